@@ -0,0 +1,204 @@
+// SPDX-FileCopyrightText: 2024 Ferenc Nandor Janky <ferenj@effective-range.com>
+// SPDX-FileCopyrightText: 2024 Attila Gombos <attila.gombos@effective-range.com>
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <FimwareFile.hpp>
+#include <ICSP_header.hpp>
+#include <PICProgrammer.hpp>
+#include <Region.hpp>
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <stop_token>
+#include <thread>
+#include <utility>
+
+// Thrown (through the returned future) by the operations that were stopped
+// before they finished
+struct OperationCancelled : std::runtime_error {
+  OperationCancelled() : std::runtime_error("Operation cancelled") {}
+};
+
+struct ProgressEvent {
+  std::size_t done{};  // bytes written / read so far
+  std::size_t total{}; // bytes of the whole operation
+};
+
+// Non-blocking facade over PICProgrammer. The operations are queued to an
+// owned executor thread, which drives the ICSP header one operation at a
+// time, every operation enters and exits the programming mode on its own.
+// Cancellation is cooperative: the stop token is checked before the
+// operation starts, and is handed to the header (see set_stop_token) which
+// stops after the word being written/read. A cancelled operation leaves the
+// programming mode and fails with OperationCancelled.
+// The progress callbacks are invoked on the executor thread.
+// The header must outlive the AsyncPICProgrammer, and must not be used by
+// anyone else in the meantime.
+template <typename Map, typename Header = ICSPHeader> class AsyncPICProgrammer {
+public:
+  using ProgressCallback = std::function<void(const ProgressEvent &)>;
+
+  explicit AsyncPICProgrammer(Map map, Header &icsp)
+      : m_map{std::move(map)}, m_icsp{icsp},
+        m_executor{[this](std::stop_token stop) { run(std::move(stop)); }} {}
+
+  AsyncPICProgrammer(const AsyncPICProgrammer &) = delete;
+  AsyncPICProgrammer &operator=(const AsyncPICProgrammer &) = delete;
+
+  // Cancels the running and the queued operations and joins the executor
+  ~AsyncPICProgrammer() { m_executor.request_stop(); }
+
+  std::future<void>
+  program_verify_async(Firmware fw,
+                       Address::Region extra_erase = Address::Region::INVALID,
+                       std::stop_token stop = {},
+                       ProgressCallback on_progress = {}) {
+    return submit(std::move(stop), [this, fw = std::move(fw), extra_erase,
+                                    on_progress = std::move(on_progress)] {
+      ProgressTracker tracker{firmware_size(fw), on_progress};
+      PICProgrammer programmer(m_map, m_icsp);
+      programmer.program_verify(fw, extra_erase, &tracker);
+    });
+  }
+
+  template <Address::region R>
+  auto read_region_async(Address::region_t<R> region, std::stop_token stop = {},
+                         ProgressCallback on_progress = {}) {
+    return submit(std::move(stop), [this, region,
+                                    on_progress = std::move(on_progress)] {
+      ProgressTracker tracker{R.size(), on_progress};
+      PICProgrammer programmer(m_map, m_icsp);
+      return m_icsp.read_region(region, &tracker);
+    });
+  }
+
+  std::future<DeviceId> read_device_id_async(std::stop_token stop = {}) {
+    return submit(std::move(stop), [this] {
+      PICProgrammer programmer(m_map, m_icsp);
+      return programmer.read_device_id();
+    });
+  }
+
+private:
+  // Stop requests of the caller and of the executor (on destruction),
+  // merged into one token for the header
+  class Cancellation {
+  public:
+    Cancellation(std::stop_token caller, std::stop_token executor)
+        : m_on_caller{std::move(caller), Stop{m_source}},
+          m_on_executor{std::move(executor), Stop{m_source}} {}
+
+    [[nodiscard]] std::stop_token token() const noexcept {
+      return m_source.get_token();
+    }
+    void throw_if_requested() const {
+      if (m_source.stop_requested()) {
+        throw OperationCancelled{};
+      }
+    }
+
+  private:
+    struct Stop {
+      std::stop_source &source;
+      void operator()() const noexcept { source.request_stop(); }
+    };
+    std::stop_source m_source;
+    std::stop_callback<Stop> m_on_caller;
+    std::stop_callback<Stop> m_on_executor;
+  };
+
+  // The header stops at the next word while the operation is cancelled
+  class StopScope {
+  public:
+    StopScope(Header &icsp, std::stop_token token) : m_icsp{icsp} {
+      m_icsp.set_stop_token(std::move(token), Header::StopAt::WORD);
+    }
+    StopScope(const StopScope &) = delete;
+    StopScope &operator=(const StopScope &) = delete;
+    ~StopScope() { m_icsp.set_stop_token({}); }
+
+  private:
+    Header &m_icsp;
+  };
+
+  class ProgressTracker final : public IProgressListener {
+  public:
+    ProgressTracker(std::size_t total, const ProgressCallback &callback)
+        : m_callback{callback}, m_event{0, total} {}
+
+    void onProgress(size_t byteCount) override {
+      m_event.done += byteCount;
+      if (m_callback) {
+        m_callback(m_event);
+      }
+    }
+
+  private:
+    const ProgressCallback &m_callback;
+    ProgressEvent m_event;
+  };
+
+  using Job = std::function<void(std::stop_token)>;
+
+  template <typename Fn> auto submit(std::stop_token stop, Fn fn) {
+    using Result = std::invoke_result_t<Fn &>;
+    // std::function needs a copyable target
+    auto task = std::make_shared<std::packaged_task<Result(std::stop_token)>>(
+        [this, stop = std::move(stop),
+         fn = std::move(fn)](std::stop_token executor) {
+          const Cancellation cancel{stop, std::move(executor)};
+          cancel.throw_if_requested();
+          const StopScope scope{m_icsp, cancel.token()};
+          try {
+            return fn();
+          } catch (IGPIO::Interrupted const &) {
+            // stopped by our token, or interrupted by a signal
+            cancel.throw_if_requested();
+            throw;
+          }
+        });
+    auto res = task->get_future();
+    {
+      std::lock_guard lock{m_mutex};
+      m_jobs.emplace_back(
+          [task = std::move(task)](std::stop_token executor) mutable {
+            (*task)(std::move(executor));
+          });
+    }
+    m_cv.notify_one();
+    return res;
+  }
+
+  void run(std::stop_token stop) {
+    for (;;) {
+      Job job;
+      {
+        std::unique_lock lock{m_mutex};
+        m_cv.wait(lock, stop, [this] { return !m_jobs.empty(); });
+        if (m_jobs.empty()) {
+          return;
+        }
+        job = std::move(m_jobs.front());
+        m_jobs.pop_front();
+      }
+      // After the stop request the queued jobs only report the cancellation
+      job(stop);
+    }
+  }
+
+  Map m_map;
+  Header &m_icsp;
+  std::mutex m_mutex;
+  std::condition_variable_any m_cv;
+  std::deque<Job> m_jobs;
+  // joined first on destruction
+  std::jthread m_executor;
+};
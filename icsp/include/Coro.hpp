@@ -0,0 +1,349 @@
+// SPDX-FileCopyrightText: 2024 Ferenc Nandor Janky <ferenj@effective-range.com>
+// SPDX-FileCopyrightText: 2024 Attila Gombos <attila.gombos@effective-range.com>
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <new>
+#include <optional>
+#include <queue>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Minimal single threaded coroutine support for the ICSP transaction engine.
+// A Task is a lazily started coroutine, which runs on a Scheduler. Awaiting
+// a Task runs it on the scheduler of the awaiting task. Tasks suspend on
+// sleep_for() while the target is busy (e.g. programming a word), in the
+// meantime the scheduler runs the other ready tasks, or idles until the
+// earliest deadline if there is nothing else to do.
+namespace coro {
+
+class Scheduler;
+
+template <typename T = void> class Task;
+
+namespace detail {
+// Recycles the coroutine frames of the calling thread, so that a loop of
+// transactions doesn't allocate once the pool is warmed up
+class FramePool {
+public:
+  static constexpr std::size_t GRANULE = 64;
+  // frames up to 1KiB are pooled
+  static constexpr std::size_t CLASSES = 16;
+
+  FramePool() = default;
+  FramePool(const FramePool &) = delete;
+  FramePool &operator=(const FramePool &) = delete;
+  ~FramePool() {
+    for (auto *block : m_free) {
+      while (block != nullptr) {
+        ::operator delete(std::exchange(block, block->next));
+      }
+    }
+  }
+
+  static void *allocate(std::size_t size) {
+    const auto cls = size_class(size);
+    if (cls >= CLASSES) {
+      return ::operator new(size);
+    }
+    if (auto *&head = local().m_free[cls]; head != nullptr) {
+      return std::exchange(head, head->next);
+    }
+    return ::operator new((cls + 1) * GRANULE);
+  }
+
+  static void deallocate(void *ptr, std::size_t size) noexcept {
+    const auto cls = size_class(size);
+    if (cls >= CLASSES) {
+      ::operator delete(ptr);
+      return;
+    }
+    auto &head = local().m_free[cls];
+    head = ::new (ptr) Block{head};
+  }
+
+private:
+  struct Block {
+    Block *next;
+  };
+
+  static constexpr std::size_t size_class(std::size_t size) noexcept {
+    return size == 0 ? 0 : (size - 1) / GRANULE;
+  }
+
+  static FramePool &local() noexcept {
+    thread_local FramePool pool;
+    return pool;
+  }
+
+  std::array<Block *, CLASSES> m_free{};
+};
+
+struct PromiseBase {
+  struct FinalAwaiter {
+    bool await_ready() noexcept { return false; }
+    template <typename P>
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<P> h) noexcept {
+      if (auto cont = h.promise().continuation; cont) {
+        return cont;
+      }
+      return std::noop_coroutine();
+    }
+    void await_resume() noexcept {}
+  };
+
+  static void *operator new(std::size_t size) {
+    return FramePool::allocate(size);
+  }
+  static void operator delete(void *ptr, std::size_t size) noexcept {
+    FramePool::deallocate(ptr, size);
+  }
+
+  std::suspend_always initial_suspend() noexcept { return {}; }
+  FinalAwaiter final_suspend() noexcept { return {}; }
+  void unhandled_exception() noexcept { error = std::current_exception(); }
+
+  void rethrow_if_failed() {
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+
+  std::coroutine_handle<> continuation{};
+  Scheduler *scheduler{};
+  std::exception_ptr error;
+};
+
+template <typename T> struct Promise : PromiseBase {
+  Task<T> get_return_object() noexcept;
+  template <typename U> void return_value(U &&val) {
+    value.emplace(std::forward<U>(val));
+  }
+  T result() {
+    rethrow_if_failed();
+    return std::move(*value);
+  }
+
+  std::optional<T> value;
+};
+
+template <> struct Promise<void> : PromiseBase {
+  Task<void> get_return_object() noexcept;
+  void return_void() noexcept {}
+  void result() { rethrow_if_failed(); }
+};
+} // namespace detail
+
+template <typename T> class [[nodiscard]] Task {
+public:
+  using promise_type = detail::Promise<T>;
+  using handle_type = std::coroutine_handle<promise_type>;
+
+  Task(Task &&other) noexcept : m_handle{std::exchange(other.m_handle, {})} {}
+  Task &operator=(Task &&other) noexcept {
+    if (this != &other) {
+      destroy();
+      m_handle = std::exchange(other.m_handle, {});
+    }
+    return *this;
+  }
+  Task(const Task &) = delete;
+  Task &operator=(const Task &) = delete;
+  ~Task() { destroy(); }
+
+  [[nodiscard]] bool done() const noexcept {
+    return !m_handle || m_handle.done();
+  }
+
+  struct Awaiter {
+    handle_type handle;
+    bool await_ready() noexcept { return false; }
+    template <typename P>
+    std::coroutine_handle<>
+    await_suspend(std::coroutine_handle<P> caller) noexcept {
+      handle.promise().continuation = caller;
+      handle.promise().scheduler = caller.promise().scheduler;
+      return handle;
+    }
+    T await_resume() { return handle.promise().result(); }
+  };
+
+  Awaiter operator co_await() && noexcept { return Awaiter{m_handle}; }
+
+private:
+  friend class Scheduler;
+  friend promise_type;
+
+  explicit Task(handle_type handle) noexcept : m_handle{handle} {}
+
+  void destroy() noexcept {
+    if (m_handle) {
+      m_handle.destroy();
+      m_handle = {};
+    }
+  }
+
+  handle_type m_handle;
+};
+
+namespace detail {
+template <typename T> Task<T> Promise<T>::get_return_object() noexcept {
+  return Task<T>{std::coroutine_handle<Promise<T>>::from_promise(*this)};
+}
+
+inline Task<void> Promise<void>::get_return_object() noexcept {
+  return Task<void>{std::coroutine_handle<Promise<void>>::from_promise(*this)};
+}
+} // namespace detail
+
+class Scheduler {
+public:
+  using Clock = std::function<std::chrono::nanoseconds()>;
+  // Blocks for at least the given duration
+  using Idle = std::function<void(std::chrono::nanoseconds)>;
+
+  // Wall clock based scheduler
+  Scheduler()
+      : Scheduler(
+            [] { return std::chrono::steady_clock::now().time_since_epoch(); },
+            [](std::chrono::nanoseconds d) {
+              std::this_thread::sleep_for(d);
+            }) {}
+  Scheduler(Clock clock, Idle idle)
+      : m_clock{std::move(clock)}, m_idle{std::move(idle)} {}
+
+  Scheduler(const Scheduler &) = delete;
+  Scheduler &operator=(const Scheduler &) = delete;
+
+  [[nodiscard]] std::chrono::nanoseconds now() const { return m_clock(); }
+
+  // Runs the task (and every other task on the scheduler) until it finishes.
+  // Throws std::logic_error if the scheduler runs out of work before that
+  // (the task waits for something that never resumes it)
+  template <typename T> T run(Task<T> task) {
+    start(task.m_handle);
+    while (!task.done() && step()) {
+    }
+    if (!task.done()) {
+      throw std::logic_error("deadlocked task");
+    }
+    return task.m_handle.promise().result();
+  }
+
+  // Adds a top level task, it is started by the next run()
+  void spawn(Task<void> task) {
+    start(task.m_handle);
+    m_spawned.push_back(std::move(task));
+  }
+
+  // Runs until every task is finished, throws the first failure of the
+  // spawned tasks
+  void run() {
+    while (step()) {
+    }
+    auto spawned = std::exchange(m_spawned, {});
+    for (auto &task : spawned) {
+      task.m_handle.promise().result();
+    }
+  }
+
+  void schedule(std::coroutine_handle<> handle) { m_ready.push_back(handle); }
+
+  void schedule_at(std::chrono::nanoseconds deadline,
+                   std::coroutine_handle<> handle) {
+    m_timers.push(Timer{deadline, m_seq++, handle});
+  }
+
+private:
+  struct Timer {
+    std::chrono::nanoseconds deadline;
+    std::uint64_t seq;
+    std::coroutine_handle<> handle;
+
+    bool operator>(const Timer &other) const noexcept {
+      return deadline != other.deadline ? deadline > other.deadline
+                                        : seq > other.seq;
+    }
+  };
+
+  template <typename P> void start(std::coroutine_handle<P> handle) {
+    handle.promise().scheduler = this;
+    schedule(handle);
+  }
+
+  // Resumes one ready task, or waits for the earliest timer
+  // returns false if there is nothing left to do
+  bool step() {
+    if (m_ready_head != m_ready.size()) {
+      auto handle = m_ready[m_ready_head++];
+      if (m_ready_head == m_ready.size()) {
+        // keeps the capacity, the steady state doesn't allocate
+        m_ready.clear();
+        m_ready_head = 0;
+      }
+      handle.resume();
+      return true;
+    }
+    if (m_timers.empty()) {
+      return false;
+    }
+    const auto first = m_timers.top().deadline;
+    if (const auto now = m_clock(); now < first) {
+      m_idle(first - now);
+    }
+    // The idle function waits at least the requested time, so the first
+    // timer is due even if the clock doesn't follow the idle time
+    const auto due = std::max(first, m_clock());
+    while (!m_timers.empty() && m_timers.top().deadline <= due) {
+      m_ready.push_back(m_timers.top().handle);
+      m_timers.pop();
+    }
+    return true;
+  }
+
+  Clock m_clock;
+  Idle m_idle;
+  // FIFO of the ready tasks, consumed from m_ready_head
+  std::vector<std::coroutine_handle<>> m_ready;
+  std::size_t m_ready_head{};
+  std::priority_queue<Timer, std::vector<Timer>, std::greater<>> m_timers;
+  std::uint64_t m_seq{};
+  std::vector<Task<void>> m_spawned;
+};
+
+// Suspends the calling task for at least the given duration
+struct sleep_for {
+  template <typename Rep, typename Period>
+  explicit sleep_for(std::chrono::duration<Rep, Period> d)
+      : duration{std::chrono::ceil<std::chrono::nanoseconds>(d)} {}
+
+  bool await_ready() const noexcept { return duration.count() <= 0; }
+  template <typename P> void await_suspend(std::coroutine_handle<P> h) {
+    auto &scheduler = *h.promise().scheduler;
+    scheduler.schedule_at(scheduler.now() + duration, h);
+  }
+  void await_resume() noexcept {}
+
+  std::chrono::nanoseconds duration;
+};
+
+// Lets the other ready tasks run
+struct yield {
+  bool await_ready() const noexcept { return false; }
+  template <typename P> void await_suspend(std::coroutine_handle<P> h) {
+    h.promise().scheduler->schedule(h);
+  }
+  void await_resume() noexcept {}
+};
+
+} // namespace coro
@@ -0,0 +1,92 @@
+// SPDX-FileCopyrightText: 2024 Ferenc Nandor Janky <ferenj@effective-range.com>
+// SPDX-FileCopyrightText: 2024 Attila Gombos <attila.gombos@effective-range.com>
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <istream>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "FimwareFile.hpp"
+#include "FirmwareBuilder.hpp"
+#include "MappedFile.hpp"
+#include "Region.hpp"
+
+#include <fmt/format.h>
+
+namespace Elf {
+// The loaded part of a PT_LOAD segment, pointing into the image
+struct Segment {
+  uint32_t addr;
+  std::span<const uint8_t> data;
+};
+
+// The PT_LOAD segments of a little endian ELF32 image at their physical
+// (load) addresses, with the file contents only: the zero filled tail
+// (p_memsz > p_filesz) is RAM initialized by the startup code.
+// Throws std::runtime_error if the image isn't a valid ELF32 file.
+std::vector<Segment> load_segments(std::string_view image);
+
+// Maps the segments into the regions of `map`, a segment may span several
+// adjacent regions. The data is copied once, from the image into the
+// elements of the Firmware (see FirmwareBuilder for the overlaps).
+template <typename Map>
+inline Firmware parse_elf_buffer(Map map, std::string_view image) {
+  // the data is at most the size of the image
+  FirmwareBuilder builder{image.size()};
+  for (const auto &segment : load_segments(image)) {
+    auto addr = segment.addr;
+    auto data = segment.data;
+    while (!data.empty()) {
+      const auto region = Address::find_region(map, addr);
+      if (!region) {
+        throw std::runtime_error(fmt::format(
+            "Out of bounds segment data at addr: 0x{:08x}", addr));
+      }
+      const auto size = std::min<std::size_t>(data.size(), region->end - addr);
+      if (const auto conflict = builder.add(*region, addr, data.first(size))) {
+        throw std::runtime_error(fmt::format(
+            "Overlapping segments with conflicting data at addr: 0x{:08x}",
+            *conflict));
+      }
+      addr += static_cast<uint32_t>(size);
+      data = data.subspan(size);
+    }
+  }
+  return std::move(builder).build();
+}
+
+// ELF needs random access, the streams are read into memory first
+template <typename Map>
+inline Firmware parse_elf_stream(Map map, std::istream &is) {
+  const std::string image{std::istreambuf_iterator<char>(is), {}};
+  if (is.bad()) {
+    throw std::runtime_error("input stream failure");
+  }
+  return parse_elf_buffer(map, image);
+}
+
+// Regular files are mapped and loaded in place, the rest (pipes, character
+// devices) are read into memory
+template <typename Map>
+inline Firmware load_elf_file(Map map, std::filesystem::path const &path) {
+  if (std::filesystem::is_regular_file(path)) {
+    if (const auto mapped = MappedFile::map(path)) {
+      return parse_elf_buffer(map, mapped->view());
+    }
+  }
+  std::ifstream ifs(path, std::ios::binary);
+  if (!ifs) {
+    throw std::runtime_error(fmt::format("Can't read {}", path.string()));
+  }
+  return parse_elf_stream(map, ifs);
+}
+} // namespace Elf
@@ -6,10 +6,17 @@
 
 #include <Region.hpp>
 
+#include <algorithm>
+#include <cstddef>
 #include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <utility>
 #include <vector>
 
-using byte_vector = std::vector<uint8_t>;
+// The data of the parsed elements comes from the parser's arena (see
+// FirmwareBuilder), copies of it are allocated on the heap
+using byte_vector = std::pmr::vector<uint8_t>;
 struct FirmwareFileRegionElem {
   uint32_t base_addr{};
   byte_vector data;
@@ -21,4 +28,58 @@ struct FirmwareFileRegion {
   std::vector<FirmwareFileRegionElem> elems;
 };
 
-using Firmware = std::vector<FirmwareFileRegion>;
\ No newline at end of file
+using FirmwareArena = std::shared_ptr<std::pmr::memory_resource>;
+
+namespace detail {
+struct FirmwareArenas {
+  std::vector<FirmwareArena> arenas;
+};
+} // namespace detail
+
+// The regions of a firmware, and the arenas their element data was
+// allocated from. The arenas are released after the regions (the base
+// listed first is destroyed last), the elements moved out of a Firmware
+// must not outlive it.
+struct Firmware : private detail::FirmwareArenas,
+                  std::vector<FirmwareFileRegion> {
+  using std::vector<FirmwareFileRegion>::vector;
+
+  Firmware() = default;
+  // the data of the copies is on the heap, the arenas aren't shared
+  Firmware(Firmware const &other)
+      : detail::FirmwareArenas{}, std::vector<FirmwareFileRegion>(other) {}
+  Firmware(Firmware &&) noexcept = default;
+  ~Firmware() = default;
+  // the old regions are released before the old arenas
+  Firmware &operator=(Firmware other) noexcept {
+    swap(other);
+    return *this;
+  }
+
+  void swap(Firmware &other) noexcept {
+    arenas.swap(other.arenas);
+    std::vector<FirmwareFileRegion>::swap(other);
+  }
+
+  // Keeps `arena` alive as long as the Firmware
+  void adopt(FirmwareArena arena) {
+    if (arena && std::find(arenas.begin(), arenas.end(), arena) ==
+                     arenas.end()) {
+      arenas.push_back(std::move(arena));
+    }
+  }
+  [[nodiscard]] std::size_t arena_count() const noexcept {
+    return arenas.size();
+  }
+};
+
+// Number of data bytes in the firmware
+inline std::size_t firmware_size(Firmware const &fw) noexcept {
+  std::size_t size{};
+  for (FirmwareFileRegion const &r : fw) {
+    for (FirmwareFileRegionElem const &elem : r.elems) {
+      size += elem.data.size();
+    }
+  }
+  return size;
+}
@@ -0,0 +1,72 @@
+// SPDX-FileCopyrightText: 2024 Ferenc Nandor Janky <ferenj@effective-range.com>
+// SPDX-FileCopyrightText: 2024 Attila Gombos <attila.gombos@effective-range.com>
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <FimwareFile.hpp>
+#include <Region.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <span>
+#include <vector>
+
+// Collects the data of a firmware in any order, as maximal contiguous runs
+// per region (an ordered map of the runs by start address, O(log n) per
+// insertion). Data overlapping a run has to be the same as the run's,
+// adjacent and overlapping runs are coalesced, so the built Firmware has
+// the fewest elements (i.e. address loads when programming) possible.
+// The data of the runs is allocated from a monotonic arena (one slab if
+// `arena_size` covers it, e.g. the size of the parsed text), the built
+// Firmware takes over the runs and the arena.
+class FirmwareBuilder {
+public:
+  explicit FirmwareBuilder(std::size_t arena_size = 0);
+  FirmwareBuilder(FirmwareBuilder &&) noexcept = default;
+  FirmwareBuilder &operator=(FirmwareBuilder &&other) noexcept;
+
+  // Returns the first address of a conflict (data overlapping with
+  // different bytes), nothing is added then
+  [[nodiscard]] std::optional<std::uint32_t>
+  add(Address::region const &region, std::uint32_t addr,
+      std::span<const std::uint8_t> data);
+  // The data is moved into a new run if it's apart from the others
+  [[nodiscard]] std::optional<std::uint32_t>
+  add(Address::region const &region, std::uint32_t addr, byte_vector &&data);
+
+  // Adds the runs of `other` (moved if they are apart, its arena is kept
+  // then), see add()
+  [[nodiscard]] std::optional<std::uint32_t> merge(FirmwareBuilder &&other);
+
+  [[nodiscard]] bool empty() const noexcept { return m_regions.empty(); }
+  [[nodiscard]] std::size_t run_count() const noexcept;
+
+  // One region entry per region with data, in the order of the addresses
+  [[nodiscard]] Firmware build() &&;
+
+private:
+  using Runs = std::map<std::uint32_t, byte_vector>;
+  struct RegionRuns {
+    Address::region region;
+    Runs runs;
+  };
+
+  Runs &runs_of(Address::region const &region);
+  template <typename Data>
+  std::optional<std::uint32_t> add_run(Address::region const &region,
+                                       std::uint32_t addr, Data &&data);
+
+  std::pmr::memory_resource *arena() const noexcept {
+    return m_arenas.front().get();
+  }
+
+  // the own arena first, then the ones of the merged builders; released
+  // after the runs
+  std::vector<FirmwareArena> m_arenas;
+  // sorted by start address
+  std::vector<RegionRuns> m_regions;
+  std::size_t m_last{};
+};
@@ -0,0 +1,96 @@
+// SPDX-FileCopyrightText: 2024 Ferenc Nandor Janky <ferenj@effective-range.com>
+// SPDX-FileCopyrightText: 2024 Attila Gombos <attila.gombos@effective-range.com>
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <FimwareFile.hpp>
+#include <IntelHex.hpp>
+#include <MappedFile.hpp>
+#include <Region.hpp>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+
+// Persistent cache of parsed firmware files. The entries are keyed by the
+// SHA-256 digest of the file content, the parser version
+// (IntelHex::parser_version) and the byte order the words were parsed in,
+// so a changed file or parser never hits a stale entry. The digest is
+// stored in the entry and compared on a hit as well.
+// An entry is a compact binary image of the Firmware (fixed size headers,
+// the data padded to 8 bytes), it's mapped and validated on a hit and the
+// data is taken over with one copy per element, without parsing. The
+// regions are only referred to by name, they are rebuilt from the memory
+// map of the caller, and every element has to be inside its region.
+// The cache is best effort: an entry that can't be read is a miss (and is
+// removed), a failing store (e.g. read-only or full file system) is
+// ignored. The least recently used entries are evicted above the limits.
+class FirmwareCache {
+public:
+  struct Options {
+    std::filesystem::path dir{default_dir()};
+    std::size_t max_entries{32};
+    std::uintmax_t max_bytes{256 * 1024 * 1024};
+  };
+
+  FirmwareCache();
+  explicit FirmwareCache(Options opts) : m_opts{std::move(opts)} {}
+
+  // $XDG_CACHE_HOME/picprogrammer, ~/.cache/picprogrammer as a fallback
+  static std::filesystem::path default_dir();
+
+  using Digest = std::array<std::uint8_t, 32>;
+  // SHA-256 of the content
+  static Digest digest(std::string_view content) noexcept;
+
+  template <auto... Rs>
+  [[nodiscard]] std::optional<Firmware> load(Address::RegionMap<Rs...>,
+                                             std::string_view content,
+                                             bool little_endian = true) const {
+    static constexpr std::array<Address::region, sizeof...(Rs)> regions{Rs...};
+    return load(regions, content, little_endian);
+  }
+  [[nodiscard]] std::optional<Firmware>
+  load(std::span<const Address::region> regions, std::string_view content,
+       bool little_endian = true) const;
+  // Returns false if the entry couldn't be written
+  bool store(std::string_view content, Firmware const &fw,
+             bool little_endian = true) const;
+  // Removes the least recently used entries above the limits
+  void evict() const;
+
+  [[nodiscard]] std::filesystem::path entry_path(std::string_view content,
+                                                 bool little_endian) const;
+  [[nodiscard]] Options const &options() const noexcept { return m_opts; }
+
+private:
+  Options m_opts;
+};
+
+// IntelHex::load_hex_file() through the cache, the regular files are mapped
+// and hashed (the pipes are parsed without the cache)
+template <typename Map>
+inline Firmware load_hex_file(Map map, std::filesystem::path const &path,
+                              FirmwareCache const &cache,
+                              bool little_endian = true) {
+  if (std::filesystem::is_regular_file(path)) {
+    if (const auto mapped = MappedFile::map(path)) {
+      const auto content = mapped->view();
+      if (auto fw = cache.load(map, content, little_endian)) {
+        return std::move(*fw);
+      }
+      auto fw =
+          IntelHex::parse_hex_buffer_parallel(map, content, {}, little_endian);
+      cache.store(content, fw, little_endian);
+      cache.evict();
+      return fw;
+    }
+  }
+  return IntelHex::load_hex_file(map, path, little_endian);
+}
@@ -0,0 +1,147 @@
+// SPDX-FileCopyrightText: 2024 Ferenc Nandor Janky <ferenj@effective-range.com>
+// SPDX-FileCopyrightText: 2024 Attila Gombos <attila.gombos@effective-range.com>
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <FimwareFile.hpp>
+#include <Region.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <vector>
+
+// Dense image of a firmware: one buffer per region covering the whole
+// region, pre-filled with the erased value, so the lookups are index
+// arithmetic and the comparisons are linear scans.
+// The pages (page_size bytes from the region start) written since the
+// construction are tracked in a dirty bitmap, every page has a hash for the
+// quick diffing of images. The hashes of the written pages are updated by
+// seal(), e.g. by the parser when it's done.
+class FlatImage {
+public:
+  static constexpr std::uint8_t erased_value = 0xFF;
+  static constexpr std::size_t default_page_size = 64;
+
+  // Bytes of the image to program at addr, views into the image
+  struct Run {
+    std::uint32_t addr;
+    std::span<const std::uint8_t> data;
+  };
+
+  class RegionImage {
+  public:
+    RegionImage(Address::region region, std::size_t page_size);
+
+    [[nodiscard]] Address::region const &region() const noexcept {
+      return m_region;
+    }
+    [[nodiscard]] std::span<const std::uint8_t> data() const noexcept {
+      return m_data;
+    }
+    [[nodiscard]] std::size_t page_size() const noexcept {
+      return m_page_size;
+    }
+    [[nodiscard]] std::size_t page_count() const noexcept {
+      return m_hashes.size();
+    }
+    [[nodiscard]] std::span<const std::uint8_t>
+    page(std::size_t page) const noexcept;
+    [[nodiscard]] std::uint32_t page_addr(std::size_t page) const noexcept {
+      return m_region.start + static_cast<std::uint32_t>(page * m_page_size);
+    }
+    [[nodiscard]] bool dirty(std::size_t page) const noexcept {
+      return test(m_dirty, page);
+    }
+    [[nodiscard]] bool any_dirty() const noexcept;
+    [[nodiscard]] bool written(std::uint32_t offset) const noexcept {
+      return test(m_written, offset);
+    }
+    // Throws std::logic_error if the page was written after seal()
+    [[nodiscard]] std::uint64_t page_hash(std::size_t page) const;
+
+    // The maximal runs of words in the dirty pages that aren't blank (all
+    // erased), i.e. what has to be programmed after a bulk erase
+    [[nodiscard]] std::vector<Run> runs() const;
+    // The runs() copied out
+    [[nodiscard]] std::vector<FirmwareFileRegionElem> segments() const;
+
+  private:
+    friend class FlatImage;
+    static bool test(std::vector<std::uint64_t> const &bits,
+                     std::size_t i) noexcept {
+      return (bits[i / 64] >> (i % 64)) & 1U;
+    }
+    void write(std::uint32_t offset, std::span<const std::uint8_t> data);
+    void seal() noexcept;
+
+    Address::region m_region;
+    std::size_t m_page_size;
+    std::vector<std::uint8_t> m_data;
+    // per byte, the pages are too coarse for the conflicts of the writes
+    std::vector<std::uint64_t> m_written;
+    std::vector<std::uint64_t> m_dirty;
+    std::vector<std::uint64_t> m_stale;
+    std::vector<std::uint64_t> m_hashes;
+  };
+
+  struct PageRef {
+    Address::Region region;
+    std::size_t page;
+
+    bool operator==(const PageRef &) const = default;
+  };
+
+  template <auto... Rs>
+  explicit FlatImage(Address::RegionMap<Rs...>,
+                     std::size_t page_size = default_page_size)
+      : FlatImage(std::vector<Address::region>{Rs...}, page_size) {}
+  explicit FlatImage(std::vector<Address::region> const &regions,
+                     std::size_t page_size = default_page_size);
+  // The image of the firmware, sealed
+  template <auto... Rs>
+  FlatImage(Address::RegionMap<Rs...> map, Firmware const &fw,
+            std::size_t page_size = default_page_size)
+      : FlatImage(map, page_size) {
+    write(fw);
+    seal();
+  }
+
+  // The bytes have to be in one region, throws std::out_of_range otherwise
+  void write(std::uint32_t addr, std::span<const std::uint8_t> data);
+  void write(Firmware const &fw);
+  // The first address where `data` would overwrite already written bytes
+  // with different values, nothing if `data` isn't in one region
+  [[nodiscard]] std::optional<std::uint32_t>
+  conflict(std::uint32_t addr, std::span<const std::uint8_t> data) const;
+  // Updates the hashes of the pages written since the last call
+  void seal() noexcept;
+
+  [[nodiscard]] std::span<const RegionImage> regions() const noexcept {
+    return m_regions;
+  }
+  [[nodiscard]] RegionImage const *find(Address::Region name) const noexcept;
+  [[nodiscard]] RegionImage const *find(std::uint32_t addr) const noexcept;
+
+  // The pages with a different content, the images must have the same
+  // layout (regions and page size) and must be sealed
+  [[nodiscard]] std::vector<PageRef> diff(FlatImage const &other) const;
+  // The first address where `data` (e.g. read back from the device) differs
+  // from the image
+  [[nodiscard]] std::optional<std::uint32_t>
+  verify(std::uint32_t addr, std::span<const std::uint8_t> data) const;
+
+  // The number of bytes in the runs() of the regions
+  [[nodiscard]] std::size_t program_size() const;
+
+  // The non-blank segments of the written regions. The written regions are
+  // kept even if they are blank, so they are still bulk erased.
+  [[nodiscard]] Firmware to_firmware() const;
+
+private:
+  RegionImage *find_region(std::uint32_t addr) noexcept;
+
+  std::vector<RegionImage> m_regions;
+};
@@ -0,0 +1,105 @@
+// SPDX-FileCopyrightText: 2024 Ferenc Nandor Janky <ferenj@effective-range.com>
+// SPDX-FileCopyrightText: 2024 Attila Gombos <attila.gombos@effective-range.com>
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <cstddef>
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <streambuf>
+#include <vector>
+
+// Streaming (de)compression of gzip data with zlib, a chunk at a time: the
+// parsers read the inflated text as it's decoded, the dumpers write through
+// the deflater, nothing is buffered as a whole or in temporary files.
+namespace Gzip {
+inline constexpr std::size_t default_chunk_size = 64 * 1024;
+// zlib's default
+inline constexpr int default_level = 6;
+
+// The first byte of the gzip magic, none of the firmware formats start
+// with it (nothing is consumed)
+bool is_gzip(std::istream &is);
+
+// Inflates the gzip (or zlib) data read from `source`, concatenated gzip
+// members are read as one stream.
+// Throws std::runtime_error on invalid or truncated data.
+class InflateBuf : public std::streambuf {
+public:
+  explicit InflateBuf(std::istream &source,
+                      std::size_t chunk_size = default_chunk_size);
+  InflateBuf(const InflateBuf &) = delete;
+  InflateBuf &operator=(const InflateBuf &) = delete;
+  ~InflateBuf() override;
+
+protected:
+  int_type underflow() override;
+
+private:
+  struct State;
+  std::istream &m_source;
+  std::unique_ptr<State> m_state;
+  std::vector<char> m_in;
+  std::vector<char> m_out;
+  bool m_done{};
+};
+
+// Deflates the data written into gzip written to `sink`. The stream is
+// completed by finish() (or on destruction, the errors are lost then).
+class DeflateBuf : public std::streambuf {
+public:
+  explicit DeflateBuf(std::ostream &sink, int level = default_level,
+                      std::size_t chunk_size = default_chunk_size);
+  DeflateBuf(const DeflateBuf &) = delete;
+  DeflateBuf &operator=(const DeflateBuf &) = delete;
+  ~DeflateBuf() override;
+
+  // Throws std::runtime_error if the sink fails
+  void finish();
+
+protected:
+  int_type overflow(int_type ch) override;
+  // the data written so far can be inflated after a flush
+  int sync() override;
+
+private:
+  struct State;
+  void deflate_pending(int flush);
+
+  std::ostream &m_sink;
+  std::unique_ptr<State> m_state;
+  std::vector<char> m_in;
+  std::vector<char> m_out;
+  bool m_finished{};
+};
+
+// The errors of the inflater are thrown from the reads (badbit is in the
+// exception mask)
+class IStream : public std::istream {
+public:
+  explicit IStream(std::istream &source)
+      : std::istream(nullptr), m_buf(source) {
+    rdbuf(&m_buf);
+    exceptions(std::ios::badbit);
+  }
+
+private:
+  InflateBuf m_buf;
+};
+
+class OStream : public std::ostream {
+public:
+  explicit OStream(std::ostream &sink, int level = default_level)
+      : std::ostream(nullptr), m_buf(sink, level) {
+    rdbuf(&m_buf);
+    exceptions(std::ios::badbit);
+  }
+
+  void finish() { m_buf.finish(); }
+
+private:
+  DeflateBuf m_buf;
+};
+} // namespace Gzip
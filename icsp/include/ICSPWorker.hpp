@@ -0,0 +1,468 @@
+// SPDX-FileCopyrightText: 2024 Ferenc Nandor Janky <ferenj@effective-range.com>
+// SPDX-FileCopyrightText: 2024 Attila Gombos <attila.gombos@effective-range.com>
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <ICSP_header.hpp>
+#include <Realtime.hpp>
+#include <Region.hpp>
+#include <SPSCRing.hpp>
+#include <fwd.hpp>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <iterator>
+#include <optional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// A single encoded ICSP operation, produced by the planning thread and
+// executed by the I/O worker thread
+struct ICSPTransaction {
+  enum class Kind : std::uint8_t {
+    ENTER_PROGRAMMING,
+    EXIT_PROGRAMMING,
+    LOAD_PC,
+    INCREMENT_ADDR,
+    BULK_ERASE,
+    WRITE,
+    WRITE_VERIFY,
+    READ,
+    SYNC,
+    STOP,
+  };
+  Kind kind{Kind::SYNC};
+  bool autoinc{};
+  // number of significant bytes in word (WRITE_VERIFY)
+  std::uint8_t size{};
+  std::uint16_t word{};
+  std::uint32_t addr{};
+  Address::region region{};
+  Address::Region erase{};
+};
+
+struct ICSPResult {
+  enum class Kind : std::uint8_t { READ, VERIFY_FAILED, ERROR, SYNC };
+  Kind kind{Kind::SYNC};
+  std::uint16_t word{};
+  std::uint16_t readback{};
+  std::uint32_t addr{};
+  Address::region region{};
+  std::exception_ptr error;
+};
+
+// Runs an ICSPHeader on a dedicated thread. The producer (owner) thread
+// encodes the operations into transactions and pushes them through a
+// lock-free ring, the worker drives the GPIO lines and sends the read data
+// and the failures back through a second ring.
+// Writes are pipelined: they return as soon as the transactions are queued,
+// and the failures are reported (thrown) by the next sync() or read.
+// The header must not be used directly while the worker is alive.
+template <GPIOBackend Backend, std::size_t N = 1024> class BasicICSPWorker {
+public:
+  using Header = BasicICSPHeader<Backend>;
+
+  struct Options {
+    // put the worker thread into real-time mode
+    std::optional<RealtimeSession::Options> realtime;
+  };
+
+  struct [[nodiscard]] ExitProg {
+    explicit ExitProg(BasicICSPWorker &worker) : m_worker{&worker} {}
+    ExitProg(const ExitProg &) = delete;
+    ExitProg &operator=(const ExitProg &) = delete;
+    ExitProg(ExitProg &&other) noexcept
+        : m_worker{std::exchange(other.m_worker, nullptr)} {}
+    ExitProg &operator=(ExitProg &&other) = delete;
+
+    ~ExitProg() {
+      if (m_worker)
+        m_worker->exit_programming_noexcept();
+    }
+    auto &icsp() const { return *m_worker; }
+
+  private:
+    BasicICSPWorker *m_worker;
+  };
+
+  explicit BasicICSPWorker(Header &icsp, Options opts = {})
+      : m_icsp{icsp},
+        m_thread{[this, rt = std::move(opts.realtime)] { run(rt); }} {
+    m_started.wait(false, std::memory_order_acquire);
+  }
+
+  BasicICSPWorker(const BasicICSPWorker &) = delete;
+  BasicICSPWorker &operator=(const BasicICSPWorker &) = delete;
+
+  // the worker stops at the STOP transaction, after the queued ones
+  ~BasicICSPWorker() {
+    push(ICSPTransaction{.kind = ICSPTransaction::Kind::STOP});
+  }
+
+  // Warnings of the real-time setup of the worker thread
+  const std::vector<std::string> &realtime_warnings() const noexcept {
+    return m_realtime_warnings;
+  }
+
+  // Low level producer API
+  void submit(const ICSPTransaction &t) {
+    if (t.kind == ICSPTransaction::Kind::SYNC) {
+      ++m_pending_syncs;
+    }
+    push(t);
+  }
+
+  std::optional<ICSPResult> poll() {
+    if (!m_backlog.empty()) {
+      auto res = std::move(m_backlog.front());
+      m_backlog.pop_front();
+      return res;
+    }
+    return m_results.try_pop();
+  }
+
+  ICSPResult wait_result() {
+    for (;;) {
+      if (auto res = poll(); res) {
+        return std::move(*res);
+      }
+      m_results.wait_not_empty();
+    }
+  }
+
+  // Waits until every submitted transaction is executed, throws the first
+  // failure since the last sync
+  void sync() {
+    submit(ICSPTransaction{.kind = ICSPTransaction::Kind::SYNC});
+    while (m_pending_syncs != 0) {
+      handle(wait_result(), nullptr);
+    }
+    rethrow_error();
+  }
+
+  // ICSPHeader compatible interface
+  ExitProg enter_programming() {
+    submit(ICSPTransaction{.kind = ICSPTransaction::Kind::ENTER_PROGRAMMING});
+    m_in_program_mode = true;
+    return ExitProg(*this);
+  }
+
+  void exit_programming() {
+    submit(ICSPTransaction{.kind = ICSPTransaction::Kind::EXIT_PROGRAMMING});
+    m_in_program_mode = false;
+    sync();
+  }
+
+  [[nodiscard]] bool programming() const noexcept { return m_in_program_mode; }
+
+  void load_pc(uint32_t addr) {
+    if (addr > 0x3F'FF'FF) {
+      throw std::out_of_range("address out of range");
+    }
+    submit(ICSPTransaction{.kind = ICSPTransaction::Kind::LOAD_PC,
+                           .addr = addr});
+  }
+
+  void increment_addr() {
+    submit(ICSPTransaction{.kind = ICSPTransaction::Kind::INCREMENT_ADDR});
+  }
+
+  void bulk_erase(Address::Region region) {
+    submit(ICSPTransaction{.kind = ICSPTransaction::Kind::BULK_ERASE,
+                           .erase = region});
+  }
+
+  template <typename MemMap, std::input_iterator It, std::sentinel_for<It> S>
+    requires(
+        std::unsigned_integral<typename std::iterator_traits<It>::value_type> &&
+        sizeof(typename std::iterator_traits<It>::value_type) == 1)
+  It write(MemMap map, uint32_t addr, It first, S last,
+           OptListener listener = {}) {
+    return write_impl<false>(map, addr, std::move(first), std::move(last),
+                             std::move(listener));
+  }
+
+  template <typename MemMap, std::input_iterator It, std::sentinel_for<It> S>
+    requires(
+        std::unsigned_integral<typename std::iterator_traits<It>::value_type> &&
+        sizeof(typename std::iterator_traits<It>::value_type) == 1)
+  It write_verify(MemMap map, uint32_t addr, It first, S last,
+                  OptListener listener = {}) {
+    return write_impl<true>(map, addr, std::move(first), std::move(last),
+                            std::move(listener));
+  }
+
+  template <typename Map, typename It>
+    requires(std::output_iterator<
+                 It, typename std::iterator_traits<It>::value_type> &&
+             sizeof(typename std::iterator_traits<It>::value_type) == 1)
+  It read_n(Map map, uint32_t addr, It first, std::size_t n,
+            OptListener listener = {}) {
+    const auto region = region_metadata(map, addr);
+    return read_n_impl(region, addr, std::move(first), n, std::move(listener));
+  }
+
+  template <Address::region R>
+  auto read_region(Address::region_t<R>, OptListener listener = {}) {
+    auto res = Address::region_data<R>{};
+    read_n_impl(R, R.start, res.data.begin(), res.data.size(),
+                std::move(listener));
+    return res;
+  }
+
+private:
+  template <bool Verify, typename MemMap, typename It, typename S>
+  It write_impl(MemMap map, uint32_t addr, It first, S last,
+                OptListener listener) {
+    const auto region = region_metadata(map, addr);
+    load_pc(addr);
+    while (first != last) {
+      ICSPTransaction t{.kind = Verify ? ICSPTransaction::Kind::WRITE_VERIFY
+                                       : ICSPTransaction::Kind::WRITE,
+                        .autoinc = !Verify && region.autoincrement_addr,
+                        .word = 0xFFFF,
+                        .addr = addr,
+                        .region = region};
+      for (; t.size < region.word_size && first != last; ++t.size, ++first) {
+        const auto byte_shift = 8 * t.size;
+        t.word &= ~(0xFF << byte_shift);
+        t.word |= static_cast<std::uint16_t>(*first) << byte_shift;
+      }
+      submit(t);
+      if (!Verify && !region.autoincrement_addr) {
+        increment_addr();
+      }
+      addr += region.word_size;
+      listener.onProgress(region.word_size);
+      // stop queueing at the first failure, sync() throws it
+      if (failure_posted()) {
+        sync();
+      }
+    }
+    return first;
+  }
+
+  template <typename It>
+  It read_n_impl(Address::region region, uint32_t addr, It first, std::size_t n,
+                 OptListener listener) {
+    load_pc(addr);
+    for (std::size_t i = 0; i < n; i += region.word_size) {
+      submit(ICSPTransaction{.kind = ICSPTransaction::Kind::READ,
+                             .autoinc = region.autoincrement_addr,
+                             .addr = addr,
+                             .region = region});
+      if (!region.autoincrement_addr) {
+        increment_addr();
+      }
+      addr += region.word_size;
+    }
+    submit(ICSPTransaction{.kind = ICSPTransaction::Kind::SYNC});
+    while (m_pending_syncs != 0) {
+      handle(wait_result(), [&](ICSPResult const &r) {
+        auto word = r.word;
+        for (std::size_t b = 0; b < region.word_size; ++b, word >>= 8) {
+          *first = static_cast<std::uint8_t>(word & 0xFF);
+          ++first;
+        }
+        listener.onProgress(region.word_size);
+      });
+    }
+    rethrow_error();
+    return first;
+  }
+
+  template <typename Map>
+  static Address::region region_metadata(Map map, uint32_t addr) {
+    return Address::with_region(
+        addr,
+        [addr]<Address::region region>(auto idx, Address::region_t<region>) {
+          if (addr % region.word_size != 0) {
+            throw std::runtime_error("Unaligned address for region");
+          }
+          return region;
+        },
+        map);
+  }
+
+  template <typename OnRead> void handle(ICSPResult res, OnRead &&on_read) {
+    using enum ICSPResult::Kind;
+    switch (res.kind) {
+    case READ:
+      if constexpr (!std::is_same_v<std::decay_t<OnRead>, std::nullptr_t>) {
+        on_read(res);
+      }
+      break;
+    case VERIFY_FAILED:
+      if (!m_error) {
+        m_error = std::make_exception_ptr(
+            programming_error(res.addr, res.region, res.word, res.readback));
+      }
+      break;
+    case ERROR:
+      if (!m_error) {
+        m_error = res.error;
+      }
+      break;
+    case SYNC:
+      --m_pending_syncs;
+      break;
+    }
+  }
+
+  // Handles the results available without waiting
+  bool failure_posted() {
+    while (auto res = poll()) {
+      handle(std::move(*res), nullptr);
+    }
+    return m_error != nullptr;
+  }
+
+  void rethrow_error() {
+    if (m_error) {
+      std::rethrow_exception(std::exchange(m_error, nullptr));
+    }
+  }
+
+  void exit_programming_noexcept() noexcept {
+    try {
+      exit_programming();
+    } catch (...) {
+      // already reported by (or outlived) the failed operation
+    }
+  }
+
+  // Producer side push, keeps the result ring drained while the request
+  // ring is full, so the worker can never block on a full result ring
+  void push(const ICSPTransaction &t) {
+    while (!m_requests.try_push(t)) {
+      bool drained = false;
+      while (auto res = m_results.try_pop()) {
+        m_backlog.push_back(std::move(*res));
+        drained = true;
+      }
+      if (!drained) {
+        std::this_thread::yield();
+      }
+    }
+  }
+
+  void push_result(ICSPResult res) {
+    while (!m_results.try_push(res)) {
+      m_results.wait_not_full();
+    }
+  }
+
+  // Worker thread
+  void run(std::optional<RealtimeSession::Options> realtime) {
+    std::optional<RealtimeSession> rt;
+    if (realtime) {
+      rt.emplace(*realtime);
+      m_realtime_warnings = rt->warnings();
+    }
+    m_started.store(true, std::memory_order_release);
+    m_started.notify_all();
+
+    std::optional<typename Header::ExitProg> prog;
+    bool failed = false;
+    for (;;) {
+      auto t = m_requests.try_pop();
+      if (!t) {
+        m_requests.wait_not_empty();
+        continue;
+      }
+      using enum ICSPTransaction::Kind;
+      if (t->kind == STOP) {
+        break;
+      }
+      if (t->kind == SYNC) {
+        failed = false;
+        push_result(ICSPResult{.kind = ICSPResult::Kind::SYNC});
+        continue;
+      }
+      if (failed) {
+        // the rest of the batch is dropped until the producer syncs
+        continue;
+      }
+      try {
+        failed = !execute(*t, prog);
+      } catch (...) {
+        failed = true;
+        push_result(ICSPResult{.kind = ICSPResult::Kind::ERROR,
+                               .error = std::current_exception()});
+      }
+    }
+    prog.reset();
+  }
+
+  // Returns false if a verify failure was posted
+  bool execute(const ICSPTransaction &t,
+               std::optional<typename Header::ExitProg> &prog) {
+    using enum ICSPTransaction::Kind;
+    switch (t.kind) {
+    case ENTER_PROGRAMMING:
+      prog.emplace(m_icsp.enter_programming());
+      break;
+    case EXIT_PROGRAMMING:
+      prog.reset();
+      break;
+    case LOAD_PC:
+      m_icsp.load_pc(t.addr);
+      break;
+    case INCREMENT_ADDR:
+      m_icsp.increment_addr();
+      break;
+    case BULK_ERASE:
+      m_icsp.bulk_erase(t.erase);
+      break;
+    case WRITE:
+      m_icsp.write_word(t.region, t.word, t.autoinc);
+      break;
+    case WRITE_VERIFY: {
+      m_icsp.write_word(t.region, t.word, false);
+      const auto readback = m_icsp.read_word(false);
+      const std::uint16_t mask = t.size == 1 ? 0xFF : 0xFFFF;
+      if ((readback & mask) != (t.word & mask)) {
+        push_result(ICSPResult{.kind = ICSPResult::Kind::VERIFY_FAILED,
+                               .word = static_cast<std::uint16_t>(t.word & mask),
+                               .readback = readback,
+                               .addr = t.addr,
+                               .region = t.region});
+        return false;
+      }
+      m_icsp.increment_addr();
+      break;
+    }
+    case READ:
+      push_result(ICSPResult{.kind = ICSPResult::Kind::READ,
+                             .word = m_icsp.read_word(t.autoinc),
+                             .addr = t.addr,
+                             .region = t.region});
+      break;
+    case SYNC:
+    case STOP:
+      break;
+    }
+    return true;
+  }
+
+  Header &m_icsp;
+  SPSCRing<ICSPTransaction, N> m_requests;
+  SPSCRing<ICSPResult, N> m_results;
+  // producer side state
+  std::deque<ICSPResult> m_backlog;
+  std::size_t m_pending_syncs{};
+  std::exception_ptr m_error;
+  bool m_in_program_mode{};
+  // set up by the worker before it signals m_started
+  std::vector<std::string> m_realtime_warnings;
+  std::atomic<bool> m_started{};
+  std::jthread m_thread;
+};
+
+using ICSPWorker = BasicICSPWorker<IGPIO>;
@@ -0,0 +1,92 @@
+// SPDX-FileCopyrightText: 2024 Ferenc Nandor Janky <ferenj@effective-range.com>
+// SPDX-FileCopyrightText: 2024 Attila Gombos <attila.gombos@effective-range.com>
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// Precomputed line levels of the ICSP transmissions.
+// Every bit is sent MSB first as a CLK high (with DATA set) and a CLK low
+// edge, so a byte is 8 DATA levels. The tables are generated at
+// compile time, sending a command or a payload only needs table lookups.
+namespace ICSPCommands {
+
+enum class Command : std::uint8_t {
+  LOAD_PC = 0x80,
+  LOAD_DATA = 0xC0,
+  LOAD_DATA_INC = 0xE0,
+  READ_DATA = 0xFC,
+  READ_DATA_INC = 0xFE,
+  INCREMENT_ADDR = 0xF8,
+  BULK_ERASE = 0x18,
+};
+
+inline constexpr std::array ALL_COMMANDS = {
+    Command::LOAD_PC,   Command::LOAD_DATA,      Command::LOAD_DATA_INC,
+    Command::READ_DATA, Command::READ_DATA_INC,  Command::INCREMENT_ADDR,
+    Command::BULK_ERASE};
+
+// The payload is 24 bits: 1 start bit, 22 data bits and 1 stop bit
+inline constexpr std::size_t PAYLOAD_BITS = 24;
+inline constexpr std::uint32_t PAYLOAD_MAX = 0x3F'FF'FF;
+
+using byte_levels_t = std::array<std::uint8_t, 8>;
+using payload_levels_t = std::array<std::uint8_t, PAYLOAD_BITS>;
+using transaction_levels_t = std::array<std::uint8_t, 8 + PAYLOAD_BITS>;
+
+constexpr byte_levels_t byte_levels(std::uint8_t byte) noexcept {
+  byte_levels_t res{};
+  for (std::size_t i = 0; i < res.size(); ++i) {
+    res[i] = (byte >> (7 - i)) & 1;
+  }
+  return res;
+}
+
+inline constexpr auto BYTE_LEVELS = [] {
+  std::array<byte_levels_t, 256> res{};
+  for (std::size_t b = 0; b < res.size(); ++b) {
+    res[b] = byte_levels(static_cast<std::uint8_t>(b));
+  }
+  return res;
+}();
+
+constexpr const byte_levels_t &command_levels(Command cmd) noexcept {
+  return BYTE_LEVELS[static_cast<std::uint8_t>(cmd)];
+}
+
+// DATA levels of a payload, the stop bit is added here
+// (the value must fit into 22 bits)
+constexpr payload_levels_t payload_levels(std::uint32_t val) noexcept {
+  const std::uint32_t tmp = (val & PAYLOAD_MAX) << 1;
+  payload_levels_t res{};
+  for (std::size_t byte = 0; byte < 3; ++byte) {
+    const auto &levels = BYTE_LEVELS[(tmp >> (16 - 8 * byte)) & 0xFF];
+    for (std::size_t i = 0; i < levels.size(); ++i) {
+      res[8 * byte + i] = levels[i];
+    }
+  }
+  return res;
+}
+
+// DATA levels of a whole command + payload transaction, assembled once and
+// clocked out in one go.
+// NOTE: the T_DLY delay between the command and the payload is the
+// responsibility of the user
+constexpr transaction_levels_t transaction_levels(Command cmd,
+                                                  std::uint32_t payload) {
+  transaction_levels_t res{};
+  const auto &cmd_levels = command_levels(cmd);
+  const auto data_levels = payload_levels(payload);
+  for (std::size_t i = 0; i < cmd_levels.size(); ++i) {
+    res[i] = cmd_levels[i];
+  }
+  for (std::size_t i = 0; i < data_levels.size(); ++i) {
+    res[cmd_levels.size() + i] = data_levels[i];
+  }
+  return res;
+}
+
+} // namespace ICSPCommands
@@ -7,22 +7,30 @@
 #include <cstddef>
 #include <range/v3/range/concepts.hpp>
 #include <range/v3/range/traits.hpp>
-#include <range/v3/view/chunk.hpp>
 #include <range/v3/view/common.hpp>
 #include <range/v3/view/subrange.hpp>
 #include <utils.hpp>
 
+#include <algorithm>
 #include <array>
+#include <bitset>
 #include <concepts>
 #include <cstdint>
 #include <fwd.hpp>
 #include <iterator>
 #include <span>
 #include <stdexcept>
+#include <stop_token>
+#include <string>
+#include <vector>
 
+#include <Coro.hpp>
+#include <GPIOBackend.hpp>
+#include <ICSP_commands.hpp>
 #include <ICSP_pins.hpp>
 #include <IGPIO.hpp>
 #include <Region.hpp>
+#include <GPIOSession.hpp>
 #include <Timings.hpp>
 
 struct IProgressListener {
@@ -43,13 +51,55 @@ private:
   IProgressListener *listener{};
 };
 
-class ICSPHeader {
+inline std::runtime_error programming_error(uint32_t addr,
+                                            Address::region region,
+                                            uint16_t wrote, uint16_t readback) {
+  return std::runtime_error(
+      fmt::format("Programming error at address 0x{:06x} (Region {}, "
+                  "word size={})! Wrote 0x{:04x}"
+                  " but read back is 0x{:04x} ",
+                  addr, Address::region_to_string(region.name),
+                  region.word_size, wrote, readback));
+}
+
+// The ICSP protocol implementation on top of a GPIO backend.
+// The backend is a template parameter, so that the bit-banging loops can be
+// inlined for concrete backends. ICSPHeader is the instantiation over the
+// IGPIO interface used with runtime backend selection.
+//
+// The operations with long waits (programming, erase, entering programming
+// mode) are coroutines (*_async), which suspend on the scheduler they are
+// run on while the target is busy. The synchronous API runs them on an
+// internal scheduler, which waits with the backend's delay().
+// Only one task may use a header at a time, the scheduler is meant to
+// overlap the waits with host work or with other headers.
+//
+// Gang mode (ICSPPins::gang_data_pins): several targets share CLK, MCLR and
+// PROG_EN, each one has its own DATA line. Every target receives the same
+// data, the DATA lines are updated together (one multi-pin write per bit) and
+// sampled together on reads. The verify failures are collected per target
+// instead of stopping at the first one, and are reported by sync() (called
+// by PICProgrammer::program_verify) or when no healthy target is left.
+//
+// Cancellation (a stop request on the token, an interrupt of the session or
+// a termination signal, see GPIOSession) is checked before every
+// transaction, and reported by throwing IGPIO::Interrupted. Leaving the
+// programming mode is never interrupted, so the target is always left in a
+// defined state.
+template <GPIOBackend Backend> class BasicICSPHeader {
 public:
-  [[nodiscard]] explicit ICSPHeader(IGPIO::Ptr igpio, ICSPPins pins = {});
-  ~ICSPHeader();
+  using BackendPtr = std::shared_ptr<Backend>;
+
+  enum class StopAt {
+    TRANSACTION, // at the next transaction
+    WORD,        // after the word being written/read is finished
+  };
+
+  [[nodiscard]] explicit BasicICSPHeader(BackendPtr igpio, ICSPPins pins = {});
+  ~BasicICSPHeader();
   using read_t = std::array<std::uint8_t, 3>;
   struct [[nodiscard]] ExitProg {
-    explicit ExitProg(ICSPHeader &icsp) : m_icsp{&icsp} {}
+    explicit ExitProg(BasicICSPHeader &icsp) : m_icsp{&icsp} {}
     ExitProg(const ExitProg &) = delete;
     ExitProg &operator=(const ExitProg &) = delete;
     ExitProg(ExitProg &&other) noexcept
@@ -63,15 +113,19 @@ public:
     auto &icsp() const { return *m_icsp; }
 
   private:
-    ICSPHeader *m_icsp;
+    BasicICSPHeader *m_icsp;
   };
-  ExitProg enter_programming();
+  ExitProg enter_programming() { return run_sync(enter_programming_async()); }
+  coro::Task<ExitProg> enter_programming_async();
   void exit_programming();
 
   // Program/Verify commands
   void load_pc(uint32_t addr);
   void increment_addr();
-  void bulk_erase(Address::Region region);
+  void bulk_erase(Address::Region region) {
+    run_sync(bulk_erase_async(region));
+  }
+  coro::Task<> bulk_erase_async(Address::Region region);
 
   template <typename Map, typename It>
     requires(std::output_iterator<
@@ -89,18 +143,29 @@ public:
         sizeof(typename std::iterator_traits<It>::value_type) == 1)
   It write(MemMap map, uint32_t addr, It first, S last,
            OptListener listener = {}) {
+    return run_sync(write_async(std::move(map), addr, std::move(first),
+                                std::move(last), std::move(listener)));
+  }
+
+  template <typename MemMap, std::input_iterator It, std::sentinel_for<It> S>
+    requires(
+        std::unsigned_integral<typename std::iterator_traits<It>::value_type> &&
+        sizeof(typename std::iterator_traits<It>::value_type) == 1)
+  coro::Task<It> write_async(MemMap map, uint32_t addr, It first, S last,
+                             OptListener listener = {}) {
     const auto region = region_metadata(map, addr);
     load_pc(addr);
-    for (auto &&to_write :
-         rg::make_subrange(first, last) | rgv::chunk(region.word_size)) {
-      write_range(region, to_write);
+    word_t buf;
+    for (auto it = first; it != last;) {
+      const WordScope word{*this};
+      co_await write_range(region, next_word(region, it, last, buf));
       if (!region.autoincrement_addr) {
         increment_addr();
       }
       addr += region.word_size;
       listener.onProgress(region.word_size);
     }
-    return first;
+    co_return first;
   }
 
   template <typename MemMap, std::input_iterator It, std::sentinel_for<It> S>
@@ -109,16 +174,28 @@ public:
         sizeof(typename std::iterator_traits<It>::value_type) == 1)
   It write_verify(MemMap map, uint32_t addr, It first, S last,
                   OptListener listener = {}) {
+    return run_sync(write_verify_async(std::move(map), addr, std::move(first),
+                                       std::move(last), std::move(listener)));
+  }
+
+  template <typename MemMap, std::input_iterator It, std::sentinel_for<It> S>
+    requires(
+        std::unsigned_integral<typename std::iterator_traits<It>::value_type> &&
+        sizeof(typename std::iterator_traits<It>::value_type) == 1)
+  coro::Task<It> write_verify_async(MemMap map, uint32_t addr, It first,
+                                    S last, OptListener listener = {}) {
     const auto region = region_metadata(map, addr);
     load_pc(addr);
-    for (auto &&to_write :
-         rg::make_subrange(first, last) | rgv::chunk(region.word_size)) {
-      write_with_readback(region, addr, to_write);
+    word_t buf;
+    for (auto it = first; it != last;) {
+      const WordScope word{*this};
+      co_await write_with_readback(region, addr,
+                                   next_word(region, it, last, buf));
       increment_addr();
       addr += region.word_size;
       listener.onProgress(region.word_size);
     }
-    return first;
+    co_return first;
   }
 
   template <Address::region R>
@@ -129,8 +206,81 @@ public:
     return res;
   }
 
+  // Reads the same range from every target (gang mode), in the order of
+  // ICSPPins::data_pins()
+  template <typename Map>
+  std::vector<std::vector<std::uint8_t>>
+  read_n_targets(Map map, uint32_t addr, std::size_t n,
+                 OptListener listener = {}) {
+    const auto region = region_metadata(map, addr);
+    std::vector<std::vector<std::uint8_t>> res(target_count());
+    for (auto &data : res) {
+      data.reserve(n);
+    }
+    load_pc(addr);
+    for (std::size_t i = 0; i < n; i += region.word_size) {
+      const WordScope word{*this};
+      read_raw(region.autoincrement_addr);
+      for (std::size_t t = 0; t < res.size(); ++t) {
+        const auto data = read_cast<2>(m_reads[t]);
+        res[t].insert(res[t].end(), data.begin(),
+                      std::next(data.begin(), region.word_size));
+      }
+      if (!region.autoincrement_addr) {
+        increment_addr();
+      }
+      listener.onProgress(region.word_size);
+    }
+    return res;
+  }
+
   [[nodiscard]] bool programming() const noexcept { return m_in_program_mode; }
 
+  struct TargetResult {
+    IGPIO::port_id_t data_pin{};
+    std::size_t failed_words{};
+    std::string first_error{};
+
+    [[nodiscard]] bool ok() const noexcept { return failed_words == 0; }
+  };
+
+  [[nodiscard]] std::size_t target_count() const noexcept {
+    return m_data_pins.size();
+  }
+  // Verify results of the targets since entering the programming mode
+  [[nodiscard]] std::span<const TargetResult> target_results() const noexcept {
+    return m_targets;
+  }
+  // Throws the summary of the failed targets, if there is any
+  void sync() const {
+    if (std::any_of(m_targets.begin(), m_targets.end(),
+                    [](const TargetResult &t) { return !t.ok(); })) {
+      throw targets_error();
+    }
+  }
+
+  void set_stop_token(std::stop_token token,
+                      StopAt stop_at = StopAt::TRANSACTION) {
+    m_stop_token = std::move(token);
+    m_stop_at = stop_at;
+  }
+
+  // Every header has its own session by default, the headers driven
+  // together may share one
+  void set_session(GPIOSession::Ptr session) { m_session = std::move(session); }
+  [[nodiscard]] GPIOSession &session() const noexcept { return *m_session; }
+  [[nodiscard]] GPIOSession::Ptr const &session_ptr() const noexcept {
+    return m_session;
+  }
+
+  // Throws IGPIO::Interrupted if the operations should stop
+  void throw_if_cancelled() const {
+    m_session->throw_if_interrupted();
+    if (m_stop_token.stop_requested()) {
+      throw IGPIO::Interrupted{};
+    }
+  }
+
   template <typename T> T read(bool autoinc = true) {
     T val = read_cast<T>(read_transaction(autoinc));
     wait(Timings::T_DLY);
@@ -143,13 +293,77 @@ public:
     return res;
   }
 
+  // Single word primitives for the transaction based executors (see
+  // ICSPWorker), the word is in little endian (in memory) layout
+  void write_word(Address::region region, std::uint16_t word, bool autoinc) {
+    run_sync(write_word_async(region, word, autoinc));
+  }
+
+  coro::Task<> write_word_async(Address::region region, std::uint16_t word,
+                                bool autoinc) {
+    const WordScope scope{*this};
+    if (region.word_size == 1) {
+      write_transaction(static_cast<std::uint8_t>(word), autoinc);
+    } else if (region.word_size == 2) {
+      write_transaction(word, autoinc);
+    } else {
+      throw std::runtime_error("Word size too big for low level write");
+    }
+    co_await coro::sleep_for(region.prog_delay().value());
+  }
+
+  std::uint16_t read_word(bool autoinc) { return read<std::uint16_t>(autoinc); }
+
 private:
+  // Marks the transactions belonging to the same word, with StopAt::WORD
+  // cancellation is only checked when the outermost scope starts
+  class WordScope {
+  public:
+    explicit WordScope(BasicICSPHeader &icsp) : m_icsp{icsp} {
+      if (m_icsp.m_word_depth == 0) {
+        m_icsp.throw_if_cancelled();
+      }
+      ++m_icsp.m_word_depth;
+    }
+    WordScope(const WordScope &) = delete;
+    WordScope &operator=(const WordScope &) = delete;
+    ~WordScope() { --m_icsp.m_word_depth; }
+
+  private:
+    BasicICSPHeader &m_icsp;
+  };
+
+  using word_t = std::array<std::uint8_t, 2>;
+
+  // Copies the next word (or the rest of a partial one) of the input into
+  // the buffer, without any range adaptors on the hot path
+  template <typename It, typename S>
+  static std::span<const std::uint8_t>
+  next_word(Address::region region, It &it, const S &last, word_t &buf) {
+    if (region.word_size > buf.size()) {
+      throw std::runtime_error("Word size too big for low level write");
+    }
+    std::size_t n = 0;
+    for (; n < region.word_size && it != last; ++n, ++it) {
+      buf[n] = static_cast<std::uint8_t>(*it);
+    }
+    return {buf.data(), n};
+  }
+
+  // Called at the start of every transaction
+  void transaction_point() const {
+    if (m_word_depth == 0 || m_stop_at == StopAt::TRANSACTION) {
+      throw_if_cancelled();
+    }
+  }
+
   template <typename It>
   It read_n_impl(Address::region region, uint32_t addr, It first, std::size_t n,
                  OptListener listener = {}) {
     load_pc(addr);
     for (std::size_t i = 0; i < n;
          i += region.word_size, std::advance(first, region.word_size)) {
+      const WordScope word{*this};
       auto data = read_cast<2>(read_raw(region.autoincrement_addr));
       std::copy(data.begin(), std::next(data.begin(), region.word_size), first);
       if (!region.autoincrement_addr) {
@@ -160,19 +374,37 @@ private:
     return first;
   }
   template <byte_range R>
-  void write_with_readback(Address::region region, uint32_t addr,
-                           R &&to_write) {
-    write_range(region, to_write, false);
-    const auto readback = read_cast<2>(read_raw(false));
+  coro::Task<> write_with_readback(Address::region region, uint32_t addr,
+                                   R &&to_write) {
+    co_await write_range(region, to_write, false);
+    read_raw(false);
     auto to_write_common = rg::common_view{to_write};
-    if (!std::equal(rg::begin(to_write_common), rg::end(to_write_common),
-                    readback.begin())) {
-      throw std::runtime_error(fmt::format(
-          "Programming error at address 0x{:06x} (Region {}, "
-          "word size={})! Wrote 0x{:04x}"
-          " but read back is 0x{:04x} ",
-          addr, Address::region_to_string(region.name), region.word_size,
-          range_cast<uint16_t>(to_write), range_cast<uint16_t>(readback)));
+    bool any_ok = false;
+    for (std::size_t t = 0; t < m_reads.size(); ++t) {
+      const auto readback = read_cast<2>(m_reads[t]);
+      if (std::equal(rg::begin(to_write_common), rg::end(to_write_common),
+                     readback.begin())) {
+        any_ok = any_ok || m_targets[t].ok();
+        continue;
+      }
+      auto err = programming_error(addr, region, range_cast<uint16_t>(to_write),
+                                   range_cast<uint16_t>(readback));
+      if (m_reads.size() == 1) {
+        throw err;
+      }
+      if (m_targets[t].failed_words++ == 0) {
+        m_targets[t].first_error = err.what();
+      }
+    }
+    if (!any_ok) {
+      throw targets_error();
+    }
+  }
+
+  std::runtime_error targets_error() const;
+  void reset_targets() {
+    for (std::size_t t = 0; t < m_targets.size(); ++t) {
+      m_targets[t] = TargetResult{m_data_pins[t]};
     }
   }
 
@@ -183,24 +415,27 @@ private:
   }
 
   template <rg::input_range R>
-  void write_range(Address::region region, R &&data, bool autoinc) {
+  coro::Task<> write_range(Address::region region, R &&data, bool autoinc) {
     if (const auto rgsize = rg::size(data);
         rgsize == 1 && region.word_size == 1) {
-      write_transaction(*rg::begin(data), autoinc);
+      return write_word_async(region, *rg::begin(data), autoinc);
     } else if (region.word_size == 2 && (rgsize == 2 || rgsize == 1)) {
       uint16_t tmp_lo = *rg::begin(data);
       uint16_t tmp_hi = rgsize == 2 ? *std::next(rg::begin(data)) : 0xFF;
       uint16_t tmp = (tmp_hi << 8) + tmp_lo;
-      write_transaction(tmp, autoinc);
-    } else {
-      throw std::runtime_error("Word size too big for low level write");
+      return write_word_async(region, tmp, autoinc);
     }
-    wait(region.prog_delay().value());
+    throw std::runtime_error("Word size too big for low level write");
   }
 
   template <rg::input_range R>
-  void write_range(Address::region region, R &&data) {
-    write_range(region, std::forward<R>(data), region.autoincrement_addr);
+  coro::Task<> write_range(Address::region region, R &&data) {
+    return write_range(region, std::forward<R>(data),
+                       region.autoincrement_addr);
+  }
+
+  template <typename T> T run_sync(coro::Task<T> task) {
+    return m_scheduler.run(std::move(task));
   }
 
   template <typename Map>
@@ -220,9 +455,9 @@ private:
   void write_transaction(uint8_t data, bool increment_pc = true);
   void write_transaction(uint16_t data, bool increment_pc = true);
 
-  constexpr auto write_cmd(bool increment_pc) const noexcept {
-    const auto cmd = increment_pc ? std::uint8_t{0xE0} : std::uint8_t{0xC0};
-    return cmd;
+  static constexpr auto write_cmd(bool increment_pc) noexcept {
+    using enum ICSPCommands::Command;
+    return increment_pc ? LOAD_DATA_INC : LOAD_DATA;
   }
 
   template <typename Rep, typename Period>
@@ -231,17 +466,289 @@ private:
     igpio->delay(duration_cast<microseconds>(d));
   }
 
+  // Wait between two clock edges, the part of the wait already covered by the
+  // backend's own edge period is not waited for again
+  template <typename Rep, typename Period>
+  void edge_wait(std::chrono::duration<Rep, Period> d) {
+    if (m_caps.min_edge_period == std::chrono::nanoseconds::zero()) {
+      wait(d);
+    } else if (const auto remaining = d - m_caps.min_edge_period;
+               remaining > decltype(remaining)::zero()) {
+      wait(remaining);
+    }
+  }
+
   void setup_programming();
   void enable_programming();
   void disable_programming();
 
   void cleanup_gpio();
+  void set_data_mode(IGPIO::Modes mode);
+  // Samples every DATA line into m_samples
+  void sample_data();
   // Writes the data out on the data lines
   // The data must be in transmission syntax, MSB first, Big Endian format
   // See write_cast() utility for converting native types to transmission format
   void write_data_sequence(std::span<const std::uint8_t> data);
+  // Clocks out the DATA levels (one per bit) see ICSPCommands tables, the
+  // rising CLK edge and the DATA levels are written in one bank operation
+  void write_levels(std::span<const std::uint8_t> levels);
+  void write_command(ICSPCommands::Command cmd) {
+    transaction_point();
+    write_levels(ICSPCommands::command_levels(cmd));
+  }
+  // The command, T_DLY and the payload
+  void write_command(ICSPCommands::Command cmd, std::uint32_t payload) {
+    transaction_point();
+    const auto levels = ICSPCommands::transaction_levels(cmd, payload);
+    const std::span view{levels};
+    write_levels(view.first(8));
+    wait(Timings::T_DLY);
+    write_levels(view.subspan(8));
+  }
 
   bool m_in_program_mode = false;
-  IGPIO::Ptr igpio;
+  BackendPtr igpio;
   ICSPPins pins;
+  IGPIO::Capabilities m_caps;
+  // DATA lines of the targets and the per target buffers, sized once, so
+  // that the bit loops don't allocate
+  std::vector<IGPIO::port_id_t> m_data_pins;
+  // CLK followed by the DATA lines, the CLK level is always high
+  std::vector<IGPIO::port_id_t> m_clk_data_pins;
+  std::vector<IGPIO::val_t> m_clk_data_levels;
+  std::vector<IGPIO::val_t> m_samples;
+  std::vector<read_t> m_reads;
+  std::vector<TargetResult> m_targets;
+  GPIOSession::Ptr m_session{GPIOSession::create()};
+  std::stop_token m_stop_token;
+  StopAt m_stop_at{StopAt::TRANSACTION};
+  unsigned m_word_depth{};
+  // runs the coroutines of the synchronous API
+  coro::Scheduler m_scheduler;
 };
+
+template <GPIOBackend Backend>
+void BasicICSPHeader<Backend>::setup_programming() {
+  if (pins.prog_en_pin) {
+    igpio->set_gpio_mode(pins.prog_en_pin.value(), IGPIO::Modes::OUTPUT, 0);
+  }
+}
+
+template <GPIOBackend Backend>
+void BasicICSPHeader<Backend>::enable_programming() {
+  if (pins.prog_en_pin) {
+    igpio->gpio_write(pins.prog_en_pin.value(), 1);
+  }
+}
+
+template <GPIOBackend Backend>
+void BasicICSPHeader<Backend>::disable_programming() {
+  if (pins.prog_en_pin) {
+    igpio->gpio_write(pins.prog_en_pin.value(), 0);
+  }
+}
+
+template <GPIOBackend Backend> void BasicICSPHeader<Backend>::cleanup_gpio() {
+  /// Request pins and set up initial values
+  igpio->set_gpio_mode(pins.mclr_pin, IGPIO::Modes::OUTPUT, 1);
+  igpio->set_gpio_mode(pins.clk_pin, IGPIO::Modes::OUTPUT, 0);
+  set_data_mode(IGPIO::Modes::OUTPUT);
+  setup_programming();
+}
+
+template <GPIOBackend Backend>
+void BasicICSPHeader<Backend>::set_data_mode(IGPIO::Modes mode) {
+  for (auto pin : m_data_pins) {
+    igpio->set_gpio_mode(pin, mode, 0);
+  }
+}
+
+template <GPIOBackend Backend> void BasicICSPHeader<Backend>::sample_data() {
+  if (m_data_pins.size() == 1) {
+    m_samples.front() = igpio->gpio_read(pins.data_pin);
+    return;
+  }
+  igpio->gpio_read_many(m_data_pins, m_samples);
+}
+
+template <GPIOBackend Backend>
+std::runtime_error BasicICSPHeader<Backend>::targets_error() const {
+  std::string msg;
+  std::size_t failed = 0;
+  for (std::size_t t = 0; t < m_targets.size(); ++t) {
+    if (const auto &target = m_targets[t]; !target.ok()) {
+      ++failed;
+      msg += fmt::format("\n  target {} (DATA pin {}): {} failed word(s), {}",
+                         t, target.data_pin, target.failed_words,
+                         target.first_error);
+    }
+  }
+  return std::runtime_error(fmt::format(
+      "Programming failed on {} of {} targets:{}", failed, m_targets.size(),
+      msg));
+}
+
+template <GPIOBackend Backend>
+BasicICSPHeader<Backend>::BasicICSPHeader(BackendPtr igp, ICSPPins pins)
+    : igpio(std::move(igp)), pins{std::move(pins)},
+      m_caps{igpio->capabilities()}, m_data_pins{this->pins.data_pins()},
+      m_clk_data_pins{this->pins.clk_pin},
+      m_clk_data_levels(m_data_pins.size() + 1, 1),
+      m_samples(m_data_pins.size()), m_reads(m_data_pins.size()),
+      m_targets(m_data_pins.size()),
+      m_scheduler{[this] { return igpio->now(); },
+                  [this](std::chrono::nanoseconds d) {
+                    igpio->delay(
+                        std::chrono::ceil<std::chrono::microseconds>(d));
+                  }} {
+  m_clk_data_pins.insert(m_clk_data_pins.end(), m_data_pins.begin(),
+                         m_data_pins.end());
+  reset_targets();
+  cleanup_gpio();
+}
+
+template <GPIOBackend Backend>
+auto BasicICSPHeader<Backend>::enter_programming_async()
+    -> coro::Task<ExitProg> {
+  using namespace std::chrono_literals;
+  if (!m_in_program_mode) {
+    throw_if_cancelled();
+    reset_targets();
+    cleanup_gpio();
+    enable_programming();
+    co_await coro::sleep_for(1ms);
+    igpio->gpio_write(pins.mclr_pin, 0);
+    co_await coro::sleep_for(Timings::T_ENTH * 2);
+    constexpr std::uint8_t KEY_SEQ[] = {0x4d_b, 0x43_b, 0x48_b, 0x50_b};
+    write_data_sequence(KEY_SEQ);
+    co_await coro::sleep_for(Timings::T_ENTH * 2);
+    m_in_program_mode = true;
+  }
+  co_return ExitProg(*this);
+}
+
+template <GPIOBackend Backend>
+void BasicICSPHeader<Backend>::load_pc(uint32_t addr) {
+  if (addr > 0x3F'FF'FF) {
+    throw std::out_of_range("address out of range");
+  }
+  write_command(ICSPCommands::Command::LOAD_PC, addr);
+  wait(Timings::T_DLY);
+}
+
+template <GPIOBackend Backend>
+void BasicICSPHeader<Backend>::write_data_sequence(
+    std::span<const std::uint8_t> data) {
+  for (auto b : data) {
+    write_levels(ICSPCommands::BYTE_LEVELS[b]);
+  }
+}
+
+template <GPIOBackend Backend>
+void BasicICSPHeader<Backend>::write_levels(
+    std::span<const std::uint8_t> levels) {
+  constexpr auto CLK_WAIT = std::max(Timings::T_CLK, Timings::T_DS);
+  for (auto level : levels) {
+    std::fill(m_clk_data_levels.begin() + 1, m_clk_data_levels.end(), level);
+    igpio->gpio_write_many(m_clk_data_pins, m_clk_data_levels);
+    edge_wait(CLK_WAIT);
+    igpio->gpio_write(pins.clk_pin, 0);
+    edge_wait(CLK_WAIT);
+  }
+}
+
+template <GPIOBackend Backend>
+void BasicICSPHeader<Backend>::write_transaction(uint8_t data,
+                                                 bool increment_pc) {
+  write_command(write_cmd(increment_pc), data);
+}
+
+template <GPIOBackend Backend>
+void BasicICSPHeader<Backend>::write_transaction(uint16_t data,
+                                                 bool increment_pc) {
+  write_command(write_cmd(increment_pc), data);
+}
+
+template <GPIOBackend Backend>
+auto BasicICSPHeader<Backend>::read_transaction(bool increment_pc) -> read_t {
+  using enum ICSPCommands::Command;
+  write_command(increment_pc ? READ_DATA_INC : READ_DATA);
+  set_data_mode(IGPIO::Modes::INPUT);
+
+  finally restore_data_gpio_mode{[this]() {
+    set_data_mode(IGPIO::Modes::OUTPUT);
+    igpio->gpio_write(pins.clk_pin, 0);
+  }};
+
+  wait(std::max(Timings::T_DLY, Timings::T_LZD));
+
+  std::fill(m_reads.begin(), m_reads.end(), read_t{});
+  for (auto byte_cnt = 2; byte_cnt >= 0; --byte_cnt) {
+    for (auto bit_idx = 7; bit_idx >= 0; --bit_idx) {
+      igpio->gpio_write(pins.clk_pin, 1);
+      static_assert(Timings::T_CLK >= Timings::T_CO,
+                    "Data out valid time greater than clock half period");
+      edge_wait(Timings::T_CLK);
+      sample_data();
+      for (std::size_t t = 0; t < m_reads.size(); ++t) {
+        if (m_samples[t]) {
+          m_reads[t][byte_cnt] |= std::uint8_t(1U << bit_idx);
+        }
+      }
+      igpio->gpio_write(pins.clk_pin, 0);
+      edge_wait(Timings::T_CLK);
+    }
+  }
+  // the single target API sees the first target
+  return m_reads.front();
+}
+
+template <GPIOBackend Backend>
+void BasicICSPHeader<Backend>::exit_programming() {
+  if (m_in_program_mode) {
+    wait(Timings::T_ENTH + Timings::T_CLK);
+    igpio->gpio_write(pins.mclr_pin, 1);
+    disable_programming();
+  }
+  m_in_program_mode = false;
+}
+
+template <GPIOBackend Backend> BasicICSPHeader<Backend>::~BasicICSPHeader() {
+  exit_programming();
+  cleanup_gpio();
+}
+
+template <GPIOBackend Backend>
+void BasicICSPHeader<Backend>::increment_addr() {
+  write_command(ICSPCommands::Command::INCREMENT_ADDR);
+  wait(Timings::T_DLY);
+}
+
+template <GPIOBackend Backend>
+coro::Task<>
+BasicICSPHeader<Backend>::bulk_erase_async(Address::Region region) {
+  constexpr auto eeprom_bit = 0;
+  constexpr auto prog_bit = 1;
+  constexpr auto userid_bit = 2;
+  constexpr auto config_bit = 3;
+  std::bitset<8> cmd{};
+  cmd.set(eeprom_bit,
+          (region & Address::Region::EEPROM) != Address::Region::INVALID);
+  cmd.set(prog_bit,
+          (region & Address::Region::PROGRAM) != Address::Region::INVALID);
+  cmd.set(userid_bit,
+          (region & Address::Region::USER) != Address::Region::INVALID);
+  cmd.set(config_bit,
+          (region & Address::Region::CONFIG) != Address::Region::INVALID);
+  if (!cmd.any()) {
+    co_return;
+  }
+  write_command(ICSPCommands::Command::BULK_ERASE,
+                static_cast<std::uint32_t>(cmd.to_ulong()));
+  co_await coro::sleep_for(Timings::T_ERAB);
+}
+
+// The virtual interface based header is compiled once in the library
+extern template class BasicICSPHeader<IGPIO>;
+using ICSPHeader = BasicICSPHeader<IGPIO>;
@@ -7,10 +7,21 @@
 #include <IGPIO.hpp>
 
 #include <optional>
+#include <vector>
 
 struct ICSPPins {
   std::optional<IGPIO::port_id_t> prog_en_pin = 6;
   IGPIO::port_id_t mclr_pin = 24;
   IGPIO::port_id_t clk_pin = 11;
   IGPIO::port_id_t data_pin = 10;
+  // DATA lines of the further targets in gang mode (see ICSPHeader), they
+  // share every other line with the first target
+  std::vector<IGPIO::port_id_t> gang_data_pins{};
+
+  // DATA lines of every target, the first one is data_pin
+  std::vector<IGPIO::port_id_t> data_pins() const {
+    std::vector<IGPIO::port_id_t> res{data_pin};
+    res.insert(res.end(), gang_data_pins.begin(), gang_data_pins.end());
+    return res;
+  }
 };
\ No newline at end of file
@@ -3,8 +3,14 @@
 // SPDX-License-Identifier: MIT
 
 #pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <charconv>
 #include <cstdint>
+#include <exception>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
 #include <numeric>
 #include <optional>
@@ -12,19 +18,27 @@
 #include <range/v3/view/reverse.hpp>
 #include <range/v3/view/subrange.hpp>
 #include <range/v3/view/transform.hpp>
-#include <regex>
 #include <string>
+#include <string_view>
 #include <system_error>
+#include <thread>
 #include <utility>
 #include <vector>
 
 #include "FimwareFile.hpp"
+#include "FirmwareBuilder.hpp"
+#include "FlatImage.hpp"
 #include "IDumper.hpp"
+#include "MappedFile.hpp"
 #include "Region.hpp"
 
 #include <fmt/format.h>
 
 namespace IntelHex {
+// Bumped whenever the Firmware parsed from the same file may change, the
+// cached parses (see FirmwareCache) are keyed by it
+inline constexpr std::uint32_t parser_version = 2;
+
 enum class RecordType : uint8_t {
   DATA = 0x00,
   END_OF_FILE = 0x01,
@@ -50,14 +64,6 @@ template <typename Enum> inline constexpr auto to_underlying(Enum e) {
   return static_cast<std::underlying_type_t<Enum>>(e);
 }
 
-// Format:
-// <StartCode><ByteCount><Address><Record type><Data><Checksum>
-inline const auto &hex_line_re() {
-  static const std::regex re(
-      R"--(:([0-9a-fA-F]{2})([0-9a-fA-F]{4})([0-9a-fA-F]{2})((?:[0-9a-fA-F]{2})+))--");
-  return re;
-}
-
 template <std::integral T, std::contiguous_iterator It>
   requires std::same_as<char, std::remove_cvref_t<std::iter_value_t<It>>>
 inline T parse_int(It first, It last, int base = 10) {
@@ -72,24 +78,13 @@ inline T parse_int(It first, It last, int base = 10) {
       ec != std::errc() ? ec : std::errc::argument_out_of_domain));
 }
 
-template <std::integral T>
-inline T parse_int(std::ssub_match match, int base = 10) {
-  return parse_int<T>(match.first, match.second, base);
-}
-
 using static_vec = std::pair<std::size_t, std::array<uint8_t, 256>>;
 
-inline auto parse_payload(std::ssub_match p) {
-  static_vec res;
-  auto bytes =
-      rg::subrange(p.first, p.second) | rgv::chunk(2) |
-      rgv::transform([](auto &&chunk) {
-        return parse_int<uint8_t>(rg::begin(chunk), rg::end(chunk), 16);
-      });
-  auto end = rg::copy(bytes, rg::begin(res.second));
-  res.first = std::distance(rg::begin(res.second), end.out);
-  return res;
-}
+// Decodes the hex digit pairs of `hex` into `out` (hex.size() / 2 bytes),
+// 16 bytes at a time on SSE2/NEON. Returns the sum of the decoded bytes
+// (mod 256, for the checksum), or nullopt if `hex` has an odd length or
+// contains a non-hex digit.
+std::optional<uint8_t> decode_hex(std::string_view hex, uint8_t *out) noexcept;
 
 struct hex_line {
   uint8_t len;
@@ -98,75 +93,268 @@ struct hex_line {
   static_vec payload;
 };
 
-inline void validate_checksum(std::string const &line, hex_line &res) {
-  const auto addr_hi = (res.addr & 0xFF00) >> 8;
-  const auto addr_lo = (res.addr & 0xFF);
-  const uint32_t accu =
-      res.len + addr_hi + addr_lo + to_underlying(res.record_type);
-
-  auto &[size, data] = res.payload;
-  const auto chk_sum =
-      std::accumulate(data.begin(), std::next(data.begin(), size), accu);
-  const auto chk = chk_sum & 0xFF;
+// `chk` is the sum of every byte of the record (checksum included)
+inline void validate_checksum(std::string_view line, uint8_t chk,
+                              hex_line &res) {
   if (chk != 0) {
     throw std::runtime_error(
         fmt::format("Invalid checksum (0x{:02x}) on line {}", chk, line));
   }
   // trim checksum from payload data
-  size -= 1;
+  res.payload.first -= 1;
 }
 
-inline std::optional<hex_line> parse_hex_line(std::istream &is) {
-  std::string line;
-  if (!std::getline(is, line)) {
-    if (!is.eof()) {
-      throw std::runtime_error("input stream failure");
-    }
-    return std::nullopt;
-  }
+// Format:
+// <StartCode><ByteCount><Address><Record type><Data><Checksum>
+// The fields are decoded straight from the line, nothing is allocated
+// unless the line is invalid.
+inline hex_line parse_hex_line(std::string_view line) {
+  // ByteCount, Address and Record type
+  constexpr std::size_t header_digits = 2 * 4;
   if (line.ends_with('\r')) {
-    line.pop_back();
+    line.remove_suffix(1);
+  }
+  hex_line res{};
+  std::array<uint8_t, 4> header{};
+  std::optional<uint8_t> header_sum;
+  std::optional<uint8_t> payload_sum;
+  // the payload has the checksum at least
+  if (line.starts_with(':') && line.size() > 1 + header_digits &&
+      line.size() - 1 - header_digits <= 2 * res.payload.second.size()) {
+    const auto payload = line.substr(1 + header_digits);
+    header_sum = decode_hex(line.substr(1, header_digits), header.data());
+    payload_sum = decode_hex(payload, res.payload.second.data());
+    res.payload.first = payload.size() / 2;
   }
-  std::smatch line_match;
-  if (!std::regex_match(line, line_match, hex_line_re())) {
+  if (!header_sum || !payload_sum) {
     throw std::runtime_error(fmt::format("Invalid line in hex file:{}", line));
   }
-  auto res = std::make_optional<hex_line>();
-  res->len = parse_int<uint8_t>(line_match[1], 16);
-  res->addr = parse_int<uint16_t>(line_match[2], 16);
-  res->record_type = toRecordType(parse_int<uint8_t>(line_match[3], 16));
-  res->payload = parse_payload(line_match[4]);
-  validate_checksum(line, *res);
+  res.len = header[0];
+  res.addr = static_cast<uint16_t>((header[1] << 8) | header[2]);
+  res.record_type = toRecordType(header[3]);
+  validate_checksum(line, static_cast<uint8_t>(*header_sum + *payload_sum),
+                    res);
   return res;
 }
 
-template <typename Map>
-inline auto parse_hex_file(Map map, std::istream &is,
-                           bool little_endian = true) {
-  Firmware result;
-  auto line = parse_hex_line(is);
-  std::optional<uint32_t> base_addr{};
-  while (line) {
+// Reads the next line into `buf`, which is reused between the lines
+inline std::optional<hex_line> parse_hex_line(std::istream &is,
+                                              std::string &buf) {
+  if (!std::getline(is, buf)) {
+    if (!is.eof()) {
+      throw std::runtime_error("input stream failure");
+    }
+    return std::nullopt;
+  }
+  return parse_hex_line(std::string_view{buf});
+}
+
+inline std::optional<hex_line> parse_hex_line(std::istream &is) {
+  std::string buf;
+  return parse_hex_line(is, buf);
+}
+
+// Splits a buffer into lines like std::getline() does, without copying
+class LineReader {
+public:
+  explicit LineReader(std::string_view text) noexcept : m_rest{text} {}
+
+  std::optional<std::string_view> next() noexcept {
+    if (m_rest.empty()) {
+      return std::nullopt;
+    }
+    const auto end = m_rest.find('\n');
+    const auto line = m_rest.substr(0, end);
+    m_rest.remove_prefix(end == m_rest.npos ? m_rest.size() : end + 1);
+    return line;
+  }
+
+private:
+  std::string_view m_rest;
+};
+
+// Adds the records returned by `next_line` (nullopt at the end of the
+// input) to `builder`, in any order. Returns true if the end of file record
+// was reached, the rest of the input is ignored then.
+// `base_addr` is the extended linear address in effect before the first
+// record (not 0 for the chunks of the parallel parser).
+template <typename Map, typename NextLine>
+inline bool process_records(Map map, NextLine &&next_line,
+                            FirmwareBuilder &builder, bool little_endian,
+                            uint32_t base_addr = 0) {
+  for (auto line = next_line(); line; line = next_line()) {
     switch (line->record_type) {
     case RecordType::DATA:
-      base_addr = process_init_record(base_addr, line.value(), result, map);
-      process_data_record(line.value(), result, map, little_endian);
+      process_data_record(*line, base_addr, builder, map, little_endian);
       break;
     case RecordType::EXTENDED_LIN_ADDR:
-      base_addr = process_extended_address_record(line.value(), result, map);
+      base_addr = process_extended_address_record(*line, map);
       break;
-    case RecordType::END_OF_FILE: {
-      return result;
-    }
+    case RecordType::END_OF_FILE:
+      return true;
     default:
       throw std::runtime_error(fmt::format("Unhandled record_type {}",
                                            to_underlying(line->record_type)));
     };
-    line = parse_hex_line(is);
   }
-  throw std::runtime_error("End-of-file missing from hex file");
+  return false;
+}
+
+template <typename Map, typename NextLine>
+inline Firmware parse_hex_records(Map map, NextLine &&next_line,
+                                  bool little_endian,
+                                  std::size_t arena_size = 0) {
+  FirmwareBuilder builder{arena_size};
+  if (!process_records(map, next_line, builder, little_endian)) {
+    throw std::runtime_error("End-of-file missing from hex file");
+  }
+  return std::move(builder).build();
+}
+
+template <typename Map>
+inline auto parse_hex_file(Map map, std::istream &is,
+                           bool little_endian = true) {
+  std::string buf;
+  return parse_hex_records(
+      map, [&] { return parse_hex_line(is, buf); }, little_endian);
+}
+
+// The records of a buffer, one by one
+inline auto buffer_records(LineReader &lines) {
+  return [&lines]() -> std::optional<hex_line> {
+    if (const auto line = lines.next()) {
+      return parse_hex_line(*line);
+    }
+    return std::nullopt;
+  };
+}
+
+// Parses the records straight from the buffer (e.g. a mapped file)
+template <typename Map>
+inline auto parse_hex_buffer(Map map, std::string_view text,
+                             bool little_endian = true) {
+  LineReader lines{text};
+  // the data is less than half of the text, the arena of the builder holds
+  // the runs as they grow
+  return parse_hex_records(map, buffer_records(lines), little_endian,
+                           text.size());
+}
+
+struct ParallelOptions {
+  // hardware concurrency if 0
+  unsigned threads{0};
+  // the chunks are at least this large (except the last one), otherwise
+  // the buffer is split evenly between the threads
+  std::size_t min_chunk_size{16 * 1024};
 };
 
+struct HexChunk {
+  std::string_view text;
+  // the extended linear address in effect at the start of the chunk
+  uint32_t base_addr{};
+};
+
+// First pass of the parallel parsing: splits the buffer into chunks of
+// whole lines (at any line boundary), and records the extended address in
+// effect at the start of every chunk. That's the only state carried from
+// line to line, so every chunk can be parsed on its own.
+std::vector<HexChunk> split_hex_chunks(std::string_view text,
+                                       std::size_t min_chunk_size);
+
+// Two-phase parsing of a large buffer: the chunks (see split_hex_chunks)
+// are decoded on a pool of threads, then merged in the order of the file.
+// The result is the same as the one of parse_hex_buffer: the records after
+// the end of file record are ignored. The first error of the file is
+// reported, except for the conflicts between the data of different chunks,
+// which are found when merging (without the line of the record).
+template <typename Map>
+inline Firmware parse_hex_buffer_parallel(Map map, std::string_view text,
+                                          ParallelOptions const &opts = {},
+                                          bool little_endian = true) {
+  struct Chunk {
+    FirmwareBuilder builder;
+    bool eof{};
+    std::exception_ptr error{};
+  };
+  const std::size_t max_threads =
+      opts.threads ? opts.threads
+                   : std::max(1U, std::thread::hardware_concurrency());
+  const auto texts = split_hex_chunks(
+      text, std::max(opts.min_chunk_size, text.size() / max_threads));
+  std::vector<Chunk> chunks;
+  chunks.reserve(texts.size());
+  for (const auto &chunk : texts) {
+    chunks.push_back(Chunk{FirmwareBuilder{chunk.text.size()}});
+  }
+  auto parse_chunk = [&](std::size_t i) {
+    try {
+      LineReader lines{texts[i].text};
+      chunks[i].eof =
+          process_records(map, buffer_records(lines), chunks[i].builder,
+                          little_endian, texts[i].base_addr);
+    } catch (...) {
+      chunks[i].error = std::current_exception();
+    }
+  };
+
+  const auto threads = std::min(max_threads, chunks.size());
+  if (threads <= 1) {
+    for (std::size_t i = 0; i < chunks.size(); ++i) {
+      parse_chunk(i);
+    }
+  } else {
+    // the workers take the next chunk when done, the chunks differ in size
+    std::atomic<std::size_t> next{0};
+    std::vector<std::jthread> pool;
+    pool.reserve(threads);
+    for (std::size_t t = 0; t < threads; ++t) {
+      pool.emplace_back([&] {
+        for (auto i = next++; i < chunks.size(); i = next++) {
+          parse_chunk(i);
+        }
+      });
+    }
+  }
+
+  // merge: the chunks before the end of file record (or the first error)
+  FirmwareBuilder result;
+  for (auto &chunk : chunks) {
+    if (chunk.error) {
+      std::rethrow_exception(chunk.error);
+    }
+    if (result.empty()) {
+      result = std::move(chunk.builder);
+    } else if (const auto conflict = result.merge(std::move(chunk.builder))) {
+      throw std::runtime_error(fmt::format(
+          "Overlapping layout, conflicting data at linear addr: 0x{:08x}",
+          *conflict));
+    }
+    if (chunk.eof) {
+      return std::move(result).build();
+    }
+  }
+  throw std::runtime_error("End-of-file missing from hex file");
+}
+
+// Regular files are mapped and parsed in place (the large ones in
+// parallel), the rest (pipes, character devices, files that can't be
+// mapped) are streamed
+template <typename Map>
+inline auto load_hex_file(Map map, std::filesystem::path const &path,
+                          bool little_endian = true) {
+  // the pipes are opened once only, a reopened pipe may lose its writer
+  if (std::filesystem::is_regular_file(path)) {
+    if (const auto mapped = MappedFile::map(path)) {
+      return parse_hex_buffer_parallel(map, mapped->view(), {}, little_endian);
+    }
+  }
+  std::ifstream ifs(path);
+  if (!ifs) {
+    throw std::runtime_error(fmt::format("Can't read {}", path.string()));
+  }
+  return parse_hex_file(map, ifs, little_endian);
+}
+
 class Dumper : public IDumper {
 public:
   inline static constexpr auto lineformat = ":{:02X}{:04X}{:02X}"sv;
@@ -200,78 +388,72 @@ private:
   std::ostream &os;
   bool little_endian{};
 };
-template <typename Map>
-auto process_init_record(std::optional<uint32_t> base_addr,
-                         const IntelHex::hex_line &line, Firmware &result,
-                         Map map) {
-  if (result.empty() || base_addr.has_value()) {
-    const auto addr = static_cast<uint32_t>(base_addr.value_or(0)) +
-                      static_cast<uint32_t>(line.addr);
-    Address::with_region(
-        addr,
-        [&]<Address::region region>(auto idx, Address::region_t<region>) {
-          result.emplace_back(region, base_addr.value_or(0));
-        },
-        map);
-    result.back().elems.emplace_back(addr);
+inline void ensure_non_conflicting(uint32_t line_addr,
+                                   std::optional<uint32_t> conflict) {
+  if (conflict) {
+    throw std::runtime_error(
+        fmt::format("Overlapping layout on line with addr:0x{:04x}, "
+                    "conflicting data at linear addr: 0x{:08x}",
+                    line_addr, *conflict));
   }
-  return std::nullopt;
 }
 
-inline void ensure_non_overlapping(uint32_t line_addr, uint32_t linear_addr,
-                                   uint32_t expected_addr) {
-  if (linear_addr < expected_addr) {
-    throw std::runtime_error(fmt::format(
-        "Overlapping layout on line with addr:0x{:04x}, linear addr: 0x{:08x}",
-        line_addr, linear_addr));
-  }
+inline void throw_out_of_bounds(uint32_t line_addr, uint32_t linear_addr) {
+  throw std::runtime_error(
+      fmt::format("Out of bounds data on line with addr:0x{:04x}, linear "
+                  "addr: 0x{:08x}",
+                  line_addr, linear_addr));
 }
 
-inline void ensure_in_bounds(Address::region const &region, uint32_t line_addr,
-                             uint32_t linear_addr) {
-
-  if (linear_addr >= region.end || linear_addr < region.start) {
-    throw std::runtime_error(
-        fmt::format("Out of bounds data on line with addr:0x{:04x}, linear "
-                    "addr: 0x{:08x}",
-                    line_addr, linear_addr));
+// The region of the data record, which has to be in it as a whole
+template <typename Map>
+inline Address::region record_region(const IntelHex::hex_line &line,
+                                     uint32_t linear_addr, Map map) {
+  const auto region = Address::find_region(map, linear_addr);
+  if (!region) {
+    throw_out_of_bounds(line.addr, linear_addr);
+  }
+  if (const auto size = static_cast<uint32_t>(line.payload.first);
+      size > region->end - linear_addr) {
+    throw_out_of_bounds(line.addr, linear_addr + size - 1);
   }
+  return *region;
 }
 
-inline void append_data(const IntelHex::hex_line &line, Firmware &result,
-                        bool little_endian) {
-  auto &curr_elem = result.back().elems.back();
+// The payload of a data record, with the bytes of the words reversed
+// (into `buf`) for big endian files
+inline std::span<const uint8_t> record_data(const IntelHex::hex_line &line,
+                                            Address::region const &region,
+                                            bool little_endian,
+                                            std::array<uint8_t, 256> &buf) {
   const auto &[size, payload] = line.payload;
-  if (const auto word_size = result.back().region.word_size;
-      word_size == 1 || little_endian) {
-    curr_elem.data.insert(curr_elem.data.end(), payload.begin(),
-                          payload.begin() + size);
-  } else {
-    auto pr = rg::make_subrange(payload.begin(), payload.begin() + size);
-    auto &&reversed =
-        pr | rgv::chunk(word_size) | rgv::transform(rgv::reverse) | rgv::join;
-    rg::copy(reversed, std::back_inserter(curr_elem.data));
+  if (const auto word_size = region.word_size;
+      word_size != 1 && !little_endian) {
+    for (std::size_t i = 0; i < size; i += word_size) {
+      const auto n = std::min<std::size_t>(word_size, size - i);
+      std::reverse_copy(payload.begin() + i, payload.begin() + i + n,
+                        buf.begin() + i);
+    }
+    return std::span(buf.data(), size);
   }
+  return std::span(payload.data(), size);
 }
 
 template <typename Map>
-auto process_data_record(const IntelHex::hex_line &line, Firmware &result,
-                         Map map, bool little_endian) {
-  auto &curr_region = result.back().region;
-  auto &curr_elem = result.back().elems.back();
-  const auto linear_addr = result.back().base_addr + line.addr;
-  const auto expected_addr = curr_elem.base_addr + curr_elem.data.size();
-  ensure_non_overlapping(line.addr, linear_addr, expected_addr);
-  ensure_in_bounds(result.back().region, line.addr, linear_addr);
-  if (expected_addr != linear_addr) {
-    result.back().elems.emplace_back(linear_addr);
-  }
-  append_data(line, result, little_endian);
+void process_data_record(const IntelHex::hex_line &line, uint32_t base_addr,
+                         FirmwareBuilder &builder, Map map,
+                         bool little_endian) {
+  const auto linear_addr = base_addr + line.addr;
+  const auto region = record_region(line, linear_addr, map);
+  std::array<uint8_t, 256> buf;
+  ensure_non_conflicting(
+      line.addr, builder.add(region, linear_addr,
+                             record_data(line, region, little_endian, buf)));
 }
 
 template <typename Map>
 auto process_extended_address_record(const IntelHex::hex_line &line,
-                                     Firmware &result, Map map) {
+                                     Map map) {
   const auto &[size, payload] = line.payload;
   if (size != 2) {
     throw std::runtime_error(
@@ -284,4 +466,48 @@ auto process_extended_address_record(const IntelHex::hex_line &line,
   return base_addr;
 }
 
+// Writes the records returned by `next_line` straight into `image`, with
+// the checks of the Firmware parser (see FirmwareBuilder).
+// Returns true if the end of file record was reached.
+template <typename Map, typename NextLine>
+inline bool process_records(Map map, NextLine &&next_line, FlatImage &image,
+                            bool little_endian) {
+  uint32_t base_addr{};
+  std::array<uint8_t, 256> buf;
+  for (auto line = next_line(); line; line = next_line()) {
+    switch (line->record_type) {
+    case RecordType::DATA: {
+      const auto linear_addr = base_addr + line->addr;
+      const auto region = record_region(*line, linear_addr, map);
+      const auto data = record_data(*line, region, little_endian, buf);
+      ensure_non_conflicting(line->addr, image.conflict(linear_addr, data));
+      image.write(linear_addr, data);
+      break;
+    }
+    case RecordType::EXTENDED_LIN_ADDR:
+      base_addr = process_extended_address_record(*line, map);
+      break;
+    case RecordType::END_OF_FILE:
+      return true;
+    default:
+      throw std::runtime_error(fmt::format("Unhandled record_type {}",
+                                           to_underlying(line->record_type)));
+    }
+  }
+  return false;
+}
+
+// Parses the buffer into a dense (sealed) image of the regions of `map`
+template <typename Map>
+inline FlatImage parse_hex_image(Map map, std::string_view text,
+                                 bool little_endian = true) {
+  FlatImage image{map};
+  LineReader lines{text};
+  if (!process_records(map, buffer_records(lines), image, little_endian)) {
+    throw std::runtime_error("End-of-file missing from hex file");
+  }
+  image.seal();
+  return image;
+}
+
 } // namespace IntelHex
@@ -0,0 +1,182 @@
+// SPDX-FileCopyrightText: 2024 Ferenc Nandor Janky <ferenj@effective-range.com>
+// SPDX-FileCopyrightText: 2024 Attila Gombos <attila.gombos@effective-range.com>
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <Coro.hpp>
+#include <FimwareFile.hpp>
+#include <ICSP_header.hpp>
+#include <ICSP_pins.hpp>
+#include <Region.hpp>
+#include <SharedICSPBus.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <exception>
+#include <memory>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fmt/format.h>
+
+// Programs several targets sharing CLK and DATA (with their own MCLR and
+// PROG_EN lines, see SharedICSPBus) by time-division interleaving: while a
+// target waits for its t_PROG (or erase) time, the next word is clocked into
+// another one. Every target is a task on one coroutine scheduler, which
+// resumes them in the order of their pending deadlines, so the time of the
+// slow (EEPROM, CONFIG) writes of N targets approaches the time of one.
+//
+// The failure of a target doesn't stop the others, the failures are
+// collected per target and reported together.
+template <typename Map> class InterleavedProgrammer {
+public:
+  InterleavedProgrammer(Map map, IGPIO::Ptr gpio,
+                        std::vector<ICSPPins> const &targets)
+      : m_map{std::move(map)}, m_bus{gpio}, m_pins{targets},
+        m_results(targets.size()),
+        m_scheduler{[gpio] { return gpio->now(); },
+                    [gpio](std::chrono::nanoseconds d) {
+                      gpio->delay(
+                          std::chrono::ceil<std::chrono::microseconds>(d));
+                    }} {
+    check_pins();
+    m_headers.reserve(m_pins.size());
+    for (const auto &pins : m_pins) {
+      m_headers.push_back(std::make_unique<ICSPHeader>(
+          m_bus.target(pins.prog_en_pin.value()), pins));
+    }
+  }
+
+  [[nodiscard]] std::size_t target_count() const noexcept {
+    return m_headers.size();
+  }
+
+  // The failures of the last program_verify(), nullptr for the targets
+  // programmed successfully
+  [[nodiscard]] std::span<const std::exception_ptr> results() const noexcept {
+    return m_results;
+  }
+
+  void program_verify(Firmware const &fw,
+                      Address::Region extra_erase = Address::Region::INVALID) {
+    std::fill(m_results.begin(), m_results.end(), nullptr);
+    std::vector<std::optional<ICSPHeader::ExitProg>> progs(m_headers.size());
+    // entering needs the bus for milliseconds, the targets enter one by one
+    for (std::size_t i = 0; i < m_headers.size(); ++i) {
+      try {
+        progs[i].emplace(
+            m_scheduler.run(m_headers[i]->enter_programming_async()));
+      } catch (const IGPIO::Interrupted &) {
+        throw;
+      } catch (...) {
+        m_results[i] = std::current_exception();
+      }
+    }
+    const auto erase = erasable_regions(fw, extra_erase);
+    for (std::size_t i = 0; i < m_headers.size(); ++i) {
+      if (progs[i]) {
+        m_scheduler.spawn(program_target(i, fw, erase));
+      }
+    }
+    m_scheduler.run();
+    progs.clear();
+    check_results();
+  }
+
+private:
+  coro::Task<> program_target(std::size_t i, Firmware const &fw,
+                              Address::Region erase) {
+    auto &icsp = *m_headers[i];
+    try {
+      co_await icsp.bulk_erase_async(erase);
+      for (auto region : {Address::Region::PROGRAM, Address::Region::EEPROM,
+                          Address::Region::USER, Address::Region::CONFIG}) {
+        for (FirmwareFileRegion const &r : fw) {
+          if (r.region.name != region) {
+            continue;
+          }
+          for (FirmwareFileRegionElem const &elem : r.elems) {
+            co_await icsp.write_verify_async(m_map, elem.base_addr,
+                                             elem.data.begin(),
+                                             elem.data.end());
+          }
+        }
+      }
+    } catch (const IGPIO::Interrupted &) {
+      throw;
+    } catch (...) {
+      m_results[i] = std::current_exception();
+    }
+  }
+
+  static Address::Region erasable_regions(Firmware const &fw,
+                                          Address::Region init) {
+    for (FirmwareFileRegion const &r : fw) {
+      init = init | r.region.name;
+    }
+    return init;
+  }
+
+  void check_pins() const {
+    if (m_pins.empty()) {
+      throw std::runtime_error("No targets to program");
+    }
+    const auto &first = m_pins.front();
+    for (std::size_t i = 0; i < m_pins.size(); ++i) {
+      const auto &pins = m_pins[i];
+      if (!pins.prog_en_pin) {
+        throw std::runtime_error(
+            fmt::format("Target {} has no PROG_EN line to isolate it", i));
+      }
+      if (pins.clk_pin != first.clk_pin || pins.data_pin != first.data_pin ||
+          !pins.gang_data_pins.empty()) {
+        throw std::runtime_error(fmt::format(
+            "Target {} doesn't share the CLK/DATA lines of target 0", i));
+      }
+      for (std::size_t j = 0; j < i; ++j) {
+        if (m_pins[j].mclr_pin == pins.mclr_pin ||
+            m_pins[j].prog_en_pin == pins.prog_en_pin) {
+          throw std::runtime_error(fmt::format(
+              "Targets {} and {} share MCLR or PROG_EN lines", j, i));
+        }
+      }
+    }
+  }
+
+  void check_results() const {
+    std::string msg;
+    std::size_t failed = 0;
+    for (std::size_t i = 0; i < m_results.size(); ++i) {
+      if (!m_results[i]) {
+        continue;
+      }
+      ++failed;
+      try {
+        std::rethrow_exception(m_results[i]);
+      } catch (const std::exception &e) {
+        msg += fmt::format("\n  target {} (MCLR pin {}): {}", i,
+                           m_pins[i].mclr_pin, e.what());
+      } catch (...) {
+        msg += fmt::format("\n  target {} (MCLR pin {}): unknown error", i,
+                           m_pins[i].mclr_pin);
+      }
+    }
+    if (failed != 0) {
+      throw std::runtime_error(fmt::format(
+          "Programming failed on {} of {} targets:{}", failed,
+          m_results.size(), msg));
+    }
+  }
+
+  Map m_map;
+  SharedICSPBus m_bus;
+  std::vector<ICSPPins> m_pins;
+  std::vector<std::exception_ptr> m_results;
+  coro::Scheduler m_scheduler;
+  // destroyed first, the bus outlives the targets
+  std::vector<std::unique_ptr<ICSPHeader>> m_headers;
+};
@@ -0,0 +1,41 @@
+// SPDX-FileCopyrightText: 2024 Ferenc Nandor Janky <ferenj@effective-range.com>
+// SPDX-FileCopyrightText: 2024 Attila Gombos <attila.gombos@effective-range.com>
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <optional>
+#include <string_view>
+
+// Read-only, private mapping of a whole file, so that it can be parsed in
+// place (no stream buffers, no copies). The whole mapping is read ahead
+// (MADV_WILLNEED), it may be parsed from several threads at once.
+class MappedFile {
+public:
+  // nullopt if the file can't be mapped: not a regular file (pipes,
+  // character devices), empty or reporting no size (e.g. procfs), or the
+  // file system doesn't support mmap. The callers stream those instead.
+  // Throws std::system_error if the file can't be opened.
+  static std::optional<MappedFile> map(std::filesystem::path const &path);
+
+  MappedFile(MappedFile &&other) noexcept;
+  MappedFile &operator=(MappedFile &&other) noexcept;
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+  ~MappedFile();
+
+  [[nodiscard]] std::string_view view() const noexcept {
+    return {static_cast<const char *>(m_data), m_size};
+  }
+  [[nodiscard]] std::size_t size() const noexcept { return m_size; }
+
+private:
+  MappedFile(void *data, std::size_t size) noexcept
+      : m_data{data}, m_size{size} {}
+  void unmap() noexcept;
+
+  void *m_data{};
+  std::size_t m_size{};
+};
@@ -0,0 +1,226 @@
+// SPDX-FileCopyrightText: 2024 Ferenc Nandor Janky <ferenj@effective-range.com>
+// SPDX-FileCopyrightText: 2024 Attila Gombos <attila.gombos@effective-range.com>
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <FimwareFile.hpp>
+#include <ICSP_header.hpp>
+#include <ICSP_pins.hpp>
+#include <PICProgrammer.hpp>
+#include <Region.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stop_token>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum class JobOperation {
+  WRITE,   // program_verify of the firmware
+  ERASE,   // bulk erase of the given regions
+  READ_ID, // device id of the target
+};
+
+struct HeaderJob {
+  JobOperation operation{JobOperation::WRITE};
+  std::shared_ptr<const Firmware> firmware{};
+  // extra regions to erase for WRITE, the erased regions for ERASE
+  Address::Region erase{Address::Region::INVALID};
+  // taken by any header if not set
+  std::optional<std::size_t> header{};
+  std::string name{};
+};
+
+struct JobResult {
+  std::size_t job{};
+  std::string name{};
+  std::size_t header{};
+  std::chrono::nanoseconds elapsed{};
+  std::optional<DeviceId> device_id{};
+  std::exception_ptr error{};
+
+  [[nodiscard]] bool ok() const noexcept { return !error; }
+};
+
+struct MultiHeaderReport {
+  // in the order of submission
+  std::vector<JobResult> results;
+  std::chrono::nanoseconds elapsed{};
+
+  [[nodiscard]] std::size_t failed() const noexcept {
+    return static_cast<std::size_t>(
+        std::count_if(results.begin(), results.end(),
+                      [](const JobResult &r) { return !r.ok(); }));
+  }
+};
+
+// Drives several independent ICSP headers (distinct pin sets) in parallel,
+// one worker thread per header. The jobs are taken from a shared queue by
+// the first idle worker (or by the header they are bound to).
+// Every header gets its own GPIO backend instance from the factory, so the
+// workers don't share line requests or shadow state, only the process wide
+// library handle of the backend.
+template <typename Map> class MultiHeaderProgrammer {
+public:
+  using GPIOFactory = std::function<IGPIO::Ptr(ICSPPins const &)>;
+
+  MultiHeaderProgrammer(Map map, std::vector<ICSPPins> const &headers,
+                        GPIOFactory const &factory)
+      : m_map{std::move(map)} {
+    if (headers.empty()) {
+      throw std::runtime_error("No ICSP headers to drive");
+    }
+    // the backends are created on this thread, the library handles of the
+    // backends are initialized once
+    m_headers.reserve(headers.size());
+    for (const auto &pins : headers) {
+      m_headers.push_back(std::make_unique<ICSPHeader>(factory(pins), pins));
+    }
+    m_workers.reserve(m_headers.size());
+    for (std::size_t i = 0; i < m_headers.size(); ++i) {
+      m_workers.emplace_back(
+          [this, i](std::stop_token stop) { run(i, std::move(stop)); });
+    }
+  }
+
+  MultiHeaderProgrammer(const MultiHeaderProgrammer &) = delete;
+  MultiHeaderProgrammer &operator=(const MultiHeaderProgrammer &) = delete;
+
+  // The running jobs are stopped at the next transaction, the queued ones
+  // are dropped
+  ~MultiHeaderProgrammer() {
+    for (auto &worker : m_workers) {
+      worker.request_stop();
+    }
+    m_workers.clear();
+  }
+
+  [[nodiscard]] std::size_t header_count() const noexcept {
+    return m_headers.size();
+  }
+
+  // Returns the index of the job in the next report
+  std::size_t submit(HeaderJob job) {
+    if (job.header && *job.header >= m_headers.size()) {
+      throw std::out_of_range(
+          fmt::format("No ICSP header with index {}", *job.header));
+    }
+    if (job.operation == JobOperation::WRITE && !job.firmware) {
+      throw std::runtime_error("Write job without firmware");
+    }
+    std::size_t id{};
+    {
+      std::lock_guard lock{m_mutex};
+      if (m_submitted == m_finished) {
+        m_start = std::chrono::steady_clock::now();
+      }
+      id = m_submitted++;
+      m_queue.push_back(Queued{id, std::move(job)});
+    }
+    m_cv.notify_all();
+    return id;
+  }
+
+  // Waits for every submitted job, the next report starts empty
+  MultiHeaderReport wait() {
+    std::unique_lock lock{m_mutex};
+    m_done_cv.wait(lock, [this] { return m_finished == m_submitted; });
+    MultiHeaderReport report{std::exchange(m_results, {}),
+                             std::chrono::steady_clock::now() - m_start};
+    std::sort(report.results.begin(), report.results.end(),
+              [](const JobResult &a, const JobResult &b) {
+                return a.job < b.job;
+              });
+    m_submitted = m_finished = 0;
+    return report;
+  }
+
+private:
+  struct Queued {
+    std::size_t id;
+    HeaderJob job;
+  };
+
+  void run(std::size_t header, std::stop_token stop) {
+    m_headers[header]->set_stop_token(stop);
+    for (;;) {
+      Queued next;
+      {
+        std::unique_lock lock{m_mutex};
+        auto it = m_queue.end();
+        const auto found = m_cv.wait(lock, stop, [&] {
+          it = std::find_if(m_queue.begin(), m_queue.end(),
+                            [header](const Queued &q) {
+                              return !q.job.header || *q.job.header == header;
+                            });
+          return it != m_queue.end();
+        });
+        if (!found) {
+          return;
+        }
+        next = std::move(*it);
+        m_queue.erase(it);
+      }
+      auto result = execute(header, next);
+      {
+        std::lock_guard lock{m_mutex};
+        m_results.push_back(std::move(result));
+        ++m_finished;
+      }
+      m_done_cv.notify_all();
+    }
+  }
+
+  JobResult execute(std::size_t header, Queued const &queued) {
+    const auto &job = queued.job;
+    JobResult res{.job = queued.id, .name = job.name, .header = header};
+    const auto start = std::chrono::steady_clock::now();
+    auto &icsp = *m_headers[header];
+    try {
+      switch (job.operation) {
+      case JobOperation::WRITE: {
+        PICProgrammer programmer(m_map, icsp);
+        programmer.program_verify(*job.firmware, job.erase);
+        break;
+      }
+      case JobOperation::ERASE: {
+        auto prog = icsp.enter_programming();
+        icsp.bulk_erase(job.erase);
+        break;
+      }
+      case JobOperation::READ_ID: {
+        PICProgrammer programmer(m_map, icsp);
+        res.device_id = programmer.read_device_id();
+        break;
+      }
+      }
+    } catch (...) {
+      res.error = std::current_exception();
+    }
+    res.elapsed = std::chrono::steady_clock::now() - start;
+    return res;
+  }
+
+  Map m_map;
+  std::vector<std::unique_ptr<ICSPHeader>> m_headers;
+  std::mutex m_mutex;
+  std::condition_variable_any m_cv;
+  std::condition_variable m_done_cv;
+  std::deque<Queued> m_queue;
+  std::vector<JobResult> m_results;
+  std::size_t m_submitted{};
+  std::size_t m_finished{};
+  std::chrono::steady_clock::time_point m_start{};
+  // joined first on destruction
+  std::vector<std::jthread> m_workers;
+};
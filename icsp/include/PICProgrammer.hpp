@@ -8,6 +8,7 @@
 #include "Region.hpp"
 #include "utils.hpp"
 #include <FimwareFile.hpp>
+#include <FlatImage.hpp>
 #include <ICSP_header.hpp>
 
 #include <array>
@@ -18,6 +19,7 @@
 #include <range/v3/numeric/accumulate.hpp>
 #include <range/v3/range/access.hpp>
 #include <range/v3/view/chunk.hpp>
+#include <range/v3/view/filter.hpp>
 #include <range/v3/view/transform.hpp>
 #include <stdexcept>
 #include <string_view>
@@ -105,13 +107,16 @@ struct DIA {
   }
 };
 
-template <typename Map> class PICProgrammer : private Map {
+template <typename Map, typename Header = ICSPHeader>
+class PICProgrammer : private Map {
 public:
-  explicit PICProgrammer(Map map, ICSPHeader &icsp)
+  using ExitProg = typename Header::ExitProg;
+
+  explicit PICProgrammer(Map map, Header &icsp)
       : Map{std::move(map)}, icsp{icsp},
         prog_guard{this->icsp.enter_programming()} {}
 
-  explicit PICProgrammer(Map map, ICSPHeader &icsp, ICSPHeader::ExitProg adopt)
+  explicit PICProgrammer(Map map, Header &icsp, ExitProg adopt)
       : Map{std::move(map)}, icsp{icsp}, prog_guard{std::move(adopt)} {
     assert(icsp.programming());
   }
@@ -120,10 +125,10 @@ public:
     const auto region_data = icsp.read_region(pic18q20map::dci_region);
     DCI dci{};
     auto s = region_data.view();
-    dci.erase_page_size = span_cast<uint16_t>(s.subspan<0, 2>());
-    dci.num_erasable_pages = span_cast<uint16_t>(s.subspan<4, 2>());
-    dci.eeprom_size = span_cast<uint16_t>(s.subspan<6, 2>());
-    dci.pin_cnt = span_cast<uint16_t>(s.subspan<8, 2>());
+    dci.erase_page_size = span_cast<uint16_t>(s.template subspan<0, 2>());
+    dci.num_erasable_pages = span_cast<uint16_t>(s.template subspan<4, 2>());
+    dci.eeprom_size = span_cast<uint16_t>(s.template subspan<6, 2>());
+    dci.pin_cnt = span_cast<uint16_t>(s.template subspan<8, 2>());
     return dci;
   }
 
@@ -141,14 +146,27 @@ public:
     return DIA::parse(region_data.view());
   };
 
+  // Planned on the FlatImage of the firmware
   void program_verify(Firmware const &fw,
-                      Address::Region extra_erase = Address::Region::INVALID) {
-    const auto regions_to_erase = erasable_regions(fw, extra_erase);
-    icsp.bulk_erase(regions_to_erase);
-    write_verify_region(fw, Address::Region::PROGRAM);
-    write_verify_region(fw, Address::Region::EEPROM);
-    write_verify_region(fw, Address::Region::USER);
-    write_verify_region(fw, Address::Region::CONFIG);
+                      Address::Region extra_erase = Address::Region::INVALID,
+                      OptListener listener = {}) {
+    program_verify(FlatImage{map(), fw}, extra_erase, std::move(listener));
+  }
+
+  // The regions with written pages are bulk erased, then only the non-blank
+  // words of the written pages are programmed
+  void program_verify(FlatImage const &image,
+                      Address::Region extra_erase = Address::Region::INVALID,
+                      OptListener listener = {}) {
+    icsp.bulk_erase(erasable_regions(image, extra_erase));
+    write_verify_region(image, Address::Region::PROGRAM, listener);
+    write_verify_region(image, Address::Region::EEPROM, listener);
+    write_verify_region(image, Address::Region::USER, listener);
+    write_verify_region(image, Address::Region::CONFIG, listener);
+    // pipelined executors (e.g. ICSPWorker) report the failures on sync
+    if constexpr (requires { icsp.sync(); }) {
+      icsp.sync();
+    }
   }
 
   Address::Region
@@ -159,22 +177,26 @@ public:
         [](FirmwareFileRegion const &r) { return r.region.name; });
   }
 
+  Address::Region
+  erasable_regions(FlatImage const &image,
+                   Address::Region init = Address::Region::INVALID) {
+    return rg::accumulate(
+        image.regions() | rgv::filter(&FlatImage::RegionImage::any_dirty),
+        init, std::bit_or<>{},
+        [](FlatImage::RegionImage const &r) { return r.region().name; });
+  }
+
 private:
-  void write_verify_region(Firmware const &fw, Address::Region reg) {
-    for (FirmwareFileRegion const &r : filter_region(fw, reg)) {
-      for (FirmwareFileRegionElem const &elem : r.elems) {
-        icsp.write_verify(map(), elem.base_addr, elem.data.begin(),
-                          elem.data.end());
+  void write_verify_region(FlatImage const &image, Address::Region reg,
+                           OptListener listener) {
+    if (const auto *region = image.find(reg)) {
+      for (const auto &run : region->runs()) {
+        icsp.write_verify(map(), run.addr, run.data.begin(), run.data.end(),
+                          listener);
       }
     }
   }
 
-  auto filter_region(Firmware const &fw, Address::Region reg) {
-    return fw | rgv::filter([reg](FirmwareFileRegion const &r) {
-             return r.region.name == reg;
-           });
-  }
-
   auto word_view(std::vector<std::uint8_t> const &v) {
     if (v.size() % 2 != 0) {
       throw std::runtime_error("unaligned memory to word size 2");
@@ -192,10 +214,12 @@ private:
   void write_verify_userids(Firmware const &fw) {}
   void write_verify_config(Firmware const &fw) {}
 
-  ICSPHeader &icsp;
-  ICSPHeader::ExitProg prog_guard;
+  Header &icsp;
+  ExitProg prog_guard;
 };
 
-template <typename Map> PICProgrammer(Map, ICSPHeader &) -> PICProgrammer<Map>;
-template <typename Map>
-PICProgrammer(Map, ICSPHeader &, ICSPHeader::ExitProg) -> PICProgrammer<Map>;
\ No newline at end of file
+template <typename Map, typename Header>
+PICProgrammer(Map, Header &) -> PICProgrammer<Map, Header>;
+template <typename Map, typename Header>
+PICProgrammer(Map, Header &, typename Header::ExitProg)
+    -> PICProgrammer<Map, Header>;
\ No newline at end of file
@@ -0,0 +1,100 @@
+// SPDX-FileCopyrightText: 2024 Ferenc Nandor Janky <ferenj@effective-range.com>
+// SPDX-FileCopyrightText: 2024 Attila Gombos <attila.gombos@effective-range.com>
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <ICSP_header.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <thread>
+
+struct ProgressSnapshot {
+  std::size_t done{};
+  std::size_t total{};
+  std::chrono::nanoseconds elapsed{};
+  // smoothed transfer rate in bytes/s
+  double rate{};
+  // unknown until the rate can be estimated
+  std::optional<std::chrono::nanoseconds> eta;
+
+  [[nodiscard]] double fraction() const noexcept {
+    return total == 0 ? 1.0 : static_cast<double>(done) / total;
+  }
+};
+
+// Rate and ETA estimation from (bytes done, time) samples, the rate is an
+// exponential moving average of the rates between the samples
+class ProgressMeter {
+public:
+  static constexpr double SMOOTHING = 0.3;
+
+  explicit ProgressMeter(std::size_t total, std::chrono::nanoseconds start = {})
+      : m_total{total}, m_start{start}, m_last_time{start} {}
+
+  ProgressSnapshot update(std::size_t done, std::chrono::nanoseconds now);
+
+private:
+  std::size_t m_total;
+  std::chrono::nanoseconds m_start;
+  std::size_t m_last_done{};
+  std::chrono::nanoseconds m_last_time;
+  std::optional<double> m_rate;
+};
+
+// Progress listener, which only does a relaxed atomic add on the calling
+// (bus) thread. The reports are delivered on a separate thread, at most once
+// per `interval`, or earlier when `every_bytes` more bytes are done (0
+// disables it), and only if there was progress since the last report.
+// finish() (or the destructor) delivers the final report on the calling
+// thread and stops the reporter thread.
+class ProgressReporter final : public IProgressListener {
+public:
+  using Callback = std::function<void(const ProgressSnapshot &)>;
+
+  struct Options {
+    std::size_t every_bytes = 0;
+    std::chrono::milliseconds interval{100};
+  };
+
+  ProgressReporter(std::size_t total, Callback callback)
+      : ProgressReporter(total, std::move(callback), Options{}) {}
+  ProgressReporter(std::size_t total, Callback callback, Options options);
+  ProgressReporter(const ProgressReporter &) = delete;
+  ProgressReporter &operator=(const ProgressReporter &) = delete;
+  ~ProgressReporter();
+
+  void onProgress(size_t byteCount) override {
+    const auto prev = m_done.fetch_add(byteCount, std::memory_order_relaxed);
+    if (const auto n = m_options.every_bytes;
+        n != 0 && prev / n != (prev + byteCount) / n) {
+      // a lost wake-up only delays the report until the next interval
+      m_cv.notify_one();
+    }
+  }
+
+  [[nodiscard]] std::size_t done() const noexcept {
+    return m_done.load(std::memory_order_relaxed);
+  }
+
+  void finish();
+
+private:
+  void run();
+  void report(std::size_t done);
+
+  Options m_options;
+  Callback m_callback;
+  ProgressMeter m_meter;
+  std::atomic<std::size_t> m_done{0};
+  std::mutex m_mutex;
+  std::condition_variable m_cv;
+  bool m_finished{false};
+  std::thread m_thread;
+};
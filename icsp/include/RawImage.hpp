@@ -0,0 +1,121 @@
+// SPDX-FileCopyrightText: 2024 Ferenc Nandor Janky <ferenj@effective-range.com>
+// SPDX-FileCopyrightText: 2024 Attila Gombos <attila.gombos@effective-range.com>
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <istream>
+#include <ostream>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "FimwareFile.hpp"
+#include "FirmwareBuilder.hpp"
+#include "IDumper.hpp"
+#include "MappedFile.hpp"
+#include "Region.hpp"
+
+#include <fmt/format.h>
+
+// Raw binary images of the regions (e.g. device dumps, golden images), the
+// data is stored as is, so loading is a copy from the mapped file.
+// Layout (the integers are little endian):
+//   "PICIMG" u16 version
+//   per region: char name[8] (e.g. "EEPROM", zero padded), u32 base address,
+//               u32 length, u32 CRC-32 of the data, u32 reserved (0),
+//               followed by `length` bytes of data
+//   end record: a region header of zeros
+namespace RawImage {
+inline constexpr std::array<char, 6> magic{'P', 'I', 'C', 'I', 'M', 'G'};
+inline constexpr std::uint16_t format_version = 1;
+inline constexpr std::size_t file_header_size = magic.size() + 2;
+inline constexpr std::size_t region_header_size = 8 + 4 * 4;
+
+// CRC-32 (IEEE 802.3, as zlib's), `crc` continues a previous one
+std::uint32_t crc32(std::span<const uint8_t> data,
+                    std::uint32_t crc = 0) noexcept;
+
+// A region of the image, pointing into it
+struct Record {
+  Address::Region name;
+  uint32_t base_addr;
+  std::span<const uint8_t> data;
+};
+
+// The records of the image, the headers and the CRCs are checked.
+// Throws std::runtime_error if the image is invalid.
+std::vector<Record> parse_records(std::string_view image);
+
+template <typename Map>
+inline Firmware parse_image(Map map, std::string_view image) {
+  // the data is at most the size of the image
+  FirmwareBuilder builder{image.size()};
+  for (const auto &record : parse_records(image)) {
+    const auto region = Address::with_region(
+        record.name,
+        []<Address::region r>(auto, Address::region_t<r>) { return r; }, map);
+    if (record.base_addr < region.start || record.base_addr > region.end ||
+        record.data.size() > region.end - record.base_addr) {
+      throw std::runtime_error(fmt::format(
+          "Image data out of the {} region at 0x{:08x} ({} bytes)",
+          region.name_str(), record.base_addr, record.data.size()));
+    }
+    if (const auto conflict =
+            builder.add(region, record.base_addr, record.data)) {
+      throw std::runtime_error(fmt::format(
+          "Overlapping image data at addr: 0x{:08x}", *conflict));
+    }
+  }
+  return std::move(builder).build();
+}
+
+// The image needs random access, the streams are read into memory first
+template <typename Map>
+inline Firmware parse_image_stream(Map map, std::istream &is) {
+  const std::string image{std::istreambuf_iterator<char>(is), {}};
+  if (is.bad()) {
+    throw std::runtime_error("input stream failure");
+  }
+  return parse_image(map, image);
+}
+
+// Regular files are mapped and loaded in place, the rest (pipes, character
+// devices) are read into memory
+template <typename Map>
+inline Firmware load_image_file(Map map, std::filesystem::path const &path) {
+  if (std::filesystem::is_regular_file(path)) {
+    if (const auto mapped = MappedFile::map(path)) {
+      return parse_image(map, mapped->view());
+    }
+  }
+  std::ifstream ifs(path, std::ios::binary);
+  if (!ifs) {
+    throw std::runtime_error(fmt::format("Can't read {}", path.string()));
+  }
+  return parse_image_stream(map, ifs);
+}
+
+class Dumper : public IDumper {
+public:
+  explicit Dumper(std::ostream &os) : os{os} {}
+
+  void dump_start() override;
+  void dump_end() override;
+  // The whole region, from its start
+  void dump_region(Address::Region reg, std::span<uint8_t> data) override;
+  void dump_data(Address::Region reg, uint32_t base_addr,
+                 std::span<const uint8_t> data);
+  // Every element of the firmware, between dump_start() and dump_end()
+  void dump_firmware(Firmware const &fw);
+
+private:
+  std::ostream &os;
+};
+} // namespace RawImage
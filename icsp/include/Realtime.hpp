@@ -0,0 +1,71 @@
+// SPDX-FileCopyrightText: 2024 Ferenc Nandor Janky <ferenj@effective-range.com>
+// SPDX-FileCopyrightText: 2024 Attila Gombos <attila.gombos@effective-range.com>
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <sched.h>
+
+// Puts the calling thread into a low-jitter execution mode for the lifetime
+// of the object:
+//  - SCHED_FIFO scheduling policy
+//  - pinned to a single (preferably isolated) CPU
+//  - all current and future memory locked, stack pre-faulted
+//  - PM QoS CPU DMA latency request (keeps the CPU out of deep idle states)
+// Every step is optional, a failing step (e.g. missing privileges) is
+// recorded in warnings() and the rest are still applied. The destructor
+// restores everything that was changed, so it must run on the same thread.
+class RealtimeSession {
+public:
+  struct Options {
+    int priority = 80;
+    // CPU to pin to, the first isolated CPU (or the last allowed one) if empty
+    std::optional<unsigned> cpu;
+    std::chrono::microseconds max_cpu_latency{0};
+    std::size_t prefault_stack = 256 * 1024;
+  };
+
+  RealtimeSession() : RealtimeSession(Options{}) {}
+  explicit RealtimeSession(Options opts);
+  RealtimeSession(const RealtimeSession &) = delete;
+  RealtimeSession &operator=(const RealtimeSession &) = delete;
+  ~RealtimeSession();
+
+  [[nodiscard]] const std::vector<std::string> &warnings() const noexcept {
+    return m_warnings;
+  }
+  [[nodiscard]] std::optional<unsigned> cpu() const noexcept { return m_cpu; }
+
+  // Touch every page of the buffer, so that it is resident (and locked when
+  // the session is active) before the time critical part starts
+  static void prefault(const void *data, std::size_t size) noexcept;
+
+  // Puts the calling thread back to the scheduling policy and affinity the
+  // thread of the active session had before the session (e.g. a taskset
+  // mask stays in effect), nothing changes without an active session.
+  // The threads started from a session inherit its policy and affinity, the
+  // helper threads (e.g. progress reporting) call this to stay off its CPU.
+  static void reset_thread() noexcept;
+
+private:
+  void set_scheduler(int priority);
+  void pin_cpu(std::optional<unsigned> cpu);
+  void lock_memory(std::size_t prefault_stack);
+  void request_cpu_latency(std::chrono::microseconds latency);
+  void warn(std::string what);
+
+  std::vector<std::string> m_warnings;
+
+  std::optional<std::pair<int, sched_param>> m_old_sched;
+  std::optional<cpu_set_t> m_old_affinity;
+  std::optional<unsigned> m_cpu;
+  bool m_memory_locked{};
+  int m_pm_qos_fd{-1};
+};
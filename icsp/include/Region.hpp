@@ -227,6 +227,16 @@ auto with_region(KeyT key, CompF comp, F f,
 
 } // namespace detail
 
+// The region of an address, if any
+template <auto... Rs>
+constexpr std::optional<region> find_region(RegionMap<Rs...>,
+                                            uint32_t addr) noexcept {
+  std::optional<region> res;
+  (void)((addr >= Rs.start && addr < Rs.end ? (res = Rs, true) : false) ||
+         ...);
+  return res;
+}
+
 template <typename F, auto... Rs>
 decltype(auto) with_region(uint32_t addr, F f, RegionMap<Rs...> rs) {
   return detail::with_region(
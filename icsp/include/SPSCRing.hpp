@@ -0,0 +1,78 @@
+// SPDX-FileCopyrightText: 2024 Ferenc Nandor Janky <ferenj@effective-range.com>
+// SPDX-FileCopyrightText: 2024 Attila Gombos <attila.gombos@effective-range.com>
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <new>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+// Bounded lock-free ring buffer for exactly one producer and one consumer
+// thread. The capacity must be a power of two.
+template <typename T, std::size_t N>
+  requires(N >= 2 && (N & (N - 1)) == 0 && std::is_default_constructible_v<T>)
+class SPSCRing {
+public:
+  static constexpr std::size_t capacity() noexcept { return N; }
+
+  // Producer side
+  template <typename U> bool try_push(U &&val) {
+    const auto head = m_head.load(std::memory_order_relaxed);
+    if (head - m_tail_cache == N) {
+      m_tail_cache = m_tail.load(std::memory_order_acquire);
+      if (head - m_tail_cache == N) {
+        return false;
+      }
+    }
+    m_slots[head % N] = std::forward<U>(val);
+    m_head.store(head + 1, std::memory_order_release);
+    m_head.notify_one();
+    return true;
+  }
+
+  // Consumer side
+  std::optional<T> try_pop() {
+    const auto tail = m_tail.load(std::memory_order_relaxed);
+    if (tail == m_head_cache) {
+      m_head_cache = m_head.load(std::memory_order_acquire);
+      if (tail == m_head_cache) {
+        return std::nullopt;
+      }
+    }
+    std::optional<T> res{std::move(m_slots[tail % N])};
+    m_tail.store(tail + 1, std::memory_order_release);
+    m_tail.notify_one();
+    return res;
+  }
+
+  // Blocks the consumer until there is something to pop
+  void wait_not_empty() const noexcept {
+    const auto tail = m_tail.load(std::memory_order_relaxed);
+    m_head.wait(tail, std::memory_order_acquire);
+  }
+
+  // Blocks the producer until there is free space
+  void wait_not_full() const noexcept {
+    const auto head = m_head.load(std::memory_order_relaxed);
+    m_tail.wait(head - N, std::memory_order_acquire);
+  }
+
+  bool empty() const noexcept {
+    return m_head.load(std::memory_order_acquire) ==
+           m_tail.load(std::memory_order_acquire);
+  }
+
+private:
+  static constexpr std::size_t CACHE_LINE = 64;
+
+  alignas(CACHE_LINE) std::atomic<std::size_t> m_head{};
+  std::size_t m_tail_cache{};
+  alignas(CACHE_LINE) std::atomic<std::size_t> m_tail{};
+  std::size_t m_head_cache{};
+  alignas(CACHE_LINE) std::array<T, N> m_slots{};
+};
@@ -0,0 +1,40 @@
+// SPDX-FileCopyrightText: 2024 Ferenc Nandor Janky <ferenj@effective-range.com>
+// SPDX-FileCopyrightText: 2024 Attila Gombos <attila.gombos@effective-range.com>
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <IGPIO.hpp>
+
+#include <memory>
+
+// CLK and DATA lines shared by several targets, each of them has its own
+// MCLR and PROG_EN lines. PROG_EN connects the ICSP lines of a target to the
+// bus, so every line operation of a target first isolates the target using
+// the bus before and connects the new one (MCLR keeps the isolated target
+// in programming mode meanwhile). The header of a target sees a plain IGPIO
+// (see target()), the PROG_EN level it writes is the target's enable state.
+//
+// Only one header may use the bus at a time (e.g. the tasks of one
+// coroutine scheduler, see InterleavedProgrammer). The bus must outlive its
+// targets.
+class SharedICSPBus {
+public:
+  explicit SharedICSPBus(IGPIO::Ptr gpio) : m_gpio{std::move(gpio)} {}
+
+  SharedICSPBus(const SharedICSPBus &) = delete;
+  SharedICSPBus &operator=(const SharedICSPBus &) = delete;
+
+  // The GPIO view of the target connected by the given PROG_EN line
+  IGPIO::Ptr target(IGPIO::port_id_t prog_en_pin);
+
+private:
+  class Target;
+
+  // Connects the target (if it is enabled), the others are isolated
+  void use(Target &target);
+  void release(Target &target);
+
+  IGPIO::Ptr m_gpio;
+  Target *m_owner{};
+};
@@ -0,0 +1,70 @@
+// SPDX-FileCopyrightText: 2024 Ferenc Nandor Janky <ferenj@effective-range.com>
+// SPDX-FileCopyrightText: 2024 Attila Gombos <attila.gombos@effective-range.com>
+// SPDX-License-Identifier: MIT
+
+#include <ElfFile.hpp>
+
+#include <cstring>
+
+#include <elf.h>
+
+namespace {
+// The headers aren't necessarily aligned in the image
+template <typename T>
+T read_header(std::string_view image, std::size_t offset,
+              std::string_view what) {
+  if (offset > image.size() || image.size() - offset < sizeof(T)) {
+    throw std::runtime_error(fmt::format("Truncated ELF {}", what));
+  }
+  T res;
+  std::memcpy(&res, image.data() + offset, sizeof(T));
+  return res;
+}
+} // namespace
+
+std::vector<Elf::Segment> Elf::load_segments(std::string_view image) {
+  if (image.size() < EI_NIDENT ||
+      std::memcmp(image.data(), ELFMAG, SELFMAG) != 0) {
+    throw std::runtime_error("Not an ELF file");
+  }
+  if (image[EI_CLASS] != ELFCLASS32) {
+    throw std::runtime_error("Only ELF32 files are supported");
+  }
+  // the PIC toolchains emit little endian files, as is the host
+  if (image[EI_DATA] != ELFDATA2LSB) {
+    throw std::runtime_error("Only little endian ELF files are supported");
+  }
+  const auto ehdr = read_header<Elf32_Ehdr>(image, 0, "header");
+  if (ehdr.e_phnum == 0) {
+    throw std::runtime_error("No program headers in the ELF file");
+  }
+  if (ehdr.e_phentsize < sizeof(Elf32_Phdr)) {
+    throw std::runtime_error(
+        fmt::format("Invalid ELF program header size {}", ehdr.e_phentsize));
+  }
+
+  std::vector<Segment> res;
+  for (std::size_t i = 0; i < ehdr.e_phnum; ++i) {
+    const auto phdr = read_header<Elf32_Phdr>(
+        image, ehdr.e_phoff + i * ehdr.e_phentsize, "program header");
+    if (phdr.p_type != PT_LOAD || phdr.p_filesz == 0) {
+      continue;
+    }
+    if (phdr.p_offset > image.size() ||
+        image.size() - phdr.p_offset < phdr.p_filesz) {
+      throw std::runtime_error(
+          fmt::format("Truncated ELF segment at offset 0x{:x}", phdr.p_offset));
+    }
+    if (phdr.p_paddr + std::uint64_t{phdr.p_filesz} > UINT32_MAX + 1ULL) {
+      throw std::runtime_error(fmt::format(
+          "ELF segment at addr: 0x{:08x} overflows the address space",
+          phdr.p_paddr));
+    }
+    res.push_back(Segment{
+        phdr.p_paddr,
+        std::span(reinterpret_cast<const uint8_t *>(image.data()) +
+                      phdr.p_offset,
+                  phdr.p_filesz)});
+  }
+  return res;
+}
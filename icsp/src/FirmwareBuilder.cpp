@@ -0,0 +1,167 @@
+// SPDX-FileCopyrightText: 2024 Ferenc Nandor Janky <ferenj@effective-range.com>
+// SPDX-FileCopyrightText: 2024 Attila Gombos <attila.gombos@effective-range.com>
+// SPDX-License-Identifier: MIT
+
+#include <FirmwareBuilder.hpp>
+
+#include <algorithm>
+#include <iterator>
+#include <type_traits>
+
+namespace {
+std::uint32_t run_end(std::pair<const std::uint32_t, byte_vector> const &run) {
+  return run.first + static_cast<std::uint32_t>(run.second.size());
+}
+} // namespace
+
+FirmwareBuilder::FirmwareBuilder(std::size_t arena_size) {
+  // the initial size must not be 0
+  m_arenas.push_back(
+      arena_size != 0
+          ? std::make_shared<std::pmr::monotonic_buffer_resource>(arena_size)
+          : std::make_shared<std::pmr::monotonic_buffer_resource>());
+}
+
+FirmwareBuilder &FirmwareBuilder::operator=(FirmwareBuilder &&other) noexcept {
+  // the runs are released before the arenas they are allocated from
+  m_regions = std::move(other.m_regions);
+  m_arenas = std::move(other.m_arenas);
+  m_last = other.m_last;
+  return *this;
+}
+
+auto FirmwareBuilder::runs_of(Address::region const &region) -> Runs & {
+  // the records of a region come mostly in a row
+  if (m_last < m_regions.size() &&
+      m_regions[m_last].region.start == region.start) {
+    return m_regions[m_last].runs;
+  }
+  const auto it = std::lower_bound(
+      m_regions.begin(), m_regions.end(), region.start,
+      [](const RegionRuns &r, std::uint32_t start) {
+        return r.region.start < start;
+      });
+  m_last = static_cast<std::size_t>(it - m_regions.begin());
+  if (it == m_regions.end() || it->region.start != region.start) {
+    m_regions.insert(it, RegionRuns{region, {}});
+  }
+  return m_regions[m_last].runs;
+}
+
+std::optional<std::uint32_t>
+FirmwareBuilder::add(Address::region const &region, std::uint32_t addr,
+                     std::span<const std::uint8_t> data) {
+  return add_run(region, addr, data);
+}
+
+std::optional<std::uint32_t>
+FirmwareBuilder::add(Address::region const &region, std::uint32_t addr,
+                     byte_vector &&data) {
+  return add_run(region, addr, std::move(data));
+}
+
+template <typename Data>
+std::optional<std::uint32_t>
+FirmwareBuilder::add_run(Address::region const &region, std::uint32_t addr,
+                         Data &&data) {
+  if (data.empty()) {
+    return std::nullopt;
+  }
+  auto &runs = runs_of(region);
+  const auto end = addr + static_cast<std::uint32_t>(data.size());
+
+  // the runs overlapping or touching [addr, end) are [first, last)
+  auto first = runs.upper_bound(addr);
+  if (first != runs.begin() && run_end(*std::prev(first)) >= addr) {
+    --first;
+  }
+  auto last = first;
+  auto merged_end = end;
+  for (; last != runs.end() && last->first <= end; ++last) {
+    const auto from = std::max(addr, last->first);
+    const auto to = std::min(end, run_end(*last));
+    for (auto a = from; a < to; ++a) {
+      if (data[a - addr] != last->second[a - last->first]) {
+        return a;
+      }
+    }
+    merged_end = std::max(merged_end, run_end(*last));
+  }
+  if (first == last) {
+    if constexpr (std::is_same_v<Data, byte_vector>) {
+      runs.emplace_hint(last, addr, std::move(data));
+    } else {
+      runs.emplace_hint(last, addr,
+                        byte_vector(data.begin(), data.end(), arena()));
+    }
+    return std::nullopt;
+  }
+
+  // the first run is extended in place (e.g. by the records in order), it
+  // is re-keyed if the data starts before it
+  if (first->first > addr) {
+    auto node = runs.extract(first);
+    auto &bytes = node.mapped();
+    bytes.insert(bytes.begin(), node.key() - addr, 0);
+    node.key() = addr;
+    first = runs.insert(last, std::move(node));
+  }
+  const auto start = first->first;
+  auto &bytes = first->second;
+  bytes.resize(merged_end - start);
+  std::copy(data.begin(), data.end(), bytes.begin() + (addr - start));
+  const auto rest = std::next(first);
+  for (auto it = rest; it != last; ++it) {
+    std::copy(it->second.begin(), it->second.end(),
+              bytes.begin() + (it->first - start));
+  }
+  runs.erase(rest, last);
+  return std::nullopt;
+}
+
+std::optional<std::uint32_t> FirmwareBuilder::merge(FirmwareBuilder &&other) {
+  // the moved runs are still allocated from the arenas of `other`
+  for (auto &arena : other.m_arenas) {
+    if (std::find(m_arenas.begin(), m_arenas.end(), arena) == m_arenas.end()) {
+      m_arenas.push_back(arena);
+    }
+  }
+  for (auto &[region, runs] : other.m_regions) {
+    for (auto &[addr, bytes] : runs) {
+      if (const auto conflict = add(region, addr, std::move(bytes))) {
+        return conflict;
+      }
+    }
+  }
+  other.m_regions.clear();
+  return std::nullopt;
+}
+
+std::size_t FirmwareBuilder::run_count() const noexcept {
+  std::size_t count{};
+  for (const auto &r : m_regions) {
+    count += r.runs.size();
+  }
+  return count;
+}
+
+Firmware FirmwareBuilder::build() && {
+  Firmware fw;
+  fw.reserve(m_regions.size());
+  for (auto &[region, runs] : m_regions) {
+    // the extended linear address of the region
+    auto &res = fw.emplace_back(region, region.start & 0xFFFF'0000U);
+    res.elems.reserve(runs.size());
+    while (!runs.empty()) {
+      auto node = runs.extract(runs.begin());
+      res.elems.push_back(
+          FirmwareFileRegionElem{node.key(), std::move(node.mapped())});
+    }
+  }
+  m_regions.clear();
+  for (auto &arena : m_arenas) {
+    fw.adopt(std::move(arena));
+  }
+  m_arenas.clear();
+  return fw;
+}
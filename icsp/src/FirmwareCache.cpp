@@ -0,0 +1,401 @@
+// SPDX-FileCopyrightText: 2024 Ferenc Nandor Janky <ferenj@effective-range.com>
+// SPDX-FileCopyrightText: 2024 Attila Gombos <attila.gombos@effective-range.com>
+// SPDX-License-Identifier: MIT
+
+#include <FirmwareCache.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <memory_resource>
+#include <system_error>
+#include <type_traits>
+#include <vector>
+
+#include <unistd.h>
+
+#include <fmt/format.h>
+#include <fmt/ranges.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+constexpr std::array<char, 8> MAGIC{'I', 'C', 'S', 'P', 'F', 'W', 'C', '\0'};
+constexpr std::uint32_t FORMAT_VERSION = 2;
+// written natively, a cache copied to a host of the other byte order misses
+constexpr std::uint32_t BYTE_ORDER_MARK = 0x01020304;
+constexpr auto ENTRY_EXT = ".fwc";
+
+struct FileHeader {
+  std::array<char, 8> magic;
+  std::uint32_t format_version;
+  std::uint32_t byte_order;
+  std::uint32_t parser_version;
+  std::uint32_t little_endian;
+  FirmwareCache::Digest content_digest;
+  std::uint64_t content_size;
+  std::uint64_t region_count;
+};
+
+// the region itself comes from the memory map
+struct RegionHeader {
+  std::uint32_t name;
+  std::uint32_t elem_count;
+};
+
+struct ElemHeader {
+  std::uint32_t base_addr;
+  std::uint32_t size;
+};
+
+static_assert(sizeof(FileHeader) % 8 == 0 && sizeof(RegionHeader) % 8 == 0 &&
+              sizeof(ElemHeader) % 8 == 0);
+
+// FIPS 180-4 SHA-256, the cache keys must not collide for different
+// content (a hit is flashed as is)
+class Sha256 {
+public:
+  void update(std::string_view data) noexcept {
+    for (const auto c : data) {
+      m_block[m_fill++] = static_cast<std::uint8_t>(c);
+      if (m_fill == m_block.size()) {
+        compress();
+        m_fill = 0;
+      }
+    }
+    m_length += data.size();
+  }
+
+  FirmwareCache::Digest finish() noexcept {
+    const std::uint64_t bits = m_length * 8;
+    m_block[m_fill++] = 0x80;
+    if (m_fill > 56) {
+      std::fill(m_block.begin() + static_cast<std::ptrdiff_t>(m_fill),
+                m_block.end(), 0);
+      compress();
+      m_fill = 0;
+    }
+    std::fill(m_block.begin() + static_cast<std::ptrdiff_t>(m_fill),
+              m_block.begin() + 56, 0);
+    for (std::size_t i = 0; i < 8; ++i) {
+      m_block[56 + i] = static_cast<std::uint8_t>(bits >> (56 - 8 * i));
+    }
+    compress();
+    FirmwareCache::Digest res{};
+    for (std::size_t i = 0; i < res.size(); ++i) {
+      res[i] = static_cast<std::uint8_t>(m_state[i / 4] >> (24 - 8 * (i % 4)));
+    }
+    return res;
+  }
+
+private:
+  static constexpr std::uint32_t rotr(std::uint32_t x, int n) noexcept {
+    return (x >> n) | (x << (32 - n));
+  }
+
+  void compress() noexcept {
+    static constexpr std::array<std::uint32_t, 64> K{
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+        0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+        0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+        0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+        0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+        0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+        0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+        0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+        0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+    std::array<std::uint32_t, 64> w{};
+    for (std::size_t i = 0; i < 16; ++i) {
+      w[i] = std::uint32_t{m_block[4 * i]} << 24 |
+             std::uint32_t{m_block[4 * i + 1]} << 16 |
+             std::uint32_t{m_block[4 * i + 2]} << 8 |
+             std::uint32_t{m_block[4 * i + 3]};
+    }
+    for (std::size_t i = 16; i < w.size(); ++i) {
+      const auto s0 =
+          rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+      const auto s1 =
+          rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+      w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+    auto [a, b, c, d, e, f, g, h] = m_state;
+    for (std::size_t i = 0; i < w.size(); ++i) {
+      const auto s1 = rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25);
+      const auto ch = (e & f) ^ (~e & g);
+      const auto t1 = h + s1 + ch + K[i] + w[i];
+      const auto s0 = rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22);
+      const auto maj = (a & b) ^ (a & c) ^ (b & c);
+      const auto t2 = s0 + maj;
+      h = g;
+      g = f;
+      f = e;
+      e = d + t1;
+      d = c;
+      c = b;
+      b = a;
+      a = t1 + t2;
+    }
+    const std::array<std::uint32_t, 8> add{a, b, c, d, e, f, g, h};
+    for (std::size_t i = 0; i < m_state.size(); ++i) {
+      m_state[i] += add[i];
+    }
+  }
+
+  std::array<std::uint32_t, 8> m_state{0x6a09e667, 0xbb67ae85, 0x3c6ef372,
+                                       0xa54ff53a, 0x510e527f, 0x9b05688c,
+                                       0x1f83d9ab, 0x5be0cd19};
+  std::array<std::uint8_t, 64> m_block{};
+  std::size_t m_fill{};
+  std::uint64_t m_length{};
+};
+
+constexpr std::size_t padded(std::size_t size) noexcept {
+  return (size + 7) & ~std::size_t{7};
+}
+
+// Bounds checked reads of the mapped entry
+class EntryReader {
+public:
+  explicit EntryReader(std::string_view data) noexcept : m_data{data} {}
+
+  template <typename T> std::optional<T> read() noexcept {
+    static_assert(std::is_trivially_copyable_v<T>);
+    const auto bytes = take(sizeof(T));
+    if (!bytes) {
+      return std::nullopt;
+    }
+    T res;
+    std::memcpy(&res, bytes->data(), sizeof(T));
+    return res;
+  }
+
+  std::optional<std::string_view> take(std::size_t size) noexcept {
+    // the padding has to be there too
+    if (m_data.size() - m_pos < padded(size)) {
+      return std::nullopt;
+    }
+    const auto res = m_data.substr(m_pos, size);
+    m_pos += padded(size);
+    return res;
+  }
+
+  [[nodiscard]] bool done() const noexcept { return m_pos == m_data.size(); }
+
+private:
+  std::string_view m_data;
+  std::size_t m_pos{};
+};
+
+std::optional<Firmware> read_entry(std::string_view data,
+                                   std::span<const Address::region> regions,
+                                   FileHeader const &expected) {
+  EntryReader reader{data};
+  const auto header = reader.read<FileHeader>();
+  if (!header || header->magic != expected.magic ||
+      header->format_version != expected.format_version ||
+      header->byte_order != expected.byte_order ||
+      header->parser_version != expected.parser_version ||
+      header->little_endian != expected.little_endian ||
+      header->content_digest != expected.content_digest ||
+      header->content_size != expected.content_size ||
+      header->region_count > regions.size()) {
+    return std::nullopt;
+  }
+  // the element data is less than the entry, one slab
+  const auto arena = std::make_shared<std::pmr::monotonic_buffer_resource>(
+      std::max<std::size_t>(data.size(), 1));
+  Firmware fw;
+  fw.adopt(arena);
+  for (std::uint64_t r = 0; r < header->region_count; ++r) {
+    const auto rh = reader.read<RegionHeader>();
+    const auto region =
+        rh ? std::find_if(regions.begin(), regions.end(),
+                          [&](Address::region const &reg) {
+                            return static_cast<std::uint32_t>(reg.name) ==
+                                   rh->name;
+                          })
+           : regions.end();
+    if (region == regions.end()) {
+      return std::nullopt;
+    }
+    // the extended linear address of the region, as the parser sets it
+    auto &res = fw.emplace_back(*region, region->start & 0xFFFF'0000U);
+    res.elems.reserve(std::min<std::size_t>(rh->elem_count, region->size()));
+    for (std::uint32_t e = 0; e < rh->elem_count; ++e) {
+      const auto eh = reader.read<ElemHeader>();
+      const auto bytes = eh ? reader.take(eh->size) : std::nullopt;
+      if (!bytes || eh->base_addr < region->start ||
+          eh->base_addr > region->end ||
+          eh->size > region->end - eh->base_addr) {
+        return std::nullopt;
+      }
+      res.elems.push_back(FirmwareFileRegionElem{
+          eh->base_addr,
+          byte_vector(bytes->begin(), bytes->end(), arena.get())});
+    }
+  }
+  if (!reader.done()) {
+    return std::nullopt;
+  }
+  return fw;
+}
+
+// the headers are multiples of 8 bytes, no padding needed
+template <typename T> void write_header(std::ofstream &os, T const &value) {
+  os.write(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+void write_bytes(std::ofstream &os, byte_vector const &data) {
+  static constexpr std::array<char, 8> zeros{};
+  os.write(reinterpret_cast<const char *>(data.data()),
+           static_cast<std::streamsize>(data.size()));
+  os.write(zeros.data(),
+           static_cast<std::streamsize>(padded(data.size()) - data.size()));
+}
+
+FileHeader file_header(std::string_view content, bool little_endian) {
+  return FileHeader{.magic = MAGIC,
+                    .format_version = FORMAT_VERSION,
+                    .byte_order = BYTE_ORDER_MARK,
+                    .parser_version = IntelHex::parser_version,
+                    .little_endian = little_endian ? 1U : 0U,
+                    .content_digest = FirmwareCache::digest(content),
+                    .content_size = content.size(),
+                    .region_count = 0};
+}
+} // namespace
+
+FirmwareCache::FirmwareCache() : FirmwareCache(Options{}) {}
+
+fs::path FirmwareCache::default_dir() {
+  if (const auto *xdg = std::getenv("XDG_CACHE_HOME"); xdg && *xdg) {
+    return fs::path(xdg) / "picprogrammer";
+  }
+  if (const auto *home = std::getenv("HOME"); home && *home) {
+    return fs::path(home) / ".cache" / "picprogrammer";
+  }
+  return fs::temp_directory_path() / "picprogrammer";
+}
+
+FirmwareCache::Digest
+FirmwareCache::digest(std::string_view content) noexcept {
+  Sha256 sha;
+  sha.update(content);
+  return sha.finish();
+}
+
+fs::path FirmwareCache::entry_path(std::string_view content,
+                                   bool little_endian) const {
+  return m_opts.dir / fmt::format("{:02x}-{}-v{}{}{}",
+                                  fmt::join(digest(content), ""),
+                                  content.size(), IntelHex::parser_version,
+                                  little_endian ? "" : "-be", ENTRY_EXT);
+}
+
+std::optional<Firmware>
+FirmwareCache::load(std::span<const Address::region> regions,
+                    std::string_view content, bool little_endian) const {
+  const auto path = entry_path(content, little_endian);
+  std::error_code ec;
+  if (!fs::is_regular_file(path, ec)) {
+    return std::nullopt;
+  }
+  try {
+    const auto mapped = MappedFile::map(path);
+    auto fw = mapped ? read_entry(mapped->view(), regions,
+                                  file_header(content, little_endian))
+                     : std::nullopt;
+    if (!fw) {
+      // corrupt or truncated, it's replaced by the next store
+      fs::remove(path, ec);
+      return std::nullopt;
+    }
+    // the recently used entries are kept on eviction
+    fs::last_write_time(path, fs::file_time_type::clock::now(), ec);
+    return fw;
+  } catch (const std::system_error &) {
+    return std::nullopt;
+  }
+}
+
+bool FirmwareCache::store(std::string_view content, Firmware const &fw,
+                          bool little_endian) const {
+  std::error_code ec;
+  fs::create_directories(m_opts.dir, ec);
+  if (ec) {
+    return false;
+  }
+  const auto path = entry_path(content, little_endian);
+  // written aside and renamed, so the concurrent readers (e.g. other
+  // programmer processes) never see a partial entry
+  auto tmp = path;
+  tmp += fmt::format(".{}.tmp", ::getpid());
+  {
+    std::ofstream os(tmp, std::ios::binary | std::ios::trunc);
+    auto header = file_header(content, little_endian);
+    header.region_count = fw.size();
+    write_header(os, header);
+    for (const auto &region : fw) {
+      write_header(os, RegionHeader{
+                           .name = static_cast<std::uint32_t>(
+                               region.region.name),
+                           .elem_count = static_cast<std::uint32_t>(
+                               region.elems.size())});
+      for (const auto &elem : region.elems) {
+        write_header(os, ElemHeader{elem.base_addr, static_cast<std::uint32_t>(
+                                                        elem.data.size())});
+        write_bytes(os, elem.data);
+      }
+    }
+    if (!os.flush()) {
+      fs::remove(tmp, ec);
+      return false;
+    }
+  }
+  fs::rename(tmp, path, ec);
+  if (ec) {
+    fs::remove(tmp, ec);
+    return false;
+  }
+  return true;
+}
+
+void FirmwareCache::evict() const {
+  struct Entry {
+    fs::path path;
+    fs::file_time_type used;
+    std::uintmax_t size;
+  };
+  std::vector<Entry> entries;
+  std::uintmax_t total{};
+  std::error_code ec;
+  for (const auto &dirent : fs::directory_iterator(m_opts.dir, ec)) {
+    if (dirent.path().extension() != ENTRY_EXT) {
+      continue;
+    }
+    const auto size = dirent.file_size(ec);
+    const auto used = dirent.last_write_time(ec);
+    if (!ec) {
+      entries.push_back(Entry{dirent.path(), used, size});
+      total += size;
+    }
+  }
+  // the least recently used ones first
+  std::sort(entries.begin(), entries.end(),
+            [](const Entry &a, const Entry &b) { return a.used < b.used; });
+  auto count = entries.size();
+  for (const auto &entry : entries) {
+    if (count <= m_opts.max_entries && total <= m_opts.max_bytes) {
+      break;
+    }
+    if (fs::remove(entry.path, ec)) {
+      --count;
+      total -= entry.size;
+    }
+  }
+}
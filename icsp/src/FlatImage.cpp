@@ -0,0 +1,286 @@
+// SPDX-FileCopyrightText: 2024 Ferenc Nandor Janky <ferenj@effective-range.com>
+// SPDX-FileCopyrightText: 2024 Attila Gombos <attila.gombos@effective-range.com>
+// SPDX-License-Identifier: MIT
+
+#include <FlatImage.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+#include <fmt/format.h>
+
+namespace {
+std::size_t words_for(std::size_t bits) noexcept { return (bits + 63) / 64; }
+
+void set_bits(std::vector<std::uint64_t> &bits, std::size_t first,
+              std::size_t last) noexcept {
+  for (auto i = first; i <= last; ++i) {
+    bits[i / 64] |= std::uint64_t{1} << (i % 64);
+  }
+}
+
+// 8 bytes at a time (multiply-xorshift), pages are hashed far more often
+// than files, the hash only has to tell the page contents apart
+std::uint64_t hash_page(std::span<const std::uint8_t> page) noexcept {
+  constexpr std::uint64_t mul = 0x9E3779B97F4A7C15ULL;
+  std::uint64_t h = page.size() * mul;
+  std::size_t i = 0;
+  for (; i + 8 <= page.size(); i += 8) {
+    std::uint64_t word;
+    std::memcpy(&word, page.data() + i, 8);
+    h = (h ^ word) * mul;
+    h ^= h >> 29;
+  }
+  for (; i < page.size(); ++i) {
+    h = (h ^ page[i]) * mul;
+  }
+  return h ^ (h >> 32);
+}
+
+bool blank(std::span<const std::uint8_t> bytes) noexcept {
+  return std::all_of(bytes.begin(), bytes.end(), [](std::uint8_t b) {
+    return b == FlatImage::erased_value;
+  });
+}
+} // namespace
+
+FlatImage::RegionImage::RegionImage(Address::region region,
+                                    std::size_t page_size)
+    : m_region{region}, m_page_size{page_size},
+      m_data(region.size(), erased_value) {
+  if (page_size == 0 || page_size % region.word_size != 0) {
+    throw std::invalid_argument(
+        fmt::format("Page size {} isn't a multiple of the {} word size",
+                    page_size, region.name_str()));
+  }
+  const auto pages = (m_data.size() + page_size - 1) / page_size;
+  m_written.assign(words_for(m_data.size()), 0);
+  m_dirty.assign(words_for(pages), 0);
+  m_stale.assign(words_for(pages), 0);
+  m_hashes.resize(pages);
+  for (std::size_t p = 0; p < pages; ++p) {
+    m_hashes[p] = hash_page(page(p));
+  }
+}
+
+std::span<const std::uint8_t>
+FlatImage::RegionImage::page(std::size_t page) const noexcept {
+  const auto first = page * m_page_size;
+  return std::span(m_data).subspan(
+      first, std::min(m_page_size, m_data.size() - first));
+}
+
+bool FlatImage::RegionImage::any_dirty() const noexcept {
+  return std::any_of(m_dirty.begin(), m_dirty.end(),
+                     [](std::uint64_t w) { return w != 0; });
+}
+
+std::uint64_t FlatImage::RegionImage::page_hash(std::size_t page) const {
+  if (test(m_stale, page)) {
+    throw std::logic_error("FlatImage page written after seal()");
+  }
+  return m_hashes[page];
+}
+
+void FlatImage::RegionImage::write(std::uint32_t offset,
+                                   std::span<const std::uint8_t> data) {
+  if (data.empty()) {
+    return;
+  }
+  std::copy(data.begin(), data.end(), m_data.begin() + offset);
+  set_bits(m_written, offset, offset + data.size() - 1);
+  const auto first = offset / m_page_size;
+  const auto last = (offset + data.size() - 1) / m_page_size;
+  set_bits(m_dirty, first, last);
+  set_bits(m_stale, first, last);
+}
+
+void FlatImage::RegionImage::seal() noexcept {
+  for (std::size_t w = 0; w < m_stale.size(); ++w) {
+    for (auto bits = std::exchange(m_stale[w], 0); bits != 0;
+         bits &= bits - 1) {
+      const auto p = w * 64 + static_cast<std::size_t>(__builtin_ctzll(bits));
+      m_hashes[p] = hash_page(page(p));
+    }
+  }
+}
+
+auto FlatImage::RegionImage::runs() const -> std::vector<Run> {
+  std::vector<Run> res;
+  const auto word = m_region.word_size;
+  std::optional<std::size_t> run_start;
+  auto close_run = [&](std::size_t end) {
+    if (run_start) {
+      res.push_back(Run{
+          m_region.start + static_cast<std::uint32_t>(*run_start),
+          std::span(m_data).subspan(*run_start, end - *run_start)});
+      run_start.reset();
+    }
+  };
+  for (std::size_t p = 0; p < page_count(); ++p) {
+    const auto first = p * m_page_size;
+    if (!dirty(p)) {
+      close_run(first);
+      continue;
+    }
+    const auto bytes = page(p);
+    for (std::size_t i = 0; i < bytes.size(); i += word) {
+      // the regions are whole words, so are the pages
+      if (blank(bytes.subspan(i, word))) {
+        close_run(first + i);
+      } else if (!run_start) {
+        run_start = first + i;
+      }
+    }
+  }
+  close_run(m_data.size());
+  return res;
+}
+
+auto FlatImage::RegionImage::segments() const
+    -> std::vector<FirmwareFileRegionElem> {
+  std::vector<FirmwareFileRegionElem> res;
+  for (const auto &run : runs()) {
+    res.push_back(FirmwareFileRegionElem{
+        run.addr, byte_vector(run.data.begin(), run.data.end())});
+  }
+  return res;
+}
+
+FlatImage::FlatImage(std::vector<Address::region> const &regions,
+                     std::size_t page_size) {
+  m_regions.reserve(regions.size());
+  for (const auto &region : regions) {
+    m_regions.emplace_back(region, page_size);
+  }
+}
+
+FlatImage::RegionImage *FlatImage::find_region(std::uint32_t addr) noexcept {
+  const auto it = std::find_if(
+      m_regions.begin(), m_regions.end(), [addr](const RegionImage &r) {
+        return addr >= r.region().start && addr < r.region().end;
+      });
+  return it != m_regions.end() ? &*it : nullptr;
+}
+
+auto FlatImage::find(std::uint32_t addr) const noexcept
+    -> RegionImage const * {
+  return const_cast<FlatImage *>(this)->find_region(addr);
+}
+
+auto FlatImage::find(Address::Region name) const noexcept
+    -> RegionImage const * {
+  const auto it = std::find_if(
+      m_regions.begin(), m_regions.end(),
+      [name](const RegionImage &r) { return r.region().name == name; });
+  return it != m_regions.end() ? &*it : nullptr;
+}
+
+void FlatImage::write(std::uint32_t addr, std::span<const std::uint8_t> data) {
+  auto *region = find_region(addr);
+  if (!region || addr + data.size() > region->region().end) {
+    throw std::out_of_range(fmt::format(
+        "Data out of the regions at 0x{:08x} ({} bytes)", addr, data.size()));
+  }
+  region->write(addr - region->region().start, data);
+}
+
+void FlatImage::write(Firmware const &fw) {
+  for (const auto &region : fw) {
+    for (const auto &elem : region.elems) {
+      write(elem.base_addr, elem.data);
+    }
+  }
+}
+
+std::optional<std::uint32_t>
+FlatImage::conflict(std::uint32_t addr,
+                    std::span<const std::uint8_t> data) const {
+  const auto *region = find(addr);
+  if (!region || addr + data.size() > region->region().end) {
+    return std::nullopt;
+  }
+  const auto offset = addr - region->region().start;
+  for (std::size_t i = 0; i < data.size(); ++i) {
+    if (region->written(offset + i) &&
+        region->data()[offset + i] != data[i]) {
+      return addr + static_cast<std::uint32_t>(i);
+    }
+  }
+  return std::nullopt;
+}
+
+void FlatImage::seal() noexcept {
+  for (auto &region : m_regions) {
+    region.seal();
+  }
+}
+
+auto FlatImage::diff(FlatImage const &other) const -> std::vector<PageRef> {
+  const auto same_layout = std::equal(
+      m_regions.begin(), m_regions.end(), other.m_regions.begin(),
+      other.m_regions.end(), [](const RegionImage &a, const RegionImage &b) {
+        return a.region().name == b.region().name &&
+               a.region().start == b.region().start &&
+               a.region().end == b.region().end &&
+               a.page_size() == b.page_size();
+      });
+  if (!same_layout) {
+    throw std::invalid_argument("Diffing FlatImages of different layouts");
+  }
+  std::vector<PageRef> res;
+  for (std::size_t r = 0; r < m_regions.size(); ++r) {
+    const auto &a = m_regions[r];
+    const auto &b = other.m_regions[r];
+    for (std::size_t p = 0; p < a.page_count(); ++p) {
+      // equal hashes are confirmed by comparing the bytes
+      if (a.page_hash(p) != b.page_hash(p) ||
+          !std::ranges::equal(a.page(p), b.page(p))) {
+        res.push_back(PageRef{a.region().name, p});
+      }
+    }
+  }
+  return res;
+}
+
+std::optional<std::uint32_t>
+FlatImage::verify(std::uint32_t addr,
+                  std::span<const std::uint8_t> data) const {
+  const auto *region = find(addr);
+  if (!region || addr + data.size() > region->region().end) {
+    throw std::out_of_range(fmt::format(
+        "Data out of the regions at 0x{:08x} ({} bytes)", addr, data.size()));
+  }
+  const auto expected =
+      region->data().subspan(addr - region->region().start, data.size());
+  const auto [it, _] = std::ranges::mismatch(expected, data);
+  if (it == expected.end()) {
+    return std::nullopt;
+  }
+  return addr + static_cast<std::uint32_t>(it - expected.begin());
+}
+
+std::size_t FlatImage::program_size() const {
+  std::size_t res = 0;
+  for (const auto &region : m_regions) {
+    for (const auto &run : region.runs()) {
+      res += run.data.size();
+    }
+  }
+  return res;
+}
+
+Firmware FlatImage::to_firmware() const {
+  Firmware fw;
+  for (const auto &region : m_regions) {
+    if (region.any_dirty()) {
+      // the same linear base as the parsed Firmware
+      fw.push_back(FirmwareFileRegion{region.region(),
+                                      region.region().start & 0xFFFF'0000U,
+                                      region.segments()});
+    }
+  }
+  return fw;
+}
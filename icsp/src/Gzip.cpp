@@ -0,0 +1,151 @@
+// SPDX-FileCopyrightText: 2024 Ferenc Nandor Janky <ferenj@effective-range.com>
+// SPDX-FileCopyrightText: 2024 Attila Gombos <attila.gombos@effective-range.com>
+// SPDX-License-Identifier: MIT
+
+#include <Gzip.hpp>
+
+#include <stdexcept>
+
+#include <zlib.h>
+
+#include <fmt/format.h>
+
+namespace {
+// the window bits of zlib: +16 writes gzip, +32 detects gzip or zlib
+constexpr int WINDOW_BITS = 15;
+
+[[noreturn]] void throw_zlib_error(z_stream const &zs, int ret,
+                                   const char *what) {
+  throw std::runtime_error(
+      fmt::format("{}: {}", what, zs.msg ? zs.msg : zError(ret)));
+}
+} // namespace
+
+struct Gzip::InflateBuf::State {
+  z_stream zs{};
+};
+
+struct Gzip::DeflateBuf::State {
+  z_stream zs{};
+};
+
+bool Gzip::is_gzip(std::istream &is) {
+  return is.peek() == 0x1f;
+}
+
+Gzip::InflateBuf::InflateBuf(std::istream &source, std::size_t chunk_size)
+    : m_source{source}, m_state{std::make_unique<State>()},
+      m_in(chunk_size), m_out(chunk_size) {
+  if (const auto ret = inflateInit2(&m_state->zs, WINDOW_BITS + 32);
+      ret != Z_OK) {
+    throw_zlib_error(m_state->zs, ret, "Can't initialize the inflater");
+  }
+  setg(m_out.data(), m_out.data(), m_out.data());
+}
+
+Gzip::InflateBuf::~InflateBuf() { inflateEnd(&m_state->zs); }
+
+auto Gzip::InflateBuf::underflow() -> int_type {
+  auto &zs = m_state->zs;
+  while (!m_done) {
+    if (zs.avail_in == 0 && m_source) {
+      m_source.read(m_in.data(), static_cast<std::streamsize>(m_in.size()));
+      zs.next_in = reinterpret_cast<Bytef *>(m_in.data());
+      zs.avail_in = static_cast<uInt>(m_source.gcount());
+      if (m_source.bad()) {
+        throw std::runtime_error("input stream failure");
+      }
+    }
+    zs.next_out = reinterpret_cast<Bytef *>(m_out.data());
+    zs.avail_out = static_cast<uInt>(m_out.size());
+    const auto ret = inflate(&zs, Z_NO_FLUSH);
+    const auto produced = m_out.size() - zs.avail_out;
+    if (ret == Z_STREAM_END) {
+      // the next member, if any
+      if (zs.avail_in == 0 && (!m_source || m_source.peek() == EOF)) {
+        m_done = true;
+      } else {
+        inflateReset(&zs);
+      }
+    } else if (ret == Z_BUF_ERROR && zs.avail_in == 0 && !m_source) {
+      throw std::runtime_error("Truncated gzip stream");
+    } else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+      throw_zlib_error(zs, ret, "Invalid gzip data");
+    }
+    if (produced > 0) {
+      setg(m_out.data(), m_out.data(), m_out.data() + produced);
+      return traits_type::to_int_type(*gptr());
+    }
+  }
+  return traits_type::eof();
+}
+
+Gzip::DeflateBuf::DeflateBuf(std::ostream &sink, int level,
+                             std::size_t chunk_size)
+    : m_sink{sink}, m_state{std::make_unique<State>()}, m_in(chunk_size),
+      m_out(chunk_size) {
+  if (const auto ret = deflateInit2(&m_state->zs, level, Z_DEFLATED,
+                                    WINDOW_BITS + 16, 8, Z_DEFAULT_STRATEGY);
+      ret != Z_OK) {
+    throw_zlib_error(m_state->zs, ret, "Can't initialize the deflater");
+  }
+  setp(m_in.data(), m_in.data() + m_in.size());
+}
+
+Gzip::DeflateBuf::~DeflateBuf() {
+  try {
+    finish();
+  } catch (...) {
+  }
+  deflateEnd(&m_state->zs);
+}
+
+void Gzip::DeflateBuf::deflate_pending(int flush) {
+  auto &zs = m_state->zs;
+  zs.next_in = reinterpret_cast<Bytef *>(pbase());
+  zs.avail_in = static_cast<uInt>(pptr() - pbase());
+  int ret{};
+  do {
+    zs.next_out = reinterpret_cast<Bytef *>(m_out.data());
+    zs.avail_out = static_cast<uInt>(m_out.size());
+    ret = deflate(&zs, flush);
+    if (ret == Z_STREAM_ERROR) {
+      throw_zlib_error(zs, ret, "Can't compress the output");
+    }
+    m_sink.write(m_out.data(), static_cast<std::streamsize>(
+                                   m_out.size() - zs.avail_out));
+    if (!m_sink) {
+      throw std::runtime_error("Can't write the compressed output");
+    }
+  } while (zs.avail_out == 0 || (flush == Z_FINISH && ret != Z_STREAM_END));
+  setp(m_in.data(), m_in.data() + m_in.size());
+}
+
+auto Gzip::DeflateBuf::overflow(int_type ch) -> int_type {
+  if (m_finished) {
+    return traits_type::eof();
+  }
+  deflate_pending(Z_NO_FLUSH);
+  if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+    *pptr() = traits_type::to_char_type(ch);
+    pbump(1);
+  }
+  return traits_type::not_eof(ch);
+}
+
+int Gzip::DeflateBuf::sync() {
+  if (!m_finished) {
+    deflate_pending(Z_SYNC_FLUSH);
+    m_sink.flush();
+  }
+  return 0;
+}
+
+void Gzip::DeflateBuf::finish() {
+  if (m_finished) {
+    return;
+  }
+  m_finished = true;
+  deflate_pending(Z_FINISH);
+  m_sink.flush();
+}
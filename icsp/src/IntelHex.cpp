@@ -10,8 +10,212 @@
 #include <range/v3/algorithm/copy.hpp>
 #include <range/v3/view/chunk.hpp>
 
+#include <array>
+#include <cstddef>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
 using namespace IntelHex;
 
+namespace {
+// value of the hex digits, 0xFF for the other characters
+constexpr auto nibble_table = [] {
+  std::array<uint8_t, 256> table{};
+  table.fill(0xFF);
+  for (int c = '0'; c <= '9'; ++c) {
+    table[c] = static_cast<uint8_t>(c - '0');
+  }
+  for (int c = 'a'; c <= 'f'; ++c) {
+    table[c] = table[c - 'a' + 'A'] = static_cast<uint8_t>(c - 'a' + 10);
+  }
+  return table;
+}();
+
+bool decode_scalar(const char *hex, std::size_t count, uint8_t *out,
+                   uint8_t &sum) noexcept {
+  for (std::size_t i = 0; i < count; ++i, hex += 2) {
+    const auto hi = nibble_table[static_cast<uint8_t>(hex[0])];
+    const auto lo = nibble_table[static_cast<uint8_t>(hex[1])];
+    if ((hi | lo) & 0xF0) {
+      return false;
+    }
+    out[i] = static_cast<uint8_t>((hi << 4) | lo);
+    sum += out[i];
+  }
+  return true;
+}
+
+#if defined(__SSE2__)
+// The nibble values of 16 digits, clears the lanes of `valid` where the
+// character isn't a hex digit (there are only signed byte compares, the
+// non-ASCII characters are negative so they fail both ranges)
+__m128i nibbles(__m128i c, __m128i &valid) {
+  const auto lower = _mm_or_si128(c, _mm_set1_epi8(0x20));
+  const auto digit = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('0' - 1)),
+                                   _mm_cmplt_epi8(c, _mm_set1_epi8('9' + 1)));
+  const auto alpha =
+      _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+                    _mm_cmplt_epi8(lower, _mm_set1_epi8('f' + 1)));
+  valid = _mm_and_si128(valid, _mm_or_si128(digit, alpha));
+  return _mm_or_si128(
+      _mm_and_si128(digit, _mm_sub_epi8(c, _mm_set1_epi8('0'))),
+      _mm_and_si128(alpha, _mm_sub_epi8(lower, _mm_set1_epi8('a' - 10))));
+}
+
+// 32 digits to 16 bytes
+__m128i decode32(const char *hex, __m128i &valid) {
+  const auto n0 =
+      nibbles(_mm_loadu_si128(reinterpret_cast<const __m128i *>(hex)), valid);
+  const auto n1 = nibbles(
+      _mm_loadu_si128(reinterpret_cast<const __m128i *>(hex + 16)), valid);
+  // the first digit of a pair (high nibble) is the low byte of the 16 bit
+  // lanes, the bytes fit in the lanes so packing doesn't saturate
+  const auto low = _mm_set1_epi16(0x00FF);
+  const auto w0 = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(n0, low), 4),
+                               _mm_srli_epi16(n0, 8));
+  const auto w1 = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(n1, low), 4),
+                               _mm_srli_epi16(n1, 8));
+  return _mm_packus_epi16(w0, w1);
+}
+
+std::size_t decode_simd(const char *hex, std::size_t count, uint8_t *out,
+                        uint8_t &sum) noexcept {
+  auto valid = _mm_set1_epi8(-1);
+  // the byte lanes wrap around, that's the sum mod 256 as needed
+  auto acc = _mm_setzero_si128();
+  std::size_t i = 0;
+  for (; i + 16 <= count; i += 16) {
+    const auto bytes = decode32(hex + 2 * i, valid);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), bytes);
+    acc = _mm_add_epi8(acc, bytes);
+  }
+  if (_mm_movemask_epi8(valid) != 0xFFFF) {
+    return 0;
+  }
+  const auto sums = _mm_sad_epu8(acc, _mm_setzero_si128());
+  sum += static_cast<uint8_t>(_mm_cvtsi128_si32(sums) +
+                              _mm_extract_epi16(sums, 4));
+  return i;
+}
+#elif defined(__ARM_NEON)
+// The nibble values of 16 digits, clears the lanes of `valid` where the
+// character isn't a hex digit
+uint8x16_t nibbles(uint8x16_t c, uint8x16_t &valid) {
+  const auto digit = vsubq_u8(c, vdupq_n_u8('0'));
+  const auto is_digit = vcltq_u8(digit, vdupq_n_u8(10));
+  const auto alpha = vsubq_u8(vorrq_u8(c, vdupq_n_u8(0x20)), vdupq_n_u8('a'));
+  const auto is_alpha = vcltq_u8(alpha, vdupq_n_u8(6));
+  valid = vandq_u8(valid, vorrq_u8(is_digit, is_alpha));
+  return vbslq_u8(is_digit, digit, vaddq_u8(alpha, vdupq_n_u8(10)));
+}
+
+// 32 digits to 16 bytes, the load splits the high and low digits
+uint8x16_t decode32(const char *hex, uint8x16_t &valid) {
+  const auto digits = vld2q_u8(reinterpret_cast<const uint8_t *>(hex));
+  return vorrq_u8(vshlq_n_u8(nibbles(digits.val[0], valid), 4),
+                  nibbles(digits.val[1], valid));
+}
+
+// pairwise reductions, available on ARMv7 NEON too
+uint8_t min_lane(uint8x16_t v) {
+  auto m = vpmin_u8(vget_low_u8(v), vget_high_u8(v));
+  m = vpmin_u8(m, m);
+  m = vpmin_u8(m, m);
+  m = vpmin_u8(m, m);
+  return vget_lane_u8(m, 0);
+}
+
+uint8_t sum_lanes(uint8x16_t v) {
+  auto s = vadd_u8(vget_low_u8(v), vget_high_u8(v));
+  s = vpadd_u8(s, s);
+  s = vpadd_u8(s, s);
+  s = vpadd_u8(s, s);
+  return vget_lane_u8(s, 0);
+}
+
+std::size_t decode_simd(const char *hex, std::size_t count, uint8_t *out,
+                        uint8_t &sum) noexcept {
+  auto valid = vdupq_n_u8(0xFF);
+  // the byte lanes wrap around, that's the sum mod 256 as needed
+  auto acc = vdupq_n_u8(0);
+  std::size_t i = 0;
+  for (; i + 16 <= count; i += 16) {
+    const auto bytes = decode32(hex + 2 * i, valid);
+    vst1q_u8(out + i, bytes);
+    acc = vaddq_u8(acc, bytes);
+  }
+  if (min_lane(valid) != 0xFF) {
+    return 0;
+  }
+  sum += sum_lanes(acc);
+  return i;
+}
+#else
+std::size_t decode_simd(const char *, std::size_t, uint8_t *,
+                        uint8_t &) noexcept {
+  return 0;
+}
+#endif
+} // namespace
+
+std::vector<IntelHex::HexChunk>
+IntelHex::split_hex_chunks(std::string_view text, std::size_t min_chunk_size) {
+  // the record type is the 4th byte, the rest of the line isn't checked here
+  // (the record is validated when its chunk is parsed)
+  constexpr auto extended_address =
+      [](std::string_view line) -> std::optional<uint32_t> {
+    std::array<uint8_t, 2> prefix{};
+    if (line.size() < 13 || line[0] != ':' || line.substr(7, 2) != "04" ||
+        !decode_hex(line.substr(9, 4), prefix.data())) {
+      return std::nullopt;
+    }
+    return (uint32_t{prefix[0]} << 24) | (uint32_t{prefix[1]} << 16);
+  };
+  std::vector<HexChunk> chunks;
+  std::size_t start = 0;
+  uint32_t start_base_addr{};
+  uint32_t base_addr{};
+  for (std::size_t pos = 0; pos < text.size();) {
+    if (pos > start && pos - start >= min_chunk_size) {
+      chunks.push_back({text.substr(start, pos - start), start_base_addr});
+      start = pos;
+      start_base_addr = base_addr;
+    }
+    const auto end = text.find('\n', pos);
+    if (const auto addr = extended_address(text.substr(pos, end - pos))) {
+      base_addr = *addr;
+    }
+    if (end == text.npos) {
+      break;
+    }
+    pos = end + 1;
+  }
+  if (start < text.size()) {
+    chunks.push_back({text.substr(start), start_base_addr});
+  }
+  return chunks;
+}
+
+std::optional<uint8_t> IntelHex::decode_hex(std::string_view hex,
+                                            uint8_t *out) noexcept {
+  if (hex.size() % 2 != 0) {
+    return std::nullopt;
+  }
+  const auto count = hex.size() / 2;
+  uint8_t sum{};
+  // the vectorized part reports the invalid digits by decoding nothing, the
+  // scalar pass finds them then
+  const auto done = decode_simd(hex.data(), count, out, sum);
+  if (!decode_scalar(hex.data() + 2 * done, count - done, out + done, sum)) {
+    return std::nullopt;
+  }
+  return sum;
+}
+
 void Dumper::dump_region(Address::Region reg, std::span<uint8_t> data) {
   using std::literals::operator""sv;
   const auto base_addr = Address::with_region(
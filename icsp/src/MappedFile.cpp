@@ -0,0 +1,76 @@
+// SPDX-FileCopyrightText: 2024 Ferenc Nandor Janky <ferenj@effective-range.com>
+// SPDX-FileCopyrightText: 2024 Attila Gombos <attila.gombos@effective-range.com>
+// SPDX-License-Identifier: MIT
+
+#include <MappedFile.hpp>
+
+#include <cerrno>
+#include <system_error>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <fmt/format.h>
+
+namespace {
+// Closes the descriptor when leaving the scope, the mapping stays valid
+struct FileDescriptor {
+  explicit FileDescriptor(int fd) noexcept : fd{fd} {}
+  FileDescriptor(const FileDescriptor &) = delete;
+  FileDescriptor &operator=(const FileDescriptor &) = delete;
+  ~FileDescriptor() {
+    if (fd >= 0) {
+      ::close(fd);
+    }
+  }
+  int fd;
+};
+} // namespace
+
+std::optional<MappedFile> MappedFile::map(std::filesystem::path const &path) {
+  // non-blocking, so opening a pipe doesn't wait for a writer
+  const FileDescriptor file{
+      ::open(path.c_str(), O_RDONLY | O_CLOEXEC | O_NONBLOCK)};
+  if (file.fd < 0) {
+    throw std::system_error(errno, std::generic_category(),
+                            fmt::format("Can't open {}", path.string()));
+  }
+  struct stat st {};
+  if (::fstat(file.fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0) {
+    return std::nullopt;
+  }
+  const auto size = static_cast<std::size_t>(st.st_size);
+  auto *data = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file.fd, 0);
+  if (data == MAP_FAILED) {
+    return std::nullopt;
+  }
+  // only a hint, the parsing works without it as well. The whole file is
+  // read ahead, the parallel parser reads it from several places at once.
+  ::madvise(data, size, MADV_WILLNEED);
+  return MappedFile{data, size};
+}
+
+MappedFile::MappedFile(MappedFile &&other) noexcept
+    : m_data{std::exchange(other.m_data, nullptr)},
+      m_size{std::exchange(other.m_size, 0)} {}
+
+MappedFile &MappedFile::operator=(MappedFile &&other) noexcept {
+  if (this != &other) {
+    unmap();
+    m_data = std::exchange(other.m_data, nullptr);
+    m_size = std::exchange(other.m_size, 0);
+  }
+  return *this;
+}
+
+MappedFile::~MappedFile() { unmap(); }
+
+void MappedFile::unmap() noexcept {
+  if (m_data) {
+    ::munmap(m_data, m_size);
+    m_data = nullptr;
+  }
+}
@@ -0,0 +1,81 @@
+// SPDX-FileCopyrightText: 2024 Ferenc Nandor Janky <ferenj@effective-range.com>
+// SPDX-FileCopyrightText: 2024 Attila Gombos <attila.gombos@effective-range.com>
+// SPDX-License-Identifier: MIT
+
+#include <Progress.hpp>
+#include <Realtime.hpp>
+
+#include <chrono>
+
+namespace {
+std::chrono::nanoseconds now() {
+  return std::chrono::steady_clock::now().time_since_epoch();
+}
+} // namespace
+
+ProgressSnapshot ProgressMeter::update(std::size_t done,
+                                       std::chrono::nanoseconds now) {
+  using namespace std::chrono;
+  if (const auto dt = duration<double>(now - m_last_time).count();
+      dt > 0 && done >= m_last_done) {
+    const auto rate = static_cast<double>(done - m_last_done) / dt;
+    m_rate = m_rate ? SMOOTHING * rate + (1 - SMOOTHING) * *m_rate : rate;
+    m_last_done = done;
+    m_last_time = now;
+  }
+
+  ProgressSnapshot snapshot{.done = done,
+                            .total = m_total,
+                            .elapsed = now - m_start,
+                            .rate = m_rate.value_or(0),
+                            .eta = std::nullopt};
+  if (done >= m_total) {
+    snapshot.eta = nanoseconds::zero();
+  } else if (m_rate && *m_rate > 0) {
+    snapshot.eta = duration_cast<nanoseconds>(
+        duration<double>((m_total - done) / *m_rate));
+  }
+  return snapshot;
+}
+
+ProgressReporter::ProgressReporter(std::size_t total, Callback callback,
+                                   Options options)
+    : m_options{options}, m_callback{std::move(callback)},
+      m_meter{total, now()}, m_thread{[this] { run(); }} {}
+
+ProgressReporter::~ProgressReporter() { finish(); }
+
+void ProgressReporter::finish() {
+  {
+    std::lock_guard lock{m_mutex};
+    if (m_finished) {
+      return;
+    }
+    m_finished = true;
+  }
+  m_cv.notify_one();
+  m_thread.join();
+  report(done());
+}
+
+void ProgressReporter::run() {
+  // started from the programming thread, which may be real-time already
+  RealtimeSession::reset_thread();
+  std::size_t reported{};
+  std::unique_lock lock{m_mutex};
+  while (!m_finished) {
+    m_cv.wait_for(lock, m_options.interval);
+    if (const auto current = done(); current != reported && !m_finished) {
+      reported = current;
+      lock.unlock();
+      report(current);
+      lock.lock();
+    }
+  }
+}
+
+void ProgressReporter::report(std::size_t done) {
+  if (m_callback) {
+    m_callback(m_meter.update(done, now()));
+  }
+}
@@ -0,0 +1,137 @@
+// SPDX-FileCopyrightText: 2024 Ferenc Nandor Janky <ferenj@effective-range.com>
+// SPDX-FileCopyrightText: 2024 Attila Gombos <attila.gombos@effective-range.com>
+// SPDX-License-Identifier: MIT
+
+#include <RawImage.hpp>
+
+#include <PIC18-Q20.hpp>
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+constexpr auto crc_table = [] {
+  std::array<std::uint32_t, 256> table{};
+  for (std::uint32_t i = 0; i < table.size(); ++i) {
+    auto crc = i;
+    for (int bit = 0; bit < 8; ++bit) {
+      crc = (crc >> 1) ^ ((crc & 1U) ? 0xEDB88320U : 0U);
+    }
+    table[i] = crc;
+  }
+  return table;
+}();
+
+std::uint32_t get_le32(const char *p) noexcept {
+  const auto *b = reinterpret_cast<const unsigned char *>(p);
+  return std::uint32_t{b[0]} | (std::uint32_t{b[1]} << 8) |
+         (std::uint32_t{b[2]} << 16) | (std::uint32_t{b[3]} << 24);
+}
+
+void put_le(std::ostream &os, std::uint32_t val, std::size_t bytes) {
+  for (std::size_t i = 0; i < bytes; ++i) {
+    os.put(static_cast<char>((val >> (8 * i)) & 0xFF));
+  }
+}
+
+void put_region_header(std::ostream &os, std::string_view name,
+                       std::uint32_t base_addr, std::uint32_t length,
+                       std::uint32_t crc) {
+  std::array<char, 8> padded{};
+  std::copy_n(name.begin(), std::min(name.size(), padded.size()),
+              padded.begin());
+  os.write(padded.data(), padded.size());
+  put_le(os, base_addr, 4);
+  put_le(os, length, 4);
+  put_le(os, crc, 4);
+  put_le(os, 0, 4);
+}
+} // namespace
+
+std::uint32_t RawImage::crc32(std::span<const uint8_t> data,
+                              std::uint32_t crc) noexcept {
+  crc = ~crc;
+  for (const auto byte : data) {
+    crc = crc_table[(crc ^ byte) & 0xFF] ^ (crc >> 8);
+  }
+  return ~crc;
+}
+
+std::vector<RawImage::Record>
+RawImage::parse_records(std::string_view image) {
+  if (image.size() < file_header_size ||
+      !std::equal(magic.begin(), magic.end(), image.begin())) {
+    throw std::runtime_error("Not a raw firmware image");
+  }
+  const auto *v =
+      reinterpret_cast<const unsigned char *>(image.data() + magic.size());
+  if (const auto version = static_cast<std::uint16_t>(v[0] | (v[1] << 8));
+      version != format_version) {
+    throw std::runtime_error(
+        fmt::format("Unsupported raw image version {}", version));
+  }
+  std::vector<Record> res;
+  for (auto rest = image.substr(file_header_size);;) {
+    if (rest.size() < region_header_size) {
+      throw std::runtime_error("Truncated raw image");
+    }
+    const auto name = rest.substr(0, 8);
+    const auto base_addr = get_le32(rest.data() + 8);
+    const auto length = get_le32(rest.data() + 12);
+    const auto crc = get_le32(rest.data() + 16);
+    rest.remove_prefix(region_header_size);
+    if (name.find_first_not_of('\0') == name.npos) {
+      return res;
+    }
+    if (rest.size() < length) {
+      throw std::runtime_error("Truncated raw image");
+    }
+    const auto region_name = name.substr(0, name.find('\0'));
+    Address::Region region{};
+    try {
+      region = Address::string_to_region(region_name);
+    } catch (std::invalid_argument const &) {
+      throw std::runtime_error(
+          fmt::format("Unknown region '{}' in raw image", region_name));
+    }
+    const std::span data(reinterpret_cast<const uint8_t *>(rest.data()),
+                         length);
+    if (crc32(data) != crc) {
+      throw std::runtime_error(
+          fmt::format("CRC mismatch of the {} region in raw image",
+                      region_name));
+    }
+    res.push_back(Record{region, base_addr, data});
+    rest.remove_prefix(length);
+  }
+}
+
+void RawImage::Dumper::dump_start() {
+  os.write(magic.data(), magic.size());
+  put_le(os, format_version, 2);
+}
+
+void RawImage::Dumper::dump_end() { put_region_header(os, {}, 0, 0, 0); }
+
+void RawImage::Dumper::dump_region(Address::Region reg,
+                                   std::span<uint8_t> data) {
+  const auto base_addr = Address::with_region(
+      reg, [](auto idx, auto reg) { return reg.value.start; }, pic18fq20);
+  dump_data(reg, base_addr, data);
+}
+
+void RawImage::Dumper::dump_data(Address::Region reg, uint32_t base_addr,
+                                 std::span<const uint8_t> data) {
+  put_region_header(os, Address::region_to_string(reg), base_addr,
+                    static_cast<std::uint32_t>(data.size()), crc32(data));
+  os.write(reinterpret_cast<const char *>(data.data()),
+           static_cast<std::streamsize>(data.size()));
+}
+
+void RawImage::Dumper::dump_firmware(Firmware const &fw) {
+  for (const auto &region : fw) {
+    for (const auto &elem : region.elems) {
+      dump_data(region.region.name, elem.base_addr, elem.data);
+    }
+  }
+}
@@ -0,0 +1,225 @@
+// SPDX-FileCopyrightText: 2024 Ferenc Nandor Janky <ferenj@effective-range.com>
+// SPDX-FileCopyrightText: 2024 Attila Gombos
+// <attila.gombos@effective-range.com> SPDX-License-Identifier: MIT
+
+#include <Realtime.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <string_view>
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <fmt/format.h>
+
+namespace {
+constexpr auto ISOLATED_CPUS = "/sys/devices/system/cpu/isolated";
+constexpr auto PM_QOS_CPU_LATENCY = "/dev/cpu_dma_latency";
+
+std::string error_string(int err) { return std::strerror(err); }
+
+// The session whose original thread settings reset_thread() restores
+std::mutex active_mutex;
+const RealtimeSession *active_session{};
+
+// Parses the kernel's cpu list format, e.g. "1-3,6"
+std::vector<unsigned> read_cpu_list(const char *path) {
+  std::vector<unsigned> res;
+  std::ifstream ifs(path);
+  std::string item;
+  while (std::getline(ifs, item, ',')) {
+    unsigned first{}, last{};
+    char dash{};
+    std::istringstream iss(item);
+    if (!(iss >> first)) {
+      continue;
+    }
+    last = first;
+    if (iss >> dash && dash == '-') {
+      iss >> last;
+    }
+    for (auto cpu = first; cpu <= last; ++cpu) {
+      res.push_back(cpu);
+    }
+  }
+  return res;
+}
+
+[[gnu::noinline]] void prefault_stack(std::size_t size) {
+  constexpr std::size_t CHUNK = 16 * 1024;
+  std::uint8_t buff[CHUNK];
+  for (std::size_t i = 0; i < CHUNK; i += 64) {
+    buff[i] = 0;
+  }
+  if (size > CHUNK) {
+    prefault_stack(size - CHUNK);
+  }
+  // the writes are observable, and the frame stays alive across the
+  // recursion (no tail call reusing it)
+  asm volatile("" : : "r"(buff) : "memory");
+}
+} // namespace
+
+RealtimeSession::RealtimeSession(Options opts) {
+  // Pin first, so that the memory is faulted in on the node of the used CPU
+  pin_cpu(opts.cpu);
+  lock_memory(opts.prefault_stack);
+  request_cpu_latency(opts.max_cpu_latency);
+  set_scheduler(opts.priority);
+  std::lock_guard lock{active_mutex};
+  active_session = this;
+}
+
+RealtimeSession::~RealtimeSession() {
+  {
+    std::lock_guard lock{active_mutex};
+    if (active_session == this) {
+      active_session = nullptr;
+    }
+  }
+  if (m_old_sched) {
+    pthread_setschedparam(pthread_self(), m_old_sched->first,
+                          &m_old_sched->second);
+  }
+  if (m_pm_qos_fd >= 0) {
+    // the request is dropped when the file is closed
+    ::close(m_pm_qos_fd);
+  }
+  if (m_memory_locked) {
+    ::munlockall();
+  }
+  if (m_old_affinity) {
+    pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &*m_old_affinity);
+  }
+}
+
+void RealtimeSession::prefault(const void *data, std::size_t size) noexcept {
+  const auto page = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+  const auto *bytes = static_cast<const volatile std::uint8_t *>(data);
+  for (std::size_t i = 0; i < size; i += page) {
+    static_cast<void>(bytes[i]);
+  }
+  if (size != 0) {
+    static_cast<void>(bytes[size - 1]);
+  }
+}
+
+void RealtimeSession::reset_thread() noexcept {
+  std::lock_guard lock{active_mutex};
+  if (!active_session) {
+    return;
+  }
+  // only what the session changed is restored
+  if (const auto &sched = active_session->m_old_sched) {
+    pthread_setschedparam(pthread_self(), sched->first, &sched->second);
+  }
+  if (const auto &affinity = active_session->m_old_affinity) {
+    pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &*affinity);
+  }
+}
+
+void RealtimeSession::warn(std::string what) {
+  m_warnings.push_back(std::move(what));
+}
+
+void RealtimeSession::set_scheduler(int priority) {
+  int policy{};
+  sched_param old_param{};
+  if (const auto err =
+          pthread_getschedparam(pthread_self(), &policy, &old_param);
+      err != 0) {
+    warn(fmt::format("Can't query the scheduling policy: {}",
+                     error_string(err)));
+    return;
+  }
+  const auto prio = std::clamp(priority, sched_get_priority_min(SCHED_FIFO),
+                               sched_get_priority_max(SCHED_FIFO));
+  sched_param param{};
+  param.sched_priority = prio;
+  if (const auto err =
+          pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+      err != 0) {
+    warn(fmt::format("Can't set SCHED_FIFO scheduling (priority {}): {}", prio,
+                     error_string(err)));
+    return;
+  }
+  m_old_sched.emplace(policy, old_param);
+}
+
+void RealtimeSession::pin_cpu(std::optional<unsigned> cpu) {
+  cpu_set_t allowed;
+  CPU_ZERO(&allowed);
+  if (const auto err =
+          pthread_getaffinity_np(pthread_self(), sizeof(allowed), &allowed);
+      err != 0) {
+    warn(fmt::format("Can't query the CPU affinity: {}", error_string(err)));
+    return;
+  }
+  if (!cpu) {
+    // isolated CPUs are not in the default affinity mask, so they are tried
+    // regardless of the current mask
+    if (const auto isolated = read_cpu_list(ISOLATED_CPUS); !isolated.empty()) {
+      cpu = isolated.front();
+    } else {
+      for (unsigned i = CPU_SETSIZE; i-- > 0;) {
+        if (CPU_ISSET(i, &allowed)) {
+          cpu = i;
+          break;
+        }
+      }
+    }
+  }
+  if (!cpu || *cpu >= CPU_SETSIZE) {
+    warn("No CPU found to pin the programming thread to");
+    return;
+  }
+  cpu_set_t target;
+  CPU_ZERO(&target);
+  CPU_SET(*cpu, &target);
+  if (const auto err =
+          pthread_setaffinity_np(pthread_self(), sizeof(target), &target);
+      err != 0) {
+    warn(fmt::format("Can't pin the programming thread to CPU {}: {}", *cpu,
+                     error_string(err)));
+    return;
+  }
+  m_old_affinity = allowed;
+  m_cpu = cpu;
+}
+
+void RealtimeSession::lock_memory(std::size_t prefault_size) {
+  if (::mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+    warn(fmt::format("Can't lock the process memory: {}",
+                     error_string(errno)));
+  } else {
+    m_memory_locked = true;
+  }
+  // Even without locking, pre-faulting avoids the page faults on the first
+  // deep calls in the time critical part
+  prefault_stack(prefault_size);
+}
+
+void RealtimeSession::request_cpu_latency(std::chrono::microseconds latency) {
+  const auto fd = ::open(PM_QOS_CPU_LATENCY, O_RDWR | O_CLOEXEC);
+  if (fd < 0) {
+    warn(fmt::format("Can't open {}: {}", PM_QOS_CPU_LATENCY,
+                     error_string(errno)));
+    return;
+  }
+  const auto value = static_cast<std::int32_t>(latency.count());
+  if (::write(fd, &value, sizeof(value)) != sizeof(value)) {
+    warn(fmt::format("Can't set the CPU latency request: {}",
+                     error_string(errno)));
+    ::close(fd);
+    return;
+  }
+  m_pm_qos_fd = fd;
+}
@@ -0,0 +1,104 @@
+// SPDX-FileCopyrightText: 2024 Ferenc Nandor Janky <ferenj@effective-range.com>
+// SPDX-FileCopyrightText: 2024 Attila Gombos <attila.gombos@effective-range.com>
+// SPDX-License-Identifier: MIT
+
+#include <SharedICSPBus.hpp>
+
+#include <chrono>
+#include <span>
+
+class SharedICSPBus::Target final : public IGPIO {
+public:
+  Target(SharedICSPBus &bus, port_id_t prog_en)
+      : m_bus{bus}, m_prog_en{prog_en} {}
+
+  ~Target() override { m_bus.release(*this); }
+
+  void set_gpio_mode(port_id_t port, Modes mode, val_t initial) override {
+    if (port == m_prog_en) {
+      m_enabled = false;
+      m_bus.release(*this);
+      gpio().set_gpio_mode(port, mode, 0);
+      if (mode == Modes::OUTPUT && initial) {
+        gpio_write(port, initial);
+      }
+      return;
+    }
+    m_bus.use(*this);
+    gpio().set_gpio_mode(port, mode, initial);
+  }
+
+  void gpio_write(port_id_t port, val_t val) override {
+    if (port == m_prog_en) {
+      m_enabled = val != 0;
+      if (m_enabled) {
+        m_bus.use(*this);
+      } else {
+        m_bus.release(*this);
+      }
+      return;
+    }
+    m_bus.use(*this);
+    gpio().gpio_write(port, val);
+  }
+
+  val_t gpio_read(port_id_t port) override {
+    m_bus.use(*this);
+    return gpio().gpio_read(port);
+  }
+
+  void gpio_write_many(std::span<const port_id_t> ports,
+                       std::span<const val_t> vals) override {
+    m_bus.use(*this);
+    gpio().gpio_write_many(ports, vals);
+  }
+
+  void gpio_read_many(std::span<const port_id_t> ports,
+                      std::span<val_t> vals) override {
+    m_bus.use(*this);
+    gpio().gpio_read_many(ports, vals);
+  }
+
+  void delay(std::chrono::microseconds d) override { gpio().delay(d); }
+
+  Capabilities capabilities() const override {
+    return m_bus.m_gpio->capabilities();
+  }
+
+  std::chrono::nanoseconds now() const override { return m_bus.m_gpio->now(); }
+
+  [[nodiscard]] bool enabled() const noexcept { return m_enabled; }
+  [[nodiscard]] port_id_t prog_en() const noexcept { return m_prog_en; }
+
+private:
+  IGPIO &gpio() { return *m_bus.m_gpio; }
+
+  SharedICSPBus &m_bus;
+  port_id_t m_prog_en;
+  bool m_enabled{};
+};
+
+IGPIO::Ptr SharedICSPBus::target(IGPIO::port_id_t prog_en_pin) {
+  return std::make_shared<Target>(*this, prog_en_pin);
+}
+
+void SharedICSPBus::use(Target &target) {
+  if (m_owner == &target) {
+    return;
+  }
+  if (m_owner != nullptr) {
+    m_gpio->gpio_write(m_owner->prog_en(), 0);
+    m_owner = nullptr;
+  }
+  if (target.enabled()) {
+    m_gpio->gpio_write(target.prog_en(), 1);
+    m_owner = &target;
+  }
+}
+
+void SharedICSPBus::release(Target &target) {
+  if (m_owner == &target) {
+    m_gpio->gpio_write(target.prog_en(), 0);
+    m_owner = nullptr;
+  }
+}
@@ -0,0 +1,32 @@
+// SPDX-FileCopyrightText: 2024 Ferenc Nandor Janky <ferenj@effective-range.com>
+// SPDX-FileCopyrightText: 2024 Attila Gombos
+// <attila.gombos@effective-range.com> SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <IGPIO.hpp>
+
+#include <chrono>
+#include <concepts>
+#include <span>
+
+// Interface of the GPIO backends usable with static dispatch (e.g. by
+// BasicICSPHeader). IGPIO itself satisfies it, in that case every call is
+// virtual. Concrete (final) backends get their calls inlined.
+template <typename B>
+concept GPIOBackend = requires(B &b, const B &cb, IGPIO::port_id_t port,
+                               IGPIO::Modes mode, IGPIO::val_t val,
+                               std::chrono::microseconds d,
+                               std::span<const IGPIO::port_id_t> ports,
+                               std::span<IGPIO::val_t> vals) {
+  b.set_gpio_mode(port, mode, val);
+  b.gpio_write(port, val);
+  { b.gpio_read(port) } -> std::convertible_to<IGPIO::val_t>;
+  b.gpio_write_many(ports, std::span<const IGPIO::val_t>{vals});
+  b.gpio_read_many(ports, vals);
+  b.delay(d);
+  { cb.capabilities() } -> std::convertible_to<IGPIO::Capabilities>;
+  { cb.now() } -> std::convertible_to<std::chrono::nanoseconds>;
+};
+
+static_assert(GPIOBackend<IGPIO>);
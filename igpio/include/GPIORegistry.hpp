@@ -0,0 +1,82 @@
+// SPDX-FileCopyrightText: 2024 Ferenc Nandor Janky <ferenj@effective-range.com>
+// SPDX-FileCopyrightText: 2024 Attila Gombos
+// <attila.gombos@effective-range.com> SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <IGPIO.hpp>
+
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Registry of the GPIO backends linked into the binary.
+// Backends register themselves with a static GPIOBackendRegistrar
+// instance in their translation unit.
+//
+// Backend selection by name:
+//  - "auto" creates every usable hardware backend, and when a probe pin is
+//    given runs a short toggle/read latency probe on it and keeps the
+//    fastest one (otherwise the one with the highest priority wins).
+//    Simulated backends are never selected, they have to be named.
+//  - any other name creates that specific backend
+class GPIORegistry {
+public:
+  using Factory = std::function<IGPIO::Ptr()>;
+
+  struct Backend {
+    std::string name;
+    Factory factory;
+    // higher priority wins when no latency probe is done
+    int priority{};
+    // simulated backends don't drive real lines
+    bool simulated{};
+  };
+
+  struct ProbeResult {
+    std::string name;
+    IGPIO::Ptr gpio;
+    // average duration of a single line operation, empty if probe failed
+    std::optional<std::chrono::nanoseconds> latency;
+  };
+
+  static constexpr std::string_view AUTO = "auto";
+
+  static GPIORegistry &instance();
+
+  void add(Backend backend);
+
+  std::vector<std::string> names() const;
+
+  // Create the backend by name (or "auto"), the probe pin is only used
+  // by auto selection, and is left in OUTPUT/low state
+  IGPIO::Ptr create(std::string_view name,
+                    std::optional<IGPIO::port_id_t> probe_pin = {}) const;
+
+  // Create and probe all the usable hardware backends
+  std::vector<ProbeResult> probe_all(IGPIO::port_id_t probe_pin) const;
+
+  // Measure the average latency of a line write/read on the given pin
+  static std::chrono::nanoseconds probe(IGPIO &gpio, IGPIO::port_id_t pin,
+                                        unsigned iterations = 64);
+
+private:
+  GPIORegistry() = default;
+  IGPIO::Ptr create_auto(std::optional<IGPIO::port_id_t> probe_pin) const;
+  std::vector<Backend> sorted_backends() const;
+
+  mutable std::mutex m_mutex;
+  std::vector<Backend> m_backends;
+};
+
+struct GPIOBackendRegistrar {
+  GPIOBackendRegistrar(std::string name, GPIORegistry::Factory factory,
+                       int priority = 0, bool simulated = false) {
+    GPIORegistry::instance().add(GPIORegistry::Backend{
+        std::move(name), std::move(factory), priority, simulated});
+  }
+};
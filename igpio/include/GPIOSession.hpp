@@ -0,0 +1,56 @@
+// SPDX-FileCopyrightText: 2024 Ferenc Nandor Janky <ferenj@effective-range.com>
+// SPDX-FileCopyrightText: 2024 Attila Gombos
+// <attila.gombos@effective-range.com> SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <IGPIO.hpp>
+#include <SignalBridge.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+// Interrupt state of one programming session (e.g. an ICSPHeader, or the
+// headers driven together by a service request). The termination signals
+// reach every session, but a session can be interrupted, or can forget the
+// signals it has seen, without affecting the others.
+// All members are thread-safe, interrupt() may be called from any thread.
+class GPIOSession {
+public:
+  using Ptr = std::shared_ptr<GPIOSession>;
+
+  // The signals the process hasn't handled yet interrupt the new session too
+  GPIOSession() noexcept : m_seen{SignalBridge::handled_count()} {}
+  GPIOSession(const GPIOSession &) = delete;
+  GPIOSession &operator=(const GPIOSession &) = delete;
+
+  static Ptr create() { return std::make_shared<GPIOSession>(); }
+
+  void interrupt() noexcept {
+    m_interrupted.store(true, std::memory_order_relaxed);
+  }
+
+  [[nodiscard]] bool interrupted() const noexcept {
+    const auto seen = m_seen.load(std::memory_order_relaxed);
+    return m_interrupted.load(std::memory_order_relaxed) ||
+           SignalBridge::signal_count() != seen;
+  }
+
+  // Throws IGPIO::Interrupted if the session was interrupted
+  void throw_if_interrupted() const {
+    if (interrupted()) {
+      throw IGPIO::Interrupted{};
+    }
+  }
+
+  // Forgets the interrupt and the signals received so far
+  void reset() noexcept {
+    m_seen.store(SignalBridge::signal_count(), std::memory_order_relaxed);
+    m_interrupted.store(false, std::memory_order_relaxed);
+  }
+
+private:
+  std::atomic<bool> m_interrupted{false};
+  std::atomic<std::uint64_t> m_seen;
+};
@@ -4,8 +4,12 @@
 
 #pragma once
 
+#include <cassert>
 #include <chrono>
+#include <cstddef>
 #include <memory>
+#include <span>
+#include <string_view>
 
 struct IGPIO {
   using Ptr = std::shared_ptr<IGPIO>;
@@ -28,6 +32,18 @@ struct IGPIO {
   using port_id_t = unsigned;
   using val_t = unsigned;
 
+  // Describes what a backend can do, users (e.g. ICSPHeader) can choose their
+  // bit-banging strategy based on it
+  struct Capabilities {
+    // can queue up several line operations and execute them at once
+    bool batching{};
+    // can update several lines of a bank in one operation
+    bool multi_pin_write{};
+    // guaranteed minimum time between two consecutive edges
+    // produced by the backend itself (0 if unknown)
+    std::chrono::nanoseconds min_edge_period{};
+  };
+
   virtual void set_gpio_mode(port_id_t port, Modes mode, val_t initial) = 0;
   void set_gpio_mode(port_id_t port, Modes mode) {
     set_gpio_mode(port, mode, 0);
@@ -35,9 +51,36 @@ struct IGPIO {
   virtual void gpio_write(port_id_t gpio, val_t val) = 0;
   virtual val_t gpio_read(port_id_t gpio) = 0;
 
+  // Writes/samples several lines at once, backends with multi_pin_write
+  // capability do it in one bank operation, otherwise one line at a time
+  virtual void gpio_write_many(std::span<const port_id_t> ports,
+                               std::span<const val_t> vals) {
+    assert(ports.size() == vals.size());
+    for (std::size_t i = 0; i < ports.size(); ++i) {
+      gpio_write(ports[i], vals[i]);
+    }
+  }
+  virtual void gpio_read_many(std::span<const port_id_t> ports,
+                              std::span<val_t> vals) {
+    assert(ports.size() == vals.size());
+    for (std::size_t i = 0; i < ports.size(); ++i) {
+      vals[i] = gpio_read(ports[i]);
+    }
+  }
+
   virtual void delay(std::chrono::microseconds) = 0;
 
+  virtual Capabilities capabilities() const { return {}; }
+
+  // Time base of the backend, delay() advances it by at least the delay
+  // (simulated backends can have their own virtual time)
+  virtual std::chrono::nanoseconds now() const {
+    return std::chrono::steady_clock::now().time_since_epoch();
+  }
+
+  // Creates the default backend, see GPIORegistry for the selection rules
   static Ptr Create();
+  static Ptr Create(std::string_view backend);
 
   virtual ~IGPIO() = default;
 };
\ No newline at end of file
@@ -0,0 +1,174 @@
+// SPDX-FileCopyrightText: 2024 Ferenc Nandor Janky <ferenj@effective-range.com>
+// SPDX-FileCopyrightText: 2024 Attila Gombos
+// <attila.gombos@effective-range.com> SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <IGPIO.hpp>
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <utility>
+
+// Decorator around any IGPIO implementation, which keeps track of the last
+// known mode and level of every pin, and drops the writes and mode changes
+// that would not change the state of the line.
+// The shadow state is only updated after the underlying call succeeded, so
+// a failing (or interrupted) operation is never considered as applied.
+// Call invalidate() if the lines might have been changed behind our back.
+class ShadowGPIO final : public IGPIO {
+public:
+  // Pins above this limit are passed through without shadowing
+  static constexpr std::size_t MAX_SHADOWED_PINS = 64;
+
+  struct Stats {
+    std::size_t writes{};
+    std::size_t suppressed_writes{};
+    std::size_t mode_changes{};
+    std::size_t suppressed_mode_changes{};
+  };
+
+  explicit ShadowGPIO(IGPIO::Ptr gpio) : m_gpio(std::move(gpio)) {}
+
+  using IGPIO::set_gpio_mode;
+
+  void set_gpio_mode(port_id_t port, Modes mode, val_t initial) override {
+    ++m_stats.mode_changes;
+    auto *pin = shadow(port);
+    if (pin == nullptr) {
+      m_gpio->set_gpio_mode(port, mode, initial);
+      return;
+    }
+    if (pin->mode == mode) {
+      ++m_stats.suppressed_mode_changes;
+      // Mode is already in place, only the initial level needs to be applied
+      // (accounted for as part of the mode change)
+      if (mode == Modes::OUTPUT) {
+        write_level(*pin, port, initial);
+      }
+      return;
+    }
+    pin->mode.reset();
+    pin->level.reset();
+    m_gpio->set_gpio_mode(port, mode, initial);
+    pin->mode = mode;
+    if (mode == Modes::OUTPUT) {
+      pin->level = level(initial);
+    }
+  }
+
+  void gpio_write(port_id_t gpio, val_t val) override {
+    ++m_stats.writes;
+    auto *pin = shadow(gpio);
+    if (pin == nullptr) {
+      m_gpio->gpio_write(gpio, val);
+      return;
+    }
+    if (!write_level(*pin, gpio, val)) {
+      ++m_stats.suppressed_writes;
+    }
+  }
+
+  val_t gpio_read(port_id_t gpio) override { return m_gpio->gpio_read(gpio); }
+
+  // Only the lines with a new level are forwarded in the bank update,
+  // nothing if none of them changes
+  void gpio_write_many(std::span<const port_id_t> ports,
+                       std::span<const val_t> vals) override {
+    m_stats.writes += ports.size();
+    if (ports.size() > MAX_SHADOWED_PINS) {
+      // more lines than the buffers, forwarded as a whole
+      forward_many(ports, vals);
+      return;
+    }
+    std::array<port_id_t, MAX_SHADOWED_PINS> changed_ports;
+    std::array<val_t, MAX_SHADOWED_PINS> changed_vals;
+    std::size_t changed{};
+    for (std::size_t i = 0; i < ports.size(); ++i) {
+      if (const auto *pin = shadow(ports[i]);
+          pin && pin->mode == Modes::OUTPUT && pin->level == level(vals[i])) {
+        ++m_stats.suppressed_writes;
+        continue;
+      }
+      changed_ports[changed] = ports[i];
+      changed_vals[changed] = vals[i];
+      ++changed;
+    }
+    if (changed != 0) {
+      forward_many(std::span(changed_ports.data(), changed),
+                   std::span(changed_vals.data(), changed));
+    }
+  }
+
+  void gpio_read_many(std::span<const port_id_t> ports,
+                      std::span<val_t> vals) override {
+    m_gpio->gpio_read_many(ports, vals);
+  }
+
+  void delay(std::chrono::microseconds d) override { m_gpio->delay(d); }
+
+  Capabilities capabilities() const override { return m_gpio->capabilities(); }
+
+  std::chrono::nanoseconds now() const override { return m_gpio->now(); }
+
+  // Forget everything known about the pins, the next operations will all be
+  // forwarded to the underlying implementation
+  void invalidate() noexcept { m_pins = {}; }
+
+  void invalidate(port_id_t port) noexcept {
+    if (auto *pin = shadow(port); pin) {
+      *pin = {};
+    }
+  }
+
+  const Stats &stats() const noexcept { return m_stats; }
+  void reset_stats() noexcept { m_stats = {}; }
+
+  const IGPIO::Ptr &underlying() const noexcept { return m_gpio; }
+
+private:
+  struct PinShadow {
+    std::optional<Modes> mode;
+    std::optional<val_t> level;
+  };
+
+  static constexpr val_t level(val_t val) noexcept { return val ? 1 : 0; }
+
+  // Returns false if the write was suppressed
+  bool write_level(PinShadow &pin, port_id_t port, val_t val) {
+    if (pin.mode == Modes::OUTPUT && pin.level == level(val)) {
+      return false;
+    }
+    pin.level.reset();
+    m_gpio->gpio_write(port, val);
+    pin.level = level(val);
+    return true;
+  }
+
+  void forward_many(std::span<const port_id_t> ports,
+                    std::span<const val_t> vals) {
+    for (auto port : ports) {
+      if (auto *pin = shadow(port); pin) {
+        pin->level.reset();
+      }
+    }
+    m_gpio->gpio_write_many(ports, vals);
+    for (std::size_t i = 0; i < ports.size(); ++i) {
+      if (auto *pin = shadow(ports[i]); pin) {
+        pin->level = level(vals[i]);
+      }
+    }
+  }
+
+  PinShadow *shadow(port_id_t port) noexcept {
+    return port < m_pins.size() ? &m_pins[port] : nullptr;
+  }
+
+  IGPIO::Ptr m_gpio;
+  std::array<PinShadow, MAX_SHADOWED_PINS> m_pins{};
+  Stats m_stats{};
+};
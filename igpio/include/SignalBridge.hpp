@@ -0,0 +1,54 @@
+// SPDX-FileCopyrightText: 2024 Ferenc Nandor Janky <ferenj@effective-range.com>
+// SPDX-FileCopyrightText: 2024 Attila Gombos
+// <attila.gombos@effective-range.com> SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// Process wide bridge between the termination signals (SIGINT, SIGTERM) and
+// the code driving the GPIOs. The signal handler only bumps a lock-free
+// atomic counter, the users (e.g. ICSPHeader through its GPIOSession) poll
+// it at their own safe points (between transactions), so the backends don't
+// check anything per call.
+// The signals are counted instead of flagged, so every session can tell
+// whether a signal arrived since it started (or was reset) on its own.
+class SignalBridge {
+public:
+  // Registers the handlers (again), to be called after initializing
+  // libraries that install their own handlers (e.g. pigpio)
+  static void install();
+
+  // Number of signals received so far
+  [[nodiscard]] static std::uint64_t signal_count() noexcept {
+    return s_signals.load(std::memory_order_relaxed);
+  }
+
+  // Number of signals the process has handled, the new sessions only see
+  // the ones arriving after this
+  [[nodiscard]] static std::uint64_t handled_count() noexcept {
+    return s_handled.load(std::memory_order_relaxed);
+  }
+
+  // True if a signal arrived that the process hasn't handled yet
+  [[nodiscard]] static bool interrupted() noexcept {
+    return signal_count() != handled_count();
+  }
+
+  // Throws IGPIO::Interrupted if a signal arrived
+  static void throw_if_interrupted();
+
+  // Forgets the received signals (e.g. to continue after a handled
+  // interrupt), the running sessions have to be reset on their own
+  static void reset() noexcept {
+    s_handled.store(signal_count(), std::memory_order_relaxed);
+  }
+
+private:
+  static void on_signal(int sig) noexcept;
+
+  static_assert(std::atomic<std::uint64_t>::is_always_lock_free);
+  static std::atomic<std::uint64_t> s_signals;
+  static std::atomic<std::uint64_t> s_handled;
+};
@@ -0,0 +1,140 @@
+// SPDX-FileCopyrightText: 2024 Ferenc Nandor Janky <ferenj@effective-range.com>
+// SPDX-FileCopyrightText: 2024 Attila Gombos
+// <attila.gombos@effective-range.com> SPDX-License-Identifier: MIT
+
+#include <GPIORegistry.hpp>
+
+#include <algorithm>
+#include <exception>
+#include <iostream>
+#include <stdexcept>
+
+#include <fmt/format.h>
+#include <fmt/ranges.h>
+
+auto GPIORegistry::instance() -> GPIORegistry & {
+  static GPIORegistry registry;
+  return registry;
+}
+
+void GPIORegistry::add(Backend backend) {
+  std::lock_guard lock(m_mutex);
+  if (backend.name == AUTO) {
+    throw std::invalid_argument("Reserved GPIO backend name");
+  }
+  const auto it = std::find_if(
+      m_backends.begin(), m_backends.end(),
+      [&](Backend const &b) { return b.name == backend.name; });
+  if (it != m_backends.end()) {
+    throw std::invalid_argument(
+        fmt::format("GPIO backend {} registered twice", backend.name));
+  }
+  m_backends.push_back(std::move(backend));
+}
+
+auto GPIORegistry::sorted_backends() const -> std::vector<Backend> {
+  std::lock_guard lock(m_mutex);
+  auto res = m_backends;
+  std::stable_sort(res.begin(), res.end(), [](auto const &l, auto const &r) {
+    return l.priority > r.priority;
+  });
+  return res;
+}
+
+std::vector<std::string> GPIORegistry::names() const {
+  std::vector<std::string> res;
+  for (auto const &b : sorted_backends()) {
+    res.push_back(b.name);
+  }
+  return res;
+}
+
+IGPIO::Ptr
+GPIORegistry::create(std::string_view name,
+                     std::optional<IGPIO::port_id_t> probe_pin) const {
+  if (name == AUTO) {
+    return create_auto(probe_pin);
+  }
+  for (auto const &b : sorted_backends()) {
+    if (b.name == name) {
+      return b.factory();
+    }
+  }
+  throw std::invalid_argument(
+      fmt::format("Unknown GPIO backend: {} (available: {})", name,
+                  fmt::join(names(), ", ")));
+}
+
+auto GPIORegistry::probe_all(IGPIO::port_id_t probe_pin) const
+    -> std::vector<ProbeResult> {
+  std::vector<ProbeResult> res;
+  for (auto const &b : sorted_backends()) {
+    if (b.simulated) {
+      continue;
+    }
+    try {
+      auto gpio = b.factory();
+      const auto latency = probe(*gpio, probe_pin);
+      res.push_back({b.name, std::move(gpio), latency});
+    } catch (IGPIO::Interrupted const &) {
+      throw;
+    } catch (std::exception const &e) {
+      std::cerr << fmt::format("Warning: GPIO backend {} is not usable: {}\n",
+                               b.name, e.what());
+      res.push_back({b.name, nullptr, std::nullopt});
+    }
+  }
+  return res;
+}
+
+IGPIO::Ptr
+GPIORegistry::create_auto(std::optional<IGPIO::port_id_t> probe_pin) const {
+  if (probe_pin) {
+    auto results = probe_all(*probe_pin);
+    auto best = std::min_element(
+        results.begin(), results.end(), [](auto const &l, auto const &r) {
+          return l.latency.has_value() &&
+                 (!r.latency.has_value() || *l.latency < *r.latency);
+        });
+    if (best != results.end() && best->latency) {
+      return std::move(best->gpio);
+    }
+  } else {
+    for (auto const &b : sorted_backends()) {
+      if (b.simulated) {
+        continue;
+      }
+      try {
+        return b.factory();
+      } catch (IGPIO::Interrupted const &) {
+        throw;
+      } catch (std::exception const &e) {
+        std::cerr << fmt::format(
+            "Warning: GPIO backend {} is not usable: {}\n", b.name, e.what());
+      }
+    }
+  }
+  // never fall back to a simulated backend, that would "program" nothing
+  throw std::runtime_error("No usable GPIO backend found");
+}
+
+std::chrono::nanoseconds GPIORegistry::probe(IGPIO &gpio, IGPIO::port_id_t pin,
+                                             unsigned iterations) {
+  using clock = std::chrono::steady_clock;
+  gpio.set_gpio_mode(pin, IGPIO::Modes::OUTPUT, 0);
+  const auto start = clock::now();
+  for (unsigned i = 0; i < iterations; ++i) {
+    gpio.gpio_write(pin, 1);
+    gpio.gpio_write(pin, 0);
+    static_cast<void>(gpio.gpio_read(pin));
+  }
+  const auto elapsed = clock::now() - start;
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed) /
+         (3 * std::max(iterations, 1u));
+}
+
+IGPIO::Ptr IGPIO::Create() { return Create(GPIORegistry::AUTO); }
+
+IGPIO::Ptr IGPIO::Create(std::string_view backend) {
+  return GPIORegistry::instance().create(backend);
+}
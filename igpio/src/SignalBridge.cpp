@@ -0,0 +1,47 @@
+// SPDX-FileCopyrightText: 2024 Ferenc Nandor Janky <ferenj@effective-range.com>
+// SPDX-FileCopyrightText: 2024 Attila Gombos
+// <attila.gombos@effective-range.com> SPDX-License-Identifier: MIT
+
+#include <IGPIO.hpp>
+#include <SignalBridge.hpp>
+
+#include <fmt/format.h>
+
+#include <csignal>
+#include <iostream>
+
+#include <signal.h>
+
+std::atomic<std::uint64_t> SignalBridge::s_signals{0};
+std::atomic<std::uint64_t> SignalBridge::s_handled{0};
+
+void SignalBridge::on_signal(int) noexcept {
+  // only async-signal-safe operations here (lock-free atomics are)
+  s_signals.fetch_add(1, std::memory_order_relaxed);
+}
+
+namespace {
+void register_signal_handler(int sig, void (*handler)(int)) {
+  struct sigaction action {};
+  action.sa_handler = handler;
+  sigemptyset(&action.sa_mask);
+  // the blocking calls of the other threads are not failed with EINTR, the
+  // operations poll the flag instead
+  action.sa_flags = SA_RESTART;
+  if (::sigaction(sig, &action, nullptr) != 0) {
+    std::cerr << fmt::format("Warning: can't register signal handler for {}!\n",
+                             sig);
+  }
+}
+} // namespace
+
+void SignalBridge::install() {
+  register_signal_handler(SIGINT, on_signal);
+  register_signal_handler(SIGTERM, on_signal);
+}
+
+void SignalBridge::throw_if_interrupted() {
+  if (interrupted()) {
+    throw IGPIO::Interrupted{};
+  }
+}
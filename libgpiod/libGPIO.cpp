@@ -5,10 +5,11 @@
 #include "libGPIO.hpp"
 #include "IGPIO.hpp"
 
+#include <GPIORegistry.hpp>
 #include <IGPIO.hpp>
+#include <SignalBridge.hpp>
 
 #include <chrono>
-#include <csignal>
 #include <cstdlib>
 #include <exception>
 #include <filesystem>
@@ -18,58 +19,38 @@
 #include <memory>
 #include <stdexcept>
 
-#include <signal.h>
-
 #include <gpiod.hpp>
 
 namespace fs = std::filesystem;
 namespace {
-volatile sig_atomic_t s_interrupted = 0;
-
-void catch_signals(int sig) {
-  s_interrupted = 1;
-  signal(sig, catch_signals);
-}
-
+const GPIOBackendRegistrar s_registrar{
+    "libgpiod", [] { return std::make_shared<LibGPIO>(); }, 10};
 } // namespace
 
-IGPIO::Ptr IGPIO::Create() { return std::make_shared<LibGPIO>(); }
-
 LibGPIO::LibGPIO(std::string_view device)
-    : m_handle(::gpiod::chip(fs::path("/dev") / device)) {}
+    : m_handle(::gpiod::chip(fs::path("/dev") / device)) {
+  SignalBridge::install();
+}
 
 void LibGPIO::set_gpio_mode(port_id_t port, Modes mode, val_t initial) {
-  ensure_running();
   if (mode != Modes::INPUT && mode != Modes::OUTPUT) {
     throw std::runtime_error(
         "Only INPUT and OUTPUT modes are supported for libgpiod for now.");
   }
-  auto direction = mode == Modes::INPUT ? gpiod::line::direction::INPUT
-                                        : gpiod::line::direction::OUTPUT;
-  gpiod::line_settings s;
-  if (mode == Modes::OUTPUT) {
-    s.set_direction(gpiod::line::direction::OUTPUT);
-    s.set_output_value(initial ? gpiod::line::value::ACTIVE
-                               : gpiod::line::value::INACTIVE);
-  } else {
-    s.set_direction(gpiod::line::direction::INPUT);
-  }
-  auto &req = get_line(port);
-  gpiod::line_config cfg;
-  cfg.add_line_settings(port, s);
-  req.reconfigure_lines(cfg);
+  auto &line = get_line(port);
+  line.request.reconfigure_lines(mode == Modes::INPUT
+                                     ? line.input
+                                     : line.output[initial ? 1 : 0]);
 }
 
 void LibGPIO::gpio_write(port_id_t gpio, val_t val) {
-  ensure_running();
-  auto &req = get_line(gpio);
+  auto &req = get_line(gpio).request;
   req.set_value(gpio, val ? gpiod::line::value::ACTIVE
                           : gpiod::line::value::INACTIVE);
 }
 
 auto LibGPIO::gpio_read(port_id_t gpio) -> val_t {
-  ensure_running();
-  auto &req = get_line(gpio);
+  auto &req = get_line(gpio).request;
   return (req.get_value(gpio) == gpiod::line::value::ACTIVE) ? 1 : 0;
 }
 void LibGPIO::delay(std::chrono::microseconds delay) {
@@ -81,17 +62,24 @@ void LibGPIO::delay(std::chrono::microseconds delay) {
   }
 }
 
-void LibGPIO::ensure_running() {
-  // Don't throw if there's already an exception in-flight
-  if (s_interrupted && std::uncaught_exceptions() == 0) {
-    throw Interrupted{};
+namespace {
+gpiod::line_config line_config(IGPIO::port_id_t port,
+                               gpiod::line::direction direction,
+                               gpiod::line::value value = {}) {
+  gpiod::line_settings s;
+  s.set_direction(direction);
+  if (direction == gpiod::line::direction::OUTPUT) {
+    s.set_output_value(value);
   }
+  gpiod::line_config cfg;
+  cfg.add_line_settings(port, s);
+  return cfg;
 }
-gpiod::line_request &LibGPIO::get_line(port_id_t gpio) {
+} // namespace
 
-  auto it = m_lines.find(gpio);
-  if (it != m_lines.end()) {
-    return it->second;
+auto LibGPIO::get_line(port_id_t gpio) -> Line & {
+  if (gpio < m_lines.size() && m_lines[gpio]) {
+    return *m_lines[gpio];
   }
   gpiod::line_settings s;
   s.set_direction(gpiod::line::direction::AS_IS);
@@ -101,6 +89,13 @@ gpiod::line_request &LibGPIO::get_line(port_id_t gpio) {
                  .add_line_settings(gpio, s)
                  .do_request();
 
-  auto [ins_it, _] = m_lines.emplace(gpio, std::move(req));
-  return ins_it->second;
+  if (gpio >= m_lines.size()) {
+    m_lines.resize(gpio + 1);
+  }
+  using gpiod::line::direction;
+  using gpiod::line::value;
+  return m_lines[gpio].emplace(
+      Line{std::move(req), line_config(gpio, direction::INPUT),
+           {line_config(gpio, direction::OUTPUT, value::INACTIVE),
+            line_config(gpio, direction::OUTPUT, value::ACTIVE)}});
 }
@@ -7,15 +7,16 @@
 #include <IGPIO.hpp>
 
 #include <gpiod.hpp>
-#include <map>
+
+#include <array>
 #include <memory>
+#include <optional>
+#include <vector>
 
-struct LibGPIO : public IGPIO {
+struct LibGPIO final : public IGPIO {
 
   LibGPIO(std::string_view device = "gpiochip0");
 
-  static void ensure_running();
-
   void set_gpio_mode(port_id_t port, Modes mode, val_t initial) override;
   using IGPIO::set_gpio_mode;
 
@@ -25,7 +26,16 @@ struct LibGPIO : public IGPIO {
   void delay(std::chrono::microseconds) override;
 
 private:
-  gpiod::line_request &get_line(port_id_t gpio);
+  // The line configurations are built once per line, switching the
+  // direction on the hot path (e.g. DATA for the reads) doesn't allocate
+  struct Line {
+    gpiod::line_request request;
+    gpiod::line_config input;
+    std::array<gpiod::line_config, 2> output; // by initial level
+  };
+
+  Line &get_line(port_id_t gpio);
   gpiod::chip m_handle;
-  std::map<port_id_t, gpiod::line_request> m_lines;
+  // indexed by the port
+  std::vector<std::optional<Line>> m_lines;
 };
\ No newline at end of file
@@ -6,59 +6,69 @@
 
 #include <IGPIO.hpp>
 
+#include <atomic>
 #include <chrono>
 #include <map>
 #include <memory>
 #include <optional>
+#include <vector>
 
 class MockPIC18Q20;
 
+// Context of the mocked GPIO library. Unlike the real libraries, which are
+// process wide, every MockGPIO gets its own one by default, so the mocks (and
+// the tests using them) are isolated from each other. A context may still be
+// shared by several mocks (e.g. to mimic the real library).
 class GPIOLibHandle {
 private:
   struct CtorTag {};
 
 public:
   using Ptr = std::shared_ptr<GPIOLibHandle>;
-  using Ref = std::weak_ptr<GPIOLibHandle>;
-  static Ptr instance();
-  static Ref weak_instance();
 
-  GPIOLibHandle(CtorTag const &) : GPIOLibHandle() {}
+  struct Options {
+    bool fail_to_initialize{false};
+  };
 
-  static bool set_fail_to_init(bool val) {
-    return std::exchange(fail_to_initialize, val);
-  }
+  static Ptr create();
+  static Ptr create(Options options);
 
-  bool is_initialized() const noexcept { return initialized; }
+  GPIOLibHandle(CtorTag const &, Options options);
+  GPIOLibHandle(const GPIOLibHandle &) = delete;
+  GPIOLibHandle &operator=(const GPIOLibHandle &) = delete;
+  ~GPIOLibHandle();
 
-  bool is_terminated() const noexcept { return terminated; }
+  bool is_initialized() const noexcept {
+    return m_initialized.load(std::memory_order_relaxed);
+  }
 
-private:
-  void terminate();
-  static void atexit_cleanup();
+  bool is_terminated() const noexcept {
+    return m_terminated.load(std::memory_order_relaxed);
+  }
 
-  static Ref handle;
-  static bool fail_to_initialize;
-  static bool initialized;
-  static bool terminated;
+  void terminate() noexcept;
 
-  GPIOLibHandle();
-  ~GPIOLibHandle();
+private:
+  std::atomic<bool> m_initialized{false};
+  std::atomic<bool> m_terminated{false};
 };
 
-struct MockGPIO : public IGPIO {
+struct MockGPIO final : public IGPIO {
   struct GPIOState;
   struct PinListener {
     virtual void onWrite(GPIOState &state, val_t v) = 0;
     virtual val_t onRead(GPIOState &state) = 0;
     virtual void onModeChange(GPIOState &state, Modes mode) = 0;
     virtual void onWait(std::chrono::microseconds d) = 0;
+    // false while the listener is isolated from the line (e.g. a mocked
+    // target disconnected from a shared bus), it doesn't answer reads then
+    virtual bool connected() const { return true; }
 
   protected:
     ~PinListener() = default;
   };
 
-  MockGPIO();
+  explicit MockGPIO(GPIOLibHandle::Ptr handle = GPIOLibHandle::create());
   struct GPIOState {
     const port_id_t id;
     Modes mode;
@@ -66,18 +76,29 @@ struct MockGPIO : public IGPIO {
     PinListener *listener{};
   };
 
-  static void ensure_running();
-
   void set_gpio_mode(port_id_t port, Modes mode, val_t initial) override;
 
   void gpio_write(port_id_t gpio, val_t val) override;
 
   val_t gpio_read(port_id_t gpio) override;
   void delay(std::chrono::microseconds) override;
+  // virtual time, only advanced by delay()
+  std::chrono::nanoseconds now() const override { return m_now; }
 
   void set_pin_listener(port_id_t p, PinListener *listener = nullptr);
 
-  static std::shared_ptr<MockGPIO> Create();
+  // Attaches one more listener to the pin, e.g. for the lines shared by
+  // several mocked targets (gang programming). The reads are answered by
+  // the first connected listener.
+  void add_pin_listener(port_id_t p, PinListener *listener);
+  void remove_pin_listener(port_id_t p, PinListener *listener);
+
+  static std::shared_ptr<MockGPIO> Create(
+      GPIOLibHandle::Ptr handle = GPIOLibHandle::create());
+
+  [[nodiscard]] GPIOLibHandle::Ptr const &handle() const noexcept {
+    return m_handle;
+  }
 
   std::optional<GPIOState> get_state(port_id_t);
 
@@ -88,8 +109,22 @@ struct MockGPIO : public IGPIO {
   void load_mock_buffer();
 
 private:
+  struct PinFanout final : PinListener {
+    void onWrite(GPIOState &state, val_t v) override;
+    val_t onRead(GPIOState &state) override;
+    void onModeChange(GPIOState &state, Modes mode) override;
+    void onWait(std::chrono::microseconds d) override;
+    bool connected() const override;
+
+    std::vector<PinListener *> listeners;
+  };
+
+  PinListener *listener(port_id_t p) const;
+
   using GPIOStates = std::map<port_id_t, GPIOState>;
   GPIOStates m_gpios;
+  std::map<port_id_t, std::unique_ptr<PinFanout>> m_fanouts;
   GPIOLibHandle::Ptr m_handle;
   std::optional<std::string_view> m_out_filename;
+  std::chrono::nanoseconds m_now{};
 };
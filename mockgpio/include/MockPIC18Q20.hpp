@@ -11,10 +11,13 @@
 #include "PIC18-Q20.hpp"
 #include "Region.hpp"
 
+#include <array>
 #include <bitset>
 #include <chrono>
+#include <cstddef>
 #include <cstdint>
 #include <memory>
+#include <new>
 #include <optional>
 #include <stdexcept>
 #include <type_traits>
@@ -118,6 +121,7 @@ struct ICSPDatPin : PinListener {
   void onWrite(MockGPIO::GPIOState &st, val_t v) override;
   void onModeChange(MockGPIO::GPIOState &state, IGPIO::Modes mode) override;
   void onWait(std::chrono::microseconds d) override;
+  bool connected() const override;
   std::optional<val_t> value() const;
   void set_value(std::optional<val_t> val);
   IGPIO::Modes client_mode{IGPIO::Modes::INPUT};
@@ -130,13 +134,55 @@ private:
   std::optional<val_t> m_value;
 };
 
+// Storage of the current protocol state without heap allocations.
+// The new states are constructed in the slots in turn, so the last two
+// states stay alive: the handler that made the transition may still be
+// running, and it may hand the event on to the new state, which can make
+// one more transition (e.g. INC_PC passes the clock edge to PROGRAMMING).
+class StateSlots {
+public:
+  static constexpr std::size_t SLOT_SIZE = 128;
+  static constexpr std::size_t SLOT_COUNT = 3;
+
+  StateSlots() = default;
+  StateSlots(const StateSlots &) = delete;
+  StateSlots &operator=(const StateSlots &) = delete;
+  ~StateSlots();
+
+  template <typename S, typename... Args> S *emplace(Args &&...args) {
+    static_assert(sizeof(S) <= SLOT_SIZE &&
+                  alignof(S) <= alignof(std::max_align_t));
+    const auto next = (m_active + 1) % SLOT_COUNT;
+    reset(next);
+    // the current state is kept if the new one can't be constructed
+    auto *state = ::new (m_slots[next].bytes) S(std::forward<Args>(args)...);
+    m_states[next] = state;
+    m_active = next;
+    return state;
+  }
+
+  PIC18Q20StateImpl *get() const noexcept { return m_states[m_active]; }
+  PIC18Q20StateImpl *operator->() const noexcept { return get(); }
+  PIC18Q20StateImpl &operator*() const noexcept { return *get(); }
+
+private:
+  void reset(std::size_t slot) noexcept;
+
+  struct alignas(std::max_align_t) Slot {
+    std::byte bytes[SLOT_SIZE];
+  };
+  std::array<Slot, SLOT_COUNT> m_slots;
+  std::array<PIC18Q20StateImpl *, SLOT_COUNT> m_states{};
+  std::size_t m_active{};
+};
+
 // TODO: dump to file based on environment variable (hex, bin)
 struct PIC18Q20State {
   PIC18Q20State(MockPIC18Q20 *s) : pic{s}, icspdat(s, this) {}
   ////////////////
   make_mem_buffer<std::remove_const_t<decltype(pic18fq20)>>::type buffer;
   std::optional<uint32_t> pc{};
-  std::unique_ptr<PIC18Q20StateImpl> prog_state;
+  StateSlots prog_state;
   MockPIC18Q20 *pic{};
   ICSPDatPin icspdat;
   using us = std::chrono::microseconds;
@@ -149,6 +195,9 @@ struct PIC18Q20State {
   us last_mclr_rising{};
   us last_mclr_falling{};
   std::optional<us> last_data_latch{};
+  // the ICSP lines are connected to the header by PROG_EN
+  bool connected{};
+  bool mclr_low{};
 };
 
 struct IPIC18Q20 {
@@ -448,24 +497,34 @@ public:
   MockPIC18Q20(const MockPIC18Q20 &) = delete;
   MockPIC18Q20 &operator=(const MockPIC18Q20 &) = delete;
 
+  // CLK and DATA edges of an isolated target are not seen (e.g. when it
+  // shares the lines with other targets)
   void clk_rising() {
+    if (!m_state->connected) {
+      return;
+    }
     m_state->last_clk_rising = m_state->last_clk_change = m_state->now;
     return m_state->prog_state->clk_rising();
   }
   void clk_falling() {
+    if (!m_state->connected) {
+      return;
+    }
     m_state->last_clk_falling = m_state->last_clk_change = m_state->now;
     return m_state->prog_state->clk_falling();
   }
   void mclr_rising() {
     m_state->last_mclr_rising = m_state->last_mclr_change = m_state->now;
     m_state->prog_state->mclr_rising();
+    m_state->mclr_low = false;
   }
   void mclr_falling() {
     m_state->last_mclr_falling = m_state->last_mclr_change = m_state->now;
     m_state->prog_state->mclr_falling();
+    m_state->mclr_low = true;
   }
-  void prog_en_rising() { m_state->prog_state->prog_en_rising(); }
-  void prog_en_falling() { m_state->prog_state->prog_en_falling(); }
+  void prog_en_rising();
+  void prog_en_falling();
 
   PIC18Q20StateImpl &state() { return *m_state->prog_state; }
   auto &buffer() { return m_state->buffer; }
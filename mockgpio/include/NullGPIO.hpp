@@ -0,0 +1,18 @@
+// SPDX-FileCopyrightText: 2024 Ferenc Nandor Janky <ferenj@effective-range.com>
+// SPDX-FileCopyrightText: 2024 Attila Gombos
+// <attila.gombos@effective-range.com> SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <IGPIO.hpp>
+
+#include <chrono>
+
+// GPIO backend without any side effect, used for measuring the host
+// overhead of the protocol implementation
+struct NullGPIO final : public IGPIO {
+  void set_gpio_mode(port_id_t, Modes, val_t) override {}
+  void gpio_write(port_id_t, val_t) override {}
+  val_t gpio_read(port_id_t) override { return 0; }
+  void delay(std::chrono::microseconds) override {}
+};
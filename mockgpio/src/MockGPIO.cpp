@@ -3,10 +3,12 @@
 // <attila.gombos@effective-range.com> SPDX-License-Identifier: MIT
 #include "IntelHex.hpp"
 #include "PIC18-Q20.hpp"
+#include <GPIORegistry.hpp>
 #include <ICSP_header.hpp>
 #include <IGPIO.hpp>
 #include <MockGPIO.hpp>
 #include <MockPIC18Q20.hpp>
+#include <SignalBridge.hpp>
 
 #include <fmt/format.h>
 #include <fstream>
@@ -18,22 +20,11 @@
 #include <memory>
 #include <optional>
 #include <range/v3/view/enumerate.hpp>
-#include <signal.h>
 #include <stdexcept>
 
 namespace rg = ranges;
 namespace rgv = rg::views;
 
-namespace {
-volatile sig_atomic_t s_interrupted = 0;
-
-void catch_signals(int sig) {
-  s_interrupted = 1;
-  signal(sig, catch_signals);
-}
-
-} // namespace
-
 void MockGPIO::load_mock_buffer() {
   const auto inhexfile = std::getenv("MOCK_GPIO_INPUT_HEX");
   if (inhexfile) {
@@ -50,19 +41,22 @@ void MockGPIO::load_mock_buffer() {
   }
 }
 
-__attribute__((weak)) IGPIO::Ptr IGPIO::Create() {
+namespace {
+IGPIO::Ptr create_mock_gpio() {
   auto gpio = MockGPIO::Create();
   gpio->pic = std::make_unique<MockPIC18Q20>(gpio.get(), ICSPPins{});
   gpio->load_mock_buffer();
   return gpio;
 }
 
-std::shared_ptr<MockGPIO> MockGPIO::Create() {
-  return std::make_shared<MockGPIO>();
+const GPIOBackendRegistrar s_registrar{"mock", create_mock_gpio, 0, true};
+} // namespace
+
+std::shared_ptr<MockGPIO> MockGPIO::Create(GPIOLibHandle::Ptr handle) {
+  return std::make_shared<MockGPIO>(std::move(handle));
 }
 
 void MockGPIO::set_gpio_mode(port_id_t port, Modes mode, val_t initial) {
-  ensure_running();
   if (auto it = m_gpios.find(port); it != m_gpios.end()) {
     it->second.listener->onModeChange(it->second, mode);
     it->second.mode = mode;
@@ -75,7 +69,6 @@ void MockGPIO::set_gpio_mode(port_id_t port, Modes mode, val_t initial) {
 }
 
 void MockGPIO::gpio_write(port_id_t gpio, val_t val) {
-  ensure_running();
   if (auto it = m_gpios.find(gpio);
       it == m_gpios.end() || it->second.mode != Modes::OUTPUT) {
     throw std::runtime_error("Trying to write GPIO on non-output port");
@@ -87,7 +80,6 @@ void MockGPIO::gpio_write(port_id_t gpio, val_t val) {
   }
 }
 IGPIO::val_t MockGPIO::gpio_read(port_id_t gpio) {
-  ensure_running();
   if (auto it = m_gpios.find(gpio);
       it == m_gpios.end() || it->second.mode != Modes::INPUT) {
     throw std::runtime_error("Trying to read GPIO on non-input port");
@@ -109,78 +101,122 @@ void MockGPIO::set_pin_listener(port_id_t p, PinListener *listener) {
   }
 }
 
-void MockGPIO::delay(std::chrono::microseconds d) {
-  ensure_running();
-  std::for_each(m_gpios.begin(), m_gpios.end(),
-                [d](auto &e) { e.second.listener->onWait(d); });
+auto MockGPIO::listener(port_id_t p) const -> PinListener * {
+  const auto it = m_gpios.find(p);
+  return it == m_gpios.end() ? nullptr : it->second.listener;
 }
 
-MockGPIO::MockGPIO() : m_handle(GPIOLibHandle::instance()) {}
-
-GPIOLibHandle::GPIOLibHandle() {
-  MockGPIO::ensure_running();
-  if (fail_to_initialize) {
-    throw std::runtime_error("GPIO init failed");
+void MockGPIO::add_pin_listener(port_id_t p, PinListener *listener) {
+  auto *current = this->listener(p);
+  if (current == nullptr) {
+    set_pin_listener(p, listener);
+    return;
+  }
+  if (auto it = m_fanouts.find(p); it != m_fanouts.end()) {
+    it->second->listeners.push_back(listener);
+    auto &state = m_gpios.at(p);
+    listener->onModeChange(state, state.mode);
+    return;
+  }
+  auto fanout = std::make_unique<PinFanout>();
+  fanout->listeners = {current, listener};
+  auto &fanout_ref = *fanout;
+  m_fanouts.emplace(p, std::move(fanout));
+  // the fan-out forwards the mode to the already attached listener again
+  set_pin_listener(p, &fanout_ref);
+}
+
+void MockGPIO::remove_pin_listener(port_id_t p, PinListener *listener) {
+  auto it = m_fanouts.find(p);
+  if (it == m_fanouts.end()) {
+    if (this->listener(p) == listener) {
+      set_pin_listener(p);
+    }
+    return;
+  }
+  auto &listeners = it->second->listeners;
+  std::erase(listeners, listener);
+  if (listeners.size() <= 1) {
+    auto *remaining = listeners.empty() ? nullptr : listeners.front();
+    set_pin_listener(p, remaining);
+    m_fanouts.erase(it);
   }
-  initialized = true;
-  terminated = false;
 }
-GPIOLibHandle::~GPIOLibHandle() { terminate(); }
 
-GPIOLibHandle::Ref GPIOLibHandle::handle{};
-
-bool GPIOLibHandle::fail_to_initialize{false};
-bool GPIOLibHandle::initialized{false};
-bool GPIOLibHandle::terminated{false};
+void MockGPIO::PinFanout::onWrite(GPIOState &state, val_t v) {
+  for (auto *l : listeners) {
+    l->onWrite(state, v);
+  }
+}
 
-void GPIOLibHandle::terminate() {
-  if (initialized && !terminated) {
-    initialized = false;
-    terminated = true;
+auto MockGPIO::PinFanout::onRead(GPIOState &state) -> val_t {
+  for (auto *l : listeners) {
+    if (l->connected()) {
+      return l->onRead(state);
+    }
   }
+  throw std::runtime_error(
+      "Reading from mocked GPIO with no connected listener");
 }
 
-void register_signal_handler(int sig, sighandler_t handler) {
-  if (::signal(sig, handler) == SIG_ERR) {
-    std::cerr << fmt::format("Warning: can't register signal handler for {}!\n",
-                             sig);
+bool MockGPIO::PinFanout::connected() const {
+  return std::any_of(listeners.begin(), listeners.end(),
+                     [](auto *l) { return l->connected(); });
+}
+
+void MockGPIO::PinFanout::onModeChange(GPIOState &state, Modes mode) {
+  for (auto *l : listeners) {
+    l->onModeChange(state, mode);
   }
 }
 
-void GPIOLibHandle::atexit_cleanup() {
-  if (auto p = weak_instance().lock(); p) {
-    p->terminate();
+void MockGPIO::PinFanout::onWait(std::chrono::microseconds d) {
+  for (auto *l : listeners) {
+    l->onWait(d);
   }
 }
-auto GPIOLibHandle::weak_instance() -> Ref { return handle; }
 
-auto GPIOLibHandle::instance() -> Ptr {
-  MockGPIO::ensure_running();
+void MockGPIO::delay(std::chrono::microseconds d) {
+  m_now += d;
+  std::for_each(m_gpios.begin(), m_gpios.end(),
+                [d](auto &e) {
+                  if (e.second.listener) {
+                    e.second.listener->onWait(d);
+                  }
+                });
+}
 
-  if (auto p = handle.lock(); p) {
-    return p;
+MockGPIO::MockGPIO(GPIOLibHandle::Ptr handle) : m_handle(std::move(handle)) {
+  if (!m_handle) {
+    throw std::invalid_argument("MockGPIO without a library handle");
   }
-  auto p = Ptr(new GPIOLibHandle{}, [](GPIOLibHandle *p) { delete p; });
-  register_signal_handler(SIGINT, catch_signals);
-  register_signal_handler(SIGTERM, catch_signals);
-  const auto regexit = std::atexit(atexit_cleanup);
-  const auto regqexit = std::at_quick_exit(atexit_cleanup);
-  if (regexit || regqexit) {
-    std::cerr << "Failed to register atexit cleanup function!\n";
+}
+
+GPIOLibHandle::GPIOLibHandle(CtorTag const &, Options options) {
+  if (options.fail_to_initialize) {
+    throw std::runtime_error("GPIO init failed");
   }
-  handle = p;
-  return p;
+  m_initialized = true;
 }
 
-void MockGPIO::ensure_running() {
-  // Don't throw if there's already an exception in-flight
-  if (s_interrupted && std::uncaught_exceptions() == 0) {
-    // reset back interrupt flag
-    s_interrupted = 0;
-    throw Interrupted{};
+GPIOLibHandle::~GPIOLibHandle() { terminate(); }
+
+void GPIOLibHandle::terminate() noexcept {
+  if (!m_terminated.exchange(true)) {
+    m_initialized = false;
   }
 }
 
+auto GPIOLibHandle::create() -> Ptr { return create(Options{}); }
+
+auto GPIOLibHandle::create(Options options) -> Ptr {
+  SignalBridge::throw_if_interrupted();
+  // like the real backends, mocked programs stop on SIGINT/SIGTERM (the
+  // handlers are taken back every time, e.g. from the test framework)
+  SignalBridge::install();
+  return std::make_shared<GPIOLibHandle>(CtorTag{}, options);
+}
+
 auto MockGPIO::get_state(port_id_t p) -> std::optional<GPIOState> {
 
   if (auto it = m_gpios.find(p); it != m_gpios.end()) {
@@ -13,9 +13,20 @@
 #include <optional>
 #include <stdexcept>
 
+StateSlots::~StateSlots() {
+  for (std::size_t slot = 0; slot < SLOT_COUNT; ++slot) {
+    reset(slot);
+  }
+}
+
+void StateSlots::reset(std::size_t slot) noexcept {
+  if (auto *state = std::exchange(m_states[slot], nullptr); state) {
+    state->~PIC18Q20StateImpl();
+  }
+}
+
 void IDLE::prog_en_rising() {
-  auto curr = std::move(m_state->prog_state);
-  m_state->prog_state = std::make_unique<PROG_EN>(m_state);
+  m_state->prog_state.emplace<PROG_EN>(m_state);
 }
 
 void PROG_EN::mclr_falling() {
@@ -26,17 +37,14 @@ void PROG_EN::mclr_falling() {
            m_state->now - m_state->last_data_change < T_ENTS)) {
     throw std::runtime_error("Timing violation");
   }
-  auto curr = std::move(m_state->prog_state);
-  m_state->prog_state = std::make_unique<MCLR>(m_state);
+  m_state->prog_state.emplace<MCLR>(m_state);
 }
 void PROG_EN::prog_en_falling() {
-  auto curr = std::move(m_state->prog_state);
-  m_state->prog_state = std::make_unique<IDLE>(m_state);
+  m_state->prog_state.emplace<IDLE>(m_state);
 }
 
 void MCLR::mclr_rising() {
-  auto curr = std::move(m_state->prog_state);
-  m_state->prog_state = std::make_unique<PROG_EN>(m_state);
+  m_state->prog_state.emplace<PROG_EN>(m_state);
 }
 void MCLR::on_data(uint32_t data) {
 
@@ -51,41 +59,38 @@ void PROGRAMMING::mclr_rising() {
     throw std::runtime_error("Programming exit hold time error");
   }
 
-  auto curr = std::move(m_state->prog_state);
-  m_state->prog_state = std::make_unique<PROG_EN>(m_state);
+  m_state->prog_state.emplace<PROG_EN>(m_state);
 }
 void PROGRAMMING::clk_rising() {
   if (m_state->now - m_state->last_clk_falling < m_ts) {
     throw std::runtime_error("Timing violation on Prog entry CLK HIGH");
   }
-  auto curr = std::move(m_state->prog_state);
-  m_state->prog_state = std::make_unique<COMMAND_PREAMBLE>(m_state);
+  m_state->prog_state.emplace<COMMAND_PREAMBLE>(m_state);
 }
 
 void COMMAND_PREAMBLE::on_data(uint32_t data) {
   const auto cmd = static_cast<uint8_t>(data);
-  auto curr = std::move(m_state->prog_state);
   switch (cmd) {
   case 0b1000'0000:
-    m_state->prog_state = std::make_unique<LOAD_PC>(m_state);
+    m_state->prog_state.emplace<LOAD_PC>(m_state);
     break;
   case 0b1111'1100:
-    m_state->prog_state = std::make_unique<READ_NVM>(m_state, false);
+    m_state->prog_state.emplace<READ_NVM>(m_state, false);
     break;
   case 0b1111'1110:
-    m_state->prog_state = std::make_unique<READ_NVM>(m_state, true);
+    m_state->prog_state.emplace<READ_NVM>(m_state, true);
     break;
   case 0b1100'0000:
-    m_state->prog_state = std::make_unique<WRITE>(m_state, false);
+    m_state->prog_state.emplace<WRITE>(m_state, false);
     break;
   case 0b1110'0000:
-    m_state->prog_state = std::make_unique<WRITE>(m_state, true);
+    m_state->prog_state.emplace<WRITE>(m_state, true);
     break;
   case 0b0001'1000:
-    m_state->prog_state = std::make_unique<BULK_ERASE>(m_state);
+    m_state->prog_state.emplace<BULK_ERASE>(m_state);
     break;
   case 0b1111'1000:
-    m_state->prog_state = std::make_unique<INC_PC>(m_state);
+    m_state->prog_state.emplace<INC_PC>(m_state);
     break;
   default:
     throw std::runtime_error("Unknown ICSP command");
@@ -102,9 +107,7 @@ void LOAD_PC::on_data(uint32_t data) {
 PIC18Q20StateImpl *
 PIC18Q20StateImpl::to_programming(std::chrono::nanoseconds setup_timeout) {
   m_state->icspdat.client_mode = IGPIO::Modes::INPUT;
-  auto curr = std::move(m_state->prog_state);
-  m_state->prog_state = std::make_unique<PROGRAMMING>(m_state, setup_timeout);
-  return m_state->prog_state.get();
+  return m_state->prog_state.emplace<PROGRAMMING>(m_state, setup_timeout);
 }
 
 READ_NVM::READ_NVM(PIC18Q20State *m_state, bool increment_pc)
@@ -179,6 +182,9 @@ void WRITE::on_data(uint32_t data) {
   to_programming(t_prog);
 }
 val_t ICSPDatPin::onRead(MockGPIO::GPIOState &st) {
+  if (!state->connected) {
+    throw std::runtime_error("Reading ICSPDAT of an isolated target");
+  }
   if (host_mode != IGPIO::Modes::INPUT && client_mode != IGPIO::Modes::OUTPUT) {
     throw std::runtime_error(
         fmt::format("Collision on ICSPDAT line  during host read "));
@@ -190,6 +196,11 @@ val_t ICSPDatPin::onRead(MockGPIO::GPIOState &st) {
   return m_value.value();
 }
 void ICSPDatPin::onWrite(MockGPIO::GPIOState &st, val_t v) {
+  if (!state->connected) {
+    // seen by the target once it is connected again
+    m_value = v;
+    return;
+  }
   if (host_mode != IGPIO::Modes::OUTPUT && client_mode != IGPIO::Modes::INPUT) {
     throw std::runtime_error("Collision on ICSPDAT line during write");
   }
@@ -209,6 +220,7 @@ void ICSPDatPin::onModeChange(MockGPIO::GPIOState &state, IGPIO::Modes mode) {
   }
 }
 void ICSPDatPin::onWait(std::chrono::microseconds d) { state->now += d; }
+bool ICSPDatPin::connected() const { return state->connected; }
 std::optional<val_t> ICSPDatPin::value() const {
   if (host_mode != IGPIO::Modes::OUTPUT && client_mode != IGPIO::Modes::INPUT) {
     throw std::runtime_error(
@@ -262,20 +274,39 @@ void INC_PC::mclr_rising() {
   prog->mclr_rising();
 }
 
+// PROG_EN connects the ICSP lines of the target to the header. While MCLR
+// keeps the target in programming mode, it only isolates the target from
+// the CLK/DATA lines (e.g. during the t_PROG of an interleaved write)
+void MockPIC18Q20::prog_en_rising() {
+  m_state->connected = true;
+  m_state->last_data_change = m_state->now;
+  if (!m_state->mclr_low) {
+    m_state->prog_state->prog_en_rising();
+  }
+}
+
+void MockPIC18Q20::prog_en_falling() {
+  m_state->connected = false;
+  if (!m_state->mclr_low) {
+    m_state->prog_state->prog_en_falling();
+  }
+}
+
 MockPIC18Q20::MockPIC18Q20(MockGPIO *gpio, ICSPPins pins)
     : gpio(std::move(gpio)), pins{pins}, clk{this}, prog(this), mclr(this),
       m_state(std::make_unique<PIC18Q20State>(this)) {
-  m_state->prog_state = std::make_unique<IDLE>(m_state.get());
-  this->gpio->set_pin_listener(pins.clk_pin, &clk);
-  this->gpio->set_pin_listener(pins.prog_en_pin.value(), &prog);
-  this->gpio->set_pin_listener(pins.mclr_pin, &mclr);
-  this->gpio->set_pin_listener(pins.data_pin, &m_state->icspdat);
+  m_state->prog_state.emplace<IDLE>(m_state.get());
+  // the control lines might be shared with other mocked targets
+  this->gpio->add_pin_listener(pins.clk_pin, &clk);
+  this->gpio->add_pin_listener(pins.prog_en_pin.value(), &prog);
+  this->gpio->add_pin_listener(pins.mclr_pin, &mclr);
+  this->gpio->add_pin_listener(pins.data_pin, &m_state->icspdat);
 }
 MockPIC18Q20::~MockPIC18Q20() {
-  this->gpio->set_pin_listener(pins.clk_pin);
-  this->gpio->set_pin_listener(pins.prog_en_pin.value());
-  this->gpio->set_pin_listener(pins.mclr_pin);
-  this->gpio->set_pin_listener(pins.data_pin);
+  this->gpio->remove_pin_listener(pins.clk_pin, &clk);
+  this->gpio->remove_pin_listener(pins.prog_en_pin.value(), &prog);
+  this->gpio->remove_pin_listener(pins.mclr_pin, &mclr);
+  this->gpio->remove_pin_listener(pins.data_pin, &m_state->icspdat);
   if (const auto outfile = std::getenv("MOCK_GPIO_OUTPUT_HEX"); outfile) {
     std::ofstream ofs(outfile);
     IntelHex::Dumper dumper(ofs);
@@ -4,32 +4,28 @@
 
 #include "PiGPIO.hpp"
 
+#include <GPIORegistry.hpp>
 #include <IGPIO.hpp>
+#include <SignalBridge.hpp>
 
-#include <csignal>
+#include <algorithm>
+#include <cstdint>
 #include <cstdlib>
 #include <exception>
 #include <fmt/format.h>
 
+#include <condition_variable>
 #include <iostream>
 #include <memory>
+#include <mutex>
 #include <pigpio.h>
 #include <stdexcept>
 
-#include <signal.h>
-
 namespace {
-volatile sig_atomic_t s_interrupted = 0;
-
-void catch_signals(int sig) {
-  s_interrupted = 1;
-  signal(sig, catch_signals);
-}
-
+const GPIOBackendRegistrar s_registrar{
+    "pigpio", [] { return std::make_shared<PiGPIO>(); }, 20};
 } // namespace
 
-auto IGPIO::Create() -> Ptr { return std::make_shared<PiGPIO>(); }
-
 unsigned int PiGPIO::translate_mode(Modes mode) {
   switch (mode) {
   case IGPIO::Modes::INPUT:
@@ -53,7 +49,6 @@ unsigned int PiGPIO::translate_mode(Modes mode) {
       fmt::format("Can't translate mode {}", static_cast<int>(mode)));
 }
 void PiGPIO::set_gpio_mode(port_id_t port, Modes mode, val_t initial) {
-  ensure_running();
   if (const auto res = gpioSetMode(port, translate_mode(mode)); res != 0) {
     const auto msg =
         fmt::format("Failed to set GPIO mode {} on port {} (error: {}) ",
@@ -65,7 +60,6 @@ void PiGPIO::set_gpio_mode(port_id_t port, Modes mode, val_t initial) {
   }
 }
 void PiGPIO::gpio_write(port_id_t gpio, val_t val) {
-  ensure_running();
   if (const auto res = gpioWrite(gpio, val); res != 0) {
     const auto msg = fmt::format("Failed to write {} on GPIO {} (error: {})",
                                  val, gpio, res);
@@ -73,7 +67,6 @@ void PiGPIO::gpio_write(port_id_t gpio, val_t val) {
   }
 }
 IGPIO::val_t PiGPIO::gpio_read(port_id_t gpio) {
-  ensure_running();
   if (const auto res = gpioRead(gpio); res == PI_BAD_GPIO) {
     const auto msg =
         fmt::format("Failed to read on GPIO {} (error: {})", gpio, res);
@@ -82,15 +75,79 @@ IGPIO::val_t PiGPIO::gpio_read(port_id_t gpio) {
     return res;
   }
 }
+namespace {
+// the bank operations cover GPIO 0-31
+bool in_bank0(std::span<const IGPIO::port_id_t> ports) {
+  return std::all_of(ports.begin(), ports.end(),
+                     [](auto port) { return port < 32; });
+}
+} // namespace
+
+void PiGPIO::gpio_write_many(std::span<const port_id_t> ports,
+                             std::span<const val_t> vals) {
+  if (!in_bank0(ports)) {
+    IGPIO::gpio_write_many(ports, vals);
+    return;
+  }
+  std::uint32_t set{}, clear{};
+  for (std::size_t i = 0; i < ports.size(); ++i) {
+    (vals[i] ? set : clear) |= 1U << ports[i];
+  }
+  if (set != 0 && gpioWrite_Bits_0_31_Set(set) != 0) {
+    throw std::runtime_error(
+        fmt::format("Failed to set GPIO bits 0x{:08x}", set));
+  }
+  if (clear != 0 && gpioWrite_Bits_0_31_Clear(clear) != 0) {
+    throw std::runtime_error(
+        fmt::format("Failed to clear GPIO bits 0x{:08x}", clear));
+  }
+}
+
+void PiGPIO::gpio_read_many(std::span<const port_id_t> ports,
+                            std::span<val_t> vals) {
+  if (!in_bank0(ports)) {
+    IGPIO::gpio_read_many(ports, vals);
+    return;
+  }
+  const auto bits = gpioRead_Bits_0_31();
+  for (std::size_t i = 0; i < ports.size(); ++i) {
+    vals[i] = (bits >> ports[i]) & 1U;
+  }
+}
+
 void PiGPIO::delay(std::chrono::microseconds d) {
-  ensure_running();
   gpioDelay(d.count());
 }
 
+auto PiGPIO::capabilities() const -> Capabilities {
+  // the bank registers can be written directly (gpioWrite_Bits_*)
+  return Capabilities{.batching = false, .multi_pin_write = true};
+}
+
 PiGPIO::PiGPIO() : m_handle(GPIOLibHandle::instance()) {}
 
+namespace {
+// The process wide state behind GPIOLibHandle::instance()
+struct LibState {
+  // recursive: the last handle can be released while instance() holds it
+  // (e.g. when the setup after the initialization throws)
+  std::recursive_mutex mutex;
+  GPIOLibHandle::Ref handle;
+  // the handle isn't deleted yet: `handle` expires with the last reference,
+  // before the deleter gets the lock and terminates the library
+  bool live{};
+  std::condition_variable_any deleted;
+  std::once_flag atexit_registered;
+};
+
+LibState &lib_state() {
+  static LibState state;
+  return state;
+}
+} // namespace
+
 GPIOLibHandle::GPIOLibHandle() {
-  PiGPIO::ensure_running();
+  SignalBridge::throw_if_interrupted();
   // This is needed as the PCM clock interferes with the I2S audio
   // TODO: make this configurable for more versatile use cases
   if (gpioCfgClock(5, PI_CLOCK_PWM, 0) < 0) {
@@ -99,60 +156,57 @@ GPIOLibHandle::GPIOLibHandle() {
   if (gpioInitialise() < 0) {
     throw std::runtime_error("Failed to initialize GPIO library");
   }
-  initialized = true;
-  terminated = false;
 }
 
-bool GPIOLibHandle::initialized{false};
-bool GPIOLibHandle::terminated{false};
-
-void GPIOLibHandle::terminate() {
-  if (initialized && !terminated) {
+void GPIOLibHandle::terminate() noexcept {
+  if (!m_terminated.exchange(true)) {
     gpioTerminate();
-    initialized = false;
-    terminated = true;
   }
 }
 
 GPIOLibHandle::~GPIOLibHandle() { terminate(); }
 
-GPIOLibHandle::Ref GPIOLibHandle::handle{};
-
-void register_signal_handler(int sig, sighandler_t handler) {
-  if (::signal(sig, handler) == SIG_ERR) {
-    std::cerr << fmt::format("Warning: can't register signal handler for {}!\n",
-                             sig);
-  }
-}
-
 void GPIOLibHandle::atexit_cleanup() {
   if (auto p = weak_instance().lock(); p) {
     p->terminate();
   }
 }
 
-auto GPIOLibHandle::weak_instance() -> Ref { return handle; }
+auto GPIOLibHandle::weak_instance() -> Ref {
+  auto &state = lib_state();
+  std::lock_guard lock{state.mutex};
+  return state.handle;
+}
+
 auto GPIOLibHandle::instance() -> Ptr {
-  PiGPIO::ensure_running();
+  SignalBridge::throw_if_interrupted();
 
-  if (auto p = handle.lock(); p) {
+  auto &state = lib_state();
+  // held while (re)initializing, so the library is initialized once even if
+  // several sessions start at the same time
+  std::unique_lock lock{state.mutex};
+  if (auto p = state.handle.lock(); p) {
     return p;
   }
-  auto p = Ptr(new GPIOLibHandle{}, [](GPIOLibHandle *p) { delete p; });
-  register_signal_handler(SIGINT, catch_signals);
-  register_signal_handler(SIGTERM, catch_signals);
-  const auto regexit = std::atexit(atexit_cleanup);
-  const auto regqexit = std::at_quick_exit(atexit_cleanup);
-  if (regexit || regqexit) {
-    std::cerr << "Failed to register atexit cleanup function!\n";
-  }
-  handle = p;
+  // a new instance isn't initialized before the previous one is terminated
+  state.deleted.wait(lock, [&state] { return !state.live; });
+  auto p = Ptr(new GPIOLibHandle{}, [](GPIOLibHandle *p) {
+    auto &state = lib_state();
+    std::lock_guard lock{state.mutex};
+    delete p;
+    state.live = false;
+    state.deleted.notify_all();
+  });
+  state.live = true;
+  // gpioInitialise() installs its own handlers, take them back
+  SignalBridge::install();
+  std::call_once(state.atexit_registered, [] {
+    const auto regexit = std::atexit(atexit_cleanup);
+    const auto regqexit = std::at_quick_exit(atexit_cleanup);
+    if (regexit || regqexit) {
+      std::cerr << "Failed to register atexit cleanup function!\n";
+    }
+  });
+  state.handle = p;
   return p;
 }
-
-void PiGPIO::ensure_running() {
-  // Don't throw if there's already an exception in-flight
-  if (s_interrupted && std::uncaught_exceptions() == 0) {
-    throw Interrupted{};
-  }
-}
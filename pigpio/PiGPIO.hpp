@@ -6,9 +6,14 @@
 
 #include <IGPIO.hpp>
 
+#include <atomic>
 #include <memory>
 #include <pigpio.h>
 
+// Reference counted context of the pigpio library. The library itself is
+// process wide (one gpioInitialise()/gpioTerminate() pair), so every PiGPIO
+// shares one context, it's terminated with the last reference (or at exit).
+// instance() and weak_instance() are thread-safe.
 class GPIOLibHandle {
 private:
   struct CtorTag {};
@@ -20,33 +25,42 @@ public:
   static Ref weak_instance();
 
   GPIOLibHandle(CtorTag const &) : GPIOLibHandle() {}
+  GPIOLibHandle(const GPIOLibHandle &) = delete;
+  GPIOLibHandle &operator=(const GPIOLibHandle &) = delete;
+
+  bool is_terminated() const noexcept {
+    return m_terminated.load(std::memory_order_relaxed);
+  }
 
 private:
-  void terminate();
+  void terminate() noexcept;
   static void atexit_cleanup();
 
-  static Ref handle;
-  static bool initialized;
-  static bool terminated;
+  std::atomic<bool> m_terminated{false};
 
   GPIOLibHandle();
   ~GPIOLibHandle();
 };
 
-struct PiGPIO : public IGPIO {
+struct PiGPIO final : public IGPIO {
 
   PiGPIO();
 
   static unsigned int translate_mode(Modes mode);
-  static void ensure_running();
 
   void set_gpio_mode(port_id_t port, Modes mode, val_t initial) override;
 
   void gpio_write(port_id_t gpio, val_t val) override;
 
   val_t gpio_read(port_id_t gpio) override;
+  void gpio_write_many(std::span<const port_id_t> ports,
+                       std::span<const val_t> vals) override;
+  void gpio_read_many(std::span<const port_id_t> ports,
+                      std::span<val_t> vals) override;
   void delay(std::chrono::microseconds) override;
 
+  Capabilities capabilities() const override;
+
 private:
   GPIOLibHandle::Ptr m_handle;
 };
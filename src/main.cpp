@@ -3,6 +3,7 @@
 // <attila.gombos@effective-range.com> SPDX-License-Identifier: MIT
 
 #include <iostream>
+#include <optional>
 #include <ostream>
 
 #include <er/hwinfo.hpp>
@@ -34,10 +35,16 @@ int main(int argc, char *argv[]) try {
                       hwdb_path / "hwdb-schema.json"); // initialize hwinfo
   auto fw = get_fw_file(parser);
   const auto extra_erease = extra_erease_regions(parser);
+  if (const auto headers = header_pins(parser); !headers.empty()) {
+    execMultiHeader(parser, fw, extra_erease, headers);
+    return 0;
+  }
   const auto pins = icsp_pins(info, parser);
+  std::optional<RealtimeSession> realtime;
+  start_realtime(realtime, parser, fw);
 
   if (parser["--info"] == true) {
-    emitInfo(fw, pins);
+    emitInfo(parser, fw, pins);
     return 0;
   } else if (parser["--dump"] == true) {
     execDump(parser, fw, pins);
@@ -48,7 +55,7 @@ int main(int argc, char *argv[]) try {
   }
 
   if (extra_erease != Address::Region::INVALID) {
-    execErase(extra_erease, pins);
+    execErase(parser, extra_erease, pins);
     return 0;
   }
 
@@ -5,22 +5,39 @@
 #include "prog_utils.hpp"
 
 #include <fstream>
+#include <iostream>
+
+#include <fmt/ranges.h>
 
 #include <argparse/argparse.hpp>
 
 #include "ICSP_pins.hpp"
 #include "PICProgrammer.hpp"
+#include <ICSPWorker.hpp>
 #include <ICSP_header.hpp>
+#include <GPIORegistry.hpp>
 #include <IGPIO.hpp>
+#include <ElfFile.hpp>
+#include <FirmwareCache.hpp>
+#include <FlatImage.hpp>
+#include <Gzip.hpp>
 #include <IntelHex.hpp>
+#include <MultiHeaderProgrammer.hpp>
 #include <PIC18-Q20.hpp>
+#include <Progress.hpp>
+#include <RawImage.hpp>
+#include <Realtime.hpp>
 #include <Region.hpp>
+#include <ShadowGPIO.hpp>
+#include <algorithm>
 #include <memory>
 #include <range/v3/numeric/accumulate.hpp>
 #include <range/v3/view/transform.hpp>
 #include <stdexcept>
 #include <utils.hpp>
 
+#include <unistd.h>
+
 void print_device_info(std::ostream &os, DeviceId const &id, DCI const &dci,
                        DIA const &dia) {
   os << fmt::format("Device Id: 0x{:04x} ({})\n"
@@ -106,7 +123,8 @@ std::unique_ptr<AugmentedParser> get_parser() {
       .help("base address (either in decimal or hexadecimal format) ");
 
   address_group.add_argument("-f", "--file")
-      .help("input/output firmware file (either in Intel Hex of ELF format)");
+      .help("input/output firmware file (either in Intel Hex of ELF format), "
+            "'-' reads the standard input");
 
   program->add_argument("-c", "--content")
       .help("Content to write, either a hex "
@@ -114,6 +132,18 @@ std::unique_ptr<AugmentedParser> get_parser() {
             "one section must be specified, if content is not integral "
             "multiple of word size, it will be padded with 0xFF bytes");
 
+  program->add_argument("--cache-dir")
+      .help("directory of the parsed firmware cache")
+      .default_value(FirmwareCache::default_dir().string());
+
+  program->add_argument("--no-cache")
+      .help("always parse the firmware file, don't use or fill the cache")
+      .flag();
+
+  program->add_argument("-z", "--gzip")
+      .help("compress the dump output with gzip")
+      .flag();
+
   program->add_argument("-e", "--erase")
       .default_value<std::vector<std::string>>({})
       .append()
@@ -144,6 +174,14 @@ std::unique_ptr<AugmentedParser> get_parser() {
       .help("GPIO pin number to be used for the ICSP DATA line")
       .scan<'i', unsigned>();
 
+  program->add_argument("--gpio-gang-data")
+      .help("GPIO pin number of the DATA line of a further target in gang mode "
+            "(can be repeated), the targets share the CLK, MCLR and PROG EN "
+            "lines and are programmed together")
+      .default_value<std::vector<unsigned>>({})
+      .append()
+      .scan<'i', unsigned>();
+
   program->add_argument("--gpio-mclr")
       .help("GPIO pin number to be used for the ICSP MCLR line")
       .scan<'i', unsigned>();
@@ -160,6 +198,38 @@ std::unique_ptr<AugmentedParser> get_parser() {
       .flag()
       .default_value(false);
 
+  program->add_argument("--icsp-header")
+      .help("pins of an ICSP header as CLK,DATA,MCLR[,PROG_EN] (can be "
+            "repeated), the targets of the headers are written/erased in "
+            "parallel, the single header pin options are ignored")
+      .default_value<std::vector<std::string>>({})
+      .append();
+
+  program->add_argument("--gpio-backend")
+      .help(fmt::format("GPIO backend to be used, one of: {}, {} (probes the "
+                        "available hardware backends and picks the fastest)",
+                        fmt::join(GPIORegistry::instance().names(), ", "),
+                        GPIORegistry::AUTO))
+      .default_value(std::string{GPIORegistry::AUTO});
+
+  program->add_argument("--realtime")
+      .flag()
+      .help("run the programming session with real-time scheduling, pinned to "
+            "a CPU, with locked memory and low CPU latency (needs privileges, "
+            "unavailable settings are skipped with a warning, not with "
+            "--icsp-header)");
+
+  program->add_argument("--realtime-cpu")
+      .help("CPU to pin the programming thread to in --realtime mode (default: "
+            "first isolated CPU)")
+      .scan<'i', unsigned>();
+
+  program->add_argument("--io-thread")
+      .flag()
+      .help("drive the ICSP lines from a dedicated thread while writing, "
+            "the data is prepared in parallel (--realtime applies to that "
+            "thread)");
+
   auto &format_group = program->add_mutually_exclusive_group();
 
   format_group.add_argument("--hex").flag().help(
@@ -167,6 +237,9 @@ std::unique_ptr<AugmentedParser> get_parser() {
       "is in hex format");
   format_group.add_argument("--elf").flag().help(
       "use elf format for the firmware data");
+  format_group.add_argument("--image").flag().help(
+      "use the raw binary image format (per region header with CRC) for the "
+      "firmware data");
 
   format_group.add_argument("-b", "--binary")
       .flag()
@@ -174,6 +247,19 @@ std::unique_ptr<AugmentedParser> get_parser() {
   return std::move(parser);
 }
 
+namespace {
+// Redundant line writes (e.g. unchanged DATA bits) are elided by the shadow
+// layer, the protocol on the wire stays the same
+// The auto backend selection probes the latency on the CLK line, which is
+// left in its idle (OUTPUT/low) state afterwards
+IGPIO::Ptr make_gpio(argparse::ArgumentParser const &args,
+                     ICSPPins const &pins) {
+  const auto backend = args.get<std::string>("--gpio-backend");
+  return std::make_shared<ShadowGPIO>(
+      GPIORegistry::instance().create(backend, pins.clk_pin));
+}
+} // namespace
+
 void dump_sections(IDumper &dumper, ICSPHeader &icsp,
                    std::vector<std::string> const &sections) {
   auto prog = icsp.enter_programming();
@@ -191,23 +277,87 @@ void dump_sections(IDumper &dumper, ICSPHeader &icsp,
   dumper.dump_end();
 }
 
-std::pair<fs::path, Firmware>
-process_input_file(argparse::ArgumentParser &parser) {
+namespace {
+enum class FileFormat { HEX, ELF, IMAGE };
+
+FileFormat input_format(argparse::ArgumentParser const &parser) {
   if (parser["--hex"] == true) {
-    fs::path inputfile = (parser.get<std::string>("-f"));
-
-    if (const auto exists = fs::exists(inputfile);
-        !exists || !fs::is_regular_file(inputfile)) {
-      throw fs::filesystem_error(
-          "Input firmware file non-existent or not a file",
-          std::make_error_code(!exists ? std::errc::no_such_file_or_directory
-                                       : std::errc::is_a_directory));
-    }
-    std::ifstream ifs(inputfile);
-    return {inputfile, IntelHex::parse_hex_file(pic18fq20, ifs)};
+    return FileFormat::HEX;
+  } else if (parser["--elf"] == true) {
+    return FileFormat::ELF;
+  } else if (parser["--image"] == true) {
+    return FileFormat::IMAGE;
   }
   throw std::runtime_error("Input file format not supported yet.");
 }
+
+Firmware parse_stream(FileFormat format, std::istream &is) {
+  // inflated chunk by chunk as the parser reads it
+  if (Gzip::is_gzip(is)) {
+    Gzip::IStream inflated(is);
+    return parse_stream(format, inflated);
+  }
+  switch (format) {
+  case FileFormat::HEX:
+    return IntelHex::parse_hex_file(pic18fq20, is);
+  case FileFormat::ELF:
+    return Elf::parse_elf_stream(pic18fq20, is);
+  case FileFormat::IMAGE:
+    return RawImage::parse_image_stream(pic18fq20, is);
+  }
+  throw std::logic_error("Unhandled file format");
+}
+
+bool is_gzip_file(fs::path const &path) {
+  std::ifstream is(path, std::ios::binary);
+  return Gzip::is_gzip(is);
+}
+} // namespace
+
+std::pair<fs::path, std::shared_ptr<const Firmware>>
+process_input_file(argparse::ArgumentParser &parser) {
+  const auto format = input_format(parser);
+  fs::path inputfile = (parser.get<std::string>("-f"));
+  // "-" streams the firmware from the standard input
+  if (inputfile == "-") {
+    return {inputfile,
+            std::make_shared<const Firmware>(parse_stream(format, std::cin))};
+  }
+  const auto status = fs::status(inputfile);
+  if (const auto exists = fs::exists(status);
+      !exists || !(fs::is_regular_file(status) || fs::is_fifo(status) ||
+                   fs::is_character_file(status))) {
+    throw fs::filesystem_error(
+        "Input firmware file non-existent or not a file",
+        std::make_error_code(!exists ? std::errc::no_such_file_or_directory
+                                     : std::errc::is_a_directory));
+  }
+  // pipes are opened once, compressed files aren't mapped nor cached
+  if (!fs::is_regular_file(status) || is_gzip_file(inputfile)) {
+    std::ifstream is(inputfile, std::ios::binary);
+    if (!is) {
+      throw std::runtime_error(
+          fmt::format("Can't open the firmware file {}", inputfile.string()));
+    }
+    return {inputfile,
+            std::make_shared<const Firmware>(parse_stream(format, is))};
+  }
+  // the binary formats are copied straight from the mapping, not cached
+  if (format == FileFormat::ELF) {
+    return {inputfile, std::make_shared<const Firmware>(
+                           Elf::load_elf_file(pic18fq20, inputfile))};
+  } else if (format == FileFormat::IMAGE) {
+    return {inputfile, std::make_shared<const Firmware>(
+                           RawImage::load_image_file(pic18fq20, inputfile))};
+  }
+  if (parser["--no-cache"] == true) {
+    return {inputfile, std::make_shared<const Firmware>(
+                           IntelHex::load_hex_file(pic18fq20, inputfile))};
+  }
+  const FirmwareCache cache({.dir = parser.get<std::string>("--cache-dir")});
+  return {inputfile, std::make_shared<const Firmware>(
+                         load_hex_file(pic18fq20, inputfile, cache))};
+}
 void print_fwfile_info(fs::path p, Firmware const &fw) {
   std::cout << fmt::format("Info from firmware file : {}\n", p.string());
   std::cout << fmt::format("  Number of regions: {}\n", fw.size());
@@ -239,12 +389,89 @@ Address::Region extra_erease_regions(argparse::ArgumentParser const &parser) {
   return extra;
 }
 
-void emitInfo(FWFileDescr const &fw, ICSPPins const &pins) {
+namespace {
+std::optional<RealtimeSession::Options>
+realtime_options(argparse::ArgumentParser const &parser) {
+  if (parser["--realtime"] != true) {
+    return std::nullopt;
+  }
+  return RealtimeSession::Options{
+      .cpu = parser.present<unsigned>("--realtime-cpu")};
+}
+
+void print_warnings(std::vector<std::string> const &warnings) {
+  for (const auto &warning : warnings) {
+    std::cerr << fmt::format("Warning: {}\n", warning);
+  }
+}
+
+bool io_thread(argparse::ArgumentParser const &parser) {
+  return parser["--io-thread"] == true && parser["--write"] == true;
+}
+
+// e.g. [##########----------]  50%    12.3 KiB/s ETA 00:07
+void print_progress(std::ostream &os, ProgressSnapshot const &progress) {
+  constexpr std::size_t WIDTH = 30;
+  // the done bytes can exceed the total (e.g. retried words)
+  const auto fraction = std::clamp(progress.fraction(), 0.0, 1.0);
+  const auto filled = static_cast<std::size_t>(fraction * WIDTH);
+  std::string eta = "--:--";
+  if (progress.eta) {
+    const auto secs =
+        std::chrono::ceil<std::chrono::seconds>(*progress.eta).count();
+    eta = fmt::format("{:02}:{:02}", secs / 60, secs % 60);
+  }
+  os << fmt::format("\r[{}{}] {:3.0f}% {:8.1f} KiB/s ETA {}",
+                    std::string(filled, '#'), std::string(WIDTH - filled, '-'),
+                    fraction * 100, progress.rate / 1024, eta)
+     << std::flush;
+}
+
+// The progress bar is only shown on terminals
+void start_progress(std::optional<ProgressReporter> &progress,
+                    argparse::ArgumentParser const &parser, std::size_t total) {
+  if (parser["quiet"] == true || ::isatty(STDERR_FILENO) == 0) {
+    return;
+  }
+  progress.emplace(total, [](ProgressSnapshot const &snapshot) {
+    print_progress(std::cerr, snapshot);
+  });
+}
+
+void finish_progress(std::optional<ProgressReporter> &progress) {
+  if (progress) {
+    progress->finish();
+    std::cerr << '\n';
+  }
+}
+} // namespace
+
+void start_realtime(std::optional<RealtimeSession> &session,
+                    argparse::ArgumentParser const &parser,
+                    FWFileDescr const &fw) {
+  const auto options = realtime_options(parser);
+  // with a separate I/O thread only that one needs real-time treatment
+  if (!options || io_thread(parser)) {
+    return;
+  }
+  session.emplace(*options);
+  print_warnings(session->warnings());
+  if (fw) {
+    for (const auto &region : *fw->second) {
+      for (const auto &elem : region.elems) {
+        RealtimeSession::prefault(elem.data.data(), elem.data.size());
+      }
+    }
+  }
+}
+
+void emitInfo(argparse::ArgumentParser const &args, FWFileDescr const &fw,
+              ICSPPins const &pins) {
   if (fw) {
     const auto &[path, fwdata] = *fw;
-    print_fwfile_info(path, fwdata);
+    print_fwfile_info(path, *fwdata);
   } else {
-    auto icsp = ICSPHeader(IGPIO::Create(), pins);
+    auto icsp = ICSPHeader(make_gpio(args, pins), pins);
     PICProgrammer programmer(pic18fq20, icsp, icsp.enter_programming());
     const auto devid = programmer.read_device_id();
     const auto dci = programmer.read_dci();
@@ -254,14 +481,30 @@ void emitInfo(FWFileDescr const &fw, ICSPPins const &pins) {
 }
 void execWrite(argparse::ArgumentParser const &args, FWFileDescr const &fw,
                Address::Region extra_erease, ICSPPins const &pins) {
-  auto icsp = ICSPHeader(IGPIO::Create(), pins);
-  auto programmer = PICProgrammer{pic18fq20, icsp};
-  programmer.program_verify(fw.value().second, extra_erease);
+  auto icsp = ICSPHeader(make_gpio(args, pins), pins);
+  // only the non-blank words are programmed, the progress counts those
+  const FlatImage image{pic18fq20, *fw.value().second};
+  std::optional<ProgressReporter> progress;
+  start_progress(progress, args, image.program_size());
+  finally end_progress{[&progress] { finish_progress(progress); }};
+  IProgressListener *listener = progress ? &*progress : nullptr;
+  if (io_thread(args)) {
+    if (!pins.gang_data_pins.empty()) {
+      throw std::runtime_error("--io-thread is not supported in gang mode");
+    }
+    ICSPWorker worker(icsp, {.realtime = realtime_options(args)});
+    print_warnings(worker.realtime_warnings());
+    auto programmer = PICProgrammer{pic18fq20, worker};
+    programmer.program_verify(image, extra_erease, listener);
+  } else {
+    auto programmer = PICProgrammer{pic18fq20, icsp};
+    programmer.program_verify(image, extra_erease, listener);
+  }
 }
 
 void execDump(argparse::ArgumentParser const &args, FWFileDescr const &fw,
               ICSPPins const &pins) {
-  auto icsp = ICSPHeader(IGPIO::Create(), pins);
+  auto icsp = ICSPHeader(make_gpio(args, pins), pins);
   // TODO: use fw file if specified
   const auto hexformat = args["hex"] == true;
   const auto elfformat = args["elf"] == true;
@@ -272,18 +515,93 @@ void execDump(argparse::ArgumentParser const &args, FWFileDescr const &fw,
   if (quiet && !tofile) {
     throw std::logic_error("quiet mode with no output file");
   }
+  if (elfformat) {
+    throw std::runtime_error("Dump format not implemented");
+  }
+  // compressed as it's written, any of the dumpers can write through it
+  std::optional<Gzip::OStream> gzip;
+  if (args["--gzip"] == true) {
+    gzip.emplace(std::cout);
+  }
+  std::ostream &os = gzip ? *gzip : std::cout;
   if (args["hex"] == true) {
-    IntelHex::Dumper dumper(std::cout);
+    IntelHex::Dumper dumper(os);
     dump_sections(dumper, icsp, sections);
-  } else if (!elfformat) {
-    OstreamDumper dumper(std::cout);
+  } else if (args["image"] == true) {
+    RawImage::Dumper dumper(os);
     dump_sections(dumper, icsp, sections);
   } else {
-    throw std::runtime_error("Dump format not implemented");
+    OstreamDumper dumper(os);
+    dump_sections(dumper, icsp, sections);
+  }
+  if (gzip) {
+    gzip->finish();
   }
 }
 
-void execErase(const Address::Region &extra_erease, ICSPPins const &pins) {
-  auto icsp = ICSPHeader(IGPIO::Create(), pins);
+void execErase(argparse::ArgumentParser const &args,
+               const Address::Region &extra_erease, ICSPPins const &pins) {
+  auto icsp = ICSPHeader(make_gpio(args, pins), pins);
   icsp.bulk_erase(extra_erease);
+}
+
+void execMultiHeader(argparse::ArgumentParser const &args,
+                     FWFileDescr const &fw, Address::Region extra_erease,
+                     std::vector<ICSPPins> const &headers) {
+  // one real-time CPU can't serve the parallel header threads
+  if (realtime_options(args)) {
+    throw std::runtime_error(
+        "--realtime is not supported with several ICSP headers");
+  }
+  HeaderJob job{};
+  if (args["--write"] == true) {
+    if (!fw) {
+      throw std::runtime_error("No firmware file to write");
+    }
+    job.operation = JobOperation::WRITE;
+    job.firmware = fw->second;
+    job.name = fw->first.filename().string();
+  } else if (extra_erease != Address::Region::INVALID) {
+    job.operation = JobOperation::ERASE;
+    job.name = "erase";
+  } else {
+    throw std::runtime_error(
+        "Only writing and erasing is supported with several ICSP headers");
+  }
+  job.erase = extra_erease;
+
+  // every header gets its own backend instance (and line requests)
+  MultiHeaderProgrammer programmer(
+      pic18fq20, headers,
+      [&args](ICSPPins const &pins) { return make_gpio(args, pins); });
+  for (std::size_t i = 0; i < headers.size(); ++i) {
+    job.header = i;
+    programmer.submit(job);
+  }
+  const auto report = programmer.wait();
+
+  for (const auto &result : report.results) {
+    const auto &pins = headers[result.header];
+    std::string status = "OK";
+    if (!result.ok()) {
+      try {
+        std::rethrow_exception(result.error);
+      } catch (const std::exception &e) {
+        status = fmt::format("FAILED: {}", e.what());
+      }
+    }
+    std::cout << fmt::format(
+        "header {} (CLK {}, DATA {}, MCLR {}) {}: {} in {:.2f} s\n",
+        result.header, pins.clk_pin, pins.data_pin, pins.mclr_pin,
+        result.name, status,
+        std::chrono::duration<double>(result.elapsed).count());
+  }
+  const auto failed = report.failed();
+  std::cout << fmt::format(
+      "{} of {} headers succeeded in {:.2f} s\n", headers.size() - failed,
+      headers.size(), std::chrono::duration<double>(report.elapsed).count());
+  if (failed != 0) {
+    throw std::runtime_error(
+        fmt::format("{} of {} headers failed", failed, headers.size()));
+  }
 }
\ No newline at end of file
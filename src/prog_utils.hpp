@@ -8,6 +8,7 @@
 #include "Region.hpp"
 #include "argparse/argparse.hpp"
 #include <PICProgrammer.hpp>
+#include <Realtime.hpp>
 
 #include <argparse/argparse.hpp>
 #include <concepts>
@@ -15,10 +16,13 @@
 
 #include <er/hwinfo.hpp>
 
+#include <charconv>
 #include <filesystem>
 #include <iosfwd>
 #include <memory>
 #include <optional>
+#include <string_view>
+#include <vector>
 
 enum class Verbosity { ERROR = 0, INFO = 1, DEBUG = 2, MAX = DEBUG };
 
@@ -81,11 +85,59 @@ inline auto icsp_pins(std::optional<er::hwinfo::info> const &info,
           ? std::nullopt
           : std::make_optional(resolve_pin(info, parser, "--gpio-prog-en",
                                            icsp_pin_names::PROG_EN));
+  pins.gang_data_pins = parser.get<std::vector<unsigned>>("--gpio-gang-data");
   return pins;
 }
 
+/// @brief Parse the pin set of an --icsp-header option
+/// @param spec GPIO pin numbers in CLK,DATA,MCLR[,PROG_EN] order
+/// @return ICSPPins without PROG_EN if it is not given
+/// @throws std::runtime_error if the pin set is malformed
+inline ICSPPins parse_header_pins(std::string_view spec) {
+  std::vector<unsigned> nums;
+  for (auto rest = spec; !rest.empty();) {
+    const auto comma = rest.find(',');
+    const auto num = rest.substr(0, comma);
+    unsigned val{};
+    const auto [end, ec] =
+        std::from_chars(num.data(), num.data() + num.size(), val);
+    if (ec != std::errc{} || end != num.data() + num.size()) {
+      throw std::runtime_error(fmt::format(
+          "Invalid pin number '{}' in ICSP header '{}'", num, spec));
+    }
+    nums.push_back(val);
+    rest = comma == std::string_view::npos ? std::string_view{}
+                                           : rest.substr(comma + 1);
+  }
+  if (nums.size() != 3 && nums.size() != 4) {
+    throw std::runtime_error(fmt::format(
+        "ICSP header '{}' should be CLK,DATA,MCLR[,PROG_EN]", spec));
+  }
+  ICSPPins pins{};
+  pins.clk_pin = nums[0];
+  pins.data_pin = nums[1];
+  pins.mclr_pin = nums[2];
+  pins.prog_en_pin =
+      nums.size() == 4 ? std::make_optional(nums[3]) : std::nullopt;
+  return pins;
+}
+
+/// @brief The ICSP headers of the multi-header mode
+/// @return empty if no --icsp-header option is given
+inline std::vector<ICSPPins>
+header_pins(argparse::ArgumentParser const &parser) {
+  std::vector<ICSPPins> res;
+  for (const auto &spec :
+       parser.get<std::vector<std::string>>("--icsp-header")) {
+    res.push_back(parse_header_pins(spec));
+  }
+  return res;
+}
+
 namespace fs = std::filesystem;
-using FWFileDescr = std::optional<std::pair<fs::path, Firmware>>;
+// shared with the jobs of the programmers (e.g. MultiHeaderProgrammer)
+using FWFileDescr =
+    std::optional<std::pair<fs::path, std::shared_ptr<const Firmware>>>;
 
 struct AugmentedParser {
   argparse::ArgumentParser parser;
@@ -120,7 +172,7 @@ void dump_regions(IDumper &dumper, ICSPHeader::ExitProg &prog,
 void dump_sections(std::ostream &os, ICSPHeader &icsp,
                    std::vector<std::string> const &sections);
 
-std::pair<fs::path, Firmware>
+std::pair<fs::path, std::shared_ptr<const Firmware>>
 process_input_file(argparse::ArgumentParser &parser);
 
 FWFileDescr get_fw_file(argparse::ArgumentParser &parser);
@@ -140,7 +192,14 @@ template <typename Rng> auto format_uid(Rng &&rng) {
 
 Address::Region extra_erease_regions(argparse::ArgumentParser const &parser);
 
-void emitInfo(FWFileDescr const &fw, ICSPPins const &);
+// Enters real-time mode if requested on the command line, the session lasts
+// until the passed object is destroyed
+void start_realtime(std::optional<RealtimeSession> &session,
+                    argparse::ArgumentParser const &parser,
+                    FWFileDescr const &fw);
+
+void emitInfo(argparse::ArgumentParser const &, FWFileDescr const &fw,
+              ICSPPins const &);
 
 void execWrite(argparse::ArgumentParser const &, FWFileDescr const &fw,
                Address::Region extra_erease, ICSPPins const &);
@@ -148,4 +207,10 @@ void execWrite(argparse::ArgumentParser const &, FWFileDescr const &fw,
 void execDump(argparse::ArgumentParser const &, FWFileDescr const &fw,
               ICSPPins const &);
 
-void execErase(const Address::Region &extra_erease, ICSPPins const &);
\ No newline at end of file
+void execErase(argparse::ArgumentParser const &,
+               const Address::Region &extra_erease, ICSPPins const &);
+
+// Writes or erases the targets of several ICSP headers in parallel
+void execMultiHeader(argparse::ArgumentParser const &, FWFileDescr const &fw,
+                     Address::Region extra_erease,
+                     std::vector<ICSPPins> const &headers);
\ No newline at end of file
@@ -0,0 +1,55 @@
+#include <catch2/catch_all.hpp>
+
+#include <ICSP_header.hpp>
+#include <IGPIO.hpp>
+#include <MockGPIO.hpp>
+#include <NullGPIO.hpp>
+
+#include "test_utils.hpp"
+
+#include <memory>
+
+// Host side overhead of the protocol implementation, the virtual ICSPHeader
+// against the statically dispatched BasicICSPHeader on the same backend.
+// A load_pc transaction is 32 bits, a read transaction is 32 bits as well
+// (8 bit command + 24 bit payload), divide by 32 for the per-bit cost.
+// Run with: icsp_test "[!benchmark]"
+
+namespace {
+template <typename Header> void bench_header(Header &icsp, const char *name) {
+  BENCHMARK(fmt::format("{}: load_pc", name)) {
+    icsp.load_pc(0x100);
+    return icsp.programming();
+  };
+  BENCHMARK(fmt::format("{}: read", name)) {
+    return icsp.read_raw(false);
+  };
+}
+} // namespace
+
+TEST_CASE("Null backend per-bit overhead", "[!benchmark][ICSP]") {
+  auto gpio = std::make_shared<NullGPIO>();
+  {
+    auto icsp = ICSPHeader(gpio);
+    bench_header(icsp, "null, virtual");
+  }
+  {
+    auto icsp = BasicICSPHeader<NullGPIO>(gpio);
+    bench_header(icsp, "null, static");
+  }
+}
+
+TEST_CASE("Mock backend per-bit overhead", "[!benchmark][ICSP]") {
+  {
+    auto objs = setup();
+    auto icsp = ICSPHeader(objs.gpio);
+    auto prog = icsp.enter_programming();
+    bench_header(icsp, "mock, virtual");
+  }
+  {
+    auto objs = setup();
+    auto icsp = BasicICSPHeader<MockGPIO>(objs.gpio);
+    auto prog = icsp.enter_programming();
+    bench_header(icsp, "mock, static");
+  }
+}
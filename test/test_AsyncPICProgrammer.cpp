@@ -0,0 +1,84 @@
+#include <catch2/catch_all.hpp>
+
+#include <AsyncPICProgrammer.hpp>
+#include <ICSP_header.hpp>
+#include <PIC18-Q20.hpp>
+
+#include "FimwareFile.hpp"
+#include "test_utils.hpp"
+
+#include <cstdint>
+#include <stop_token>
+#include <vector>
+
+namespace {
+Firmware test_firmware() {
+  Firmware fw;
+  auto &prog = fw.emplace_back(pic18q20map::program_region_v);
+  prog.elems.assign({FirmwareFileRegionElem{0, {0xDE, 0xAD, 0xBE, 0xEF}},
+                     FirmwareFileRegionElem{0x2120, {0xAA, 0xBB, 0xCC, 0xDD}}});
+  auto &eeprom = fw.emplace_back(pic18q20map::eeprom_region_v);
+  eeprom.elems.assign({FirmwareFileRegionElem{0x380000, {0x11, 0x22}}});
+  return fw;
+}
+} // namespace
+
+TEST_CASE("Async programmer", "[async]") {
+  auto objs = setup();
+  objs.pic->buffer()[0x3FFFFE] = 0x40;
+  objs.pic->buffer()[0x3FFFFF] = 0x7a;
+  auto icsp = ICSPHeader(objs.gpio);
+
+  SECTION("program, verify and read back") {
+    AsyncPICProgrammer programmer(pic18fq20, icsp);
+    std::vector<ProgressEvent> events;
+    auto programmed = programmer.program_verify_async(
+        test_firmware(), Address::Region::INVALID, {},
+        [&](const ProgressEvent &ev) { events.push_back(ev); });
+    auto id = programmer.read_device_id_async();
+    auto eeprom = programmer.read_region_async(pic18q20map::eeprom_region);
+
+    REQUIRE_NOTHROW(programmed.get());
+    REQUIRE(id.get().deviceId == 0x7a40);
+    const auto data = eeprom.get();
+    REQUIRE(data.data[0] == 0x11);
+    REQUIRE(data.data[1] == 0x22);
+    REQUIRE(data.data[2] == 0xFF);
+
+    REQUIRE_FALSE(events.empty());
+    REQUIRE(events.back().done == 10);
+    REQUIRE(events.back().total == 10);
+    REQUIRE(objs.pic->buffer()[0x2123] == 0xDD);
+  }
+
+  SECTION("cancelled before start") {
+    AsyncPICProgrammer programmer(pic18fq20, icsp);
+    std::stop_source stop;
+    stop.request_stop();
+    auto programmed = programmer.program_verify_async(
+        test_firmware(), Address::Region::INVALID, stop.get_token());
+    REQUIRE_THROWS_AS(programmed.get(), OperationCancelled);
+    REQUIRE(objs.pic->buffer()[0] == 0xFF);
+  }
+
+  SECTION("cancelled between words") {
+    AsyncPICProgrammer programmer(pic18fq20, icsp);
+    std::stop_source stop;
+    auto programmed = programmer.program_verify_async(
+        test_firmware(), Address::Region::INVALID, stop.get_token(),
+        [&](const ProgressEvent &ev) {
+          if (ev.done >= 4) {
+            stop.request_stop();
+          }
+        });
+    REQUIRE_THROWS_AS(programmed.get(), OperationCancelled);
+    // the words already written are complete, the rest is not touched
+    REQUIRE(objs.pic->buffer()[3] == 0xEF);
+    REQUIRE(objs.pic->buffer()[0x2120] == 0xFF);
+    REQUIRE_FALSE(icsp.programming());
+    REQUIRE(in_state<IDLE>(objs.pic->state()));
+
+    // the executor carries on with the next operation
+    REQUIRE(programmer.read_device_id_async().get().deviceId == 0x7a40);
+  }
+}
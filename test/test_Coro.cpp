@@ -0,0 +1,131 @@
+#include <catch2/catch_all.hpp>
+
+#include <Coro.hpp>
+#include <ICSP_header.hpp>
+#include <PIC18-Q20.hpp>
+
+#include "test_utils.hpp"
+
+#include <chrono>
+#include <coroutine>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+namespace {
+struct VirtualTime {
+  coro::Scheduler scheduler{[this] { return now; },
+                            [this](std::chrono::nanoseconds d) {
+                              now += d;
+                              idle += d;
+                            }};
+  std::chrono::nanoseconds now{};
+  std::chrono::nanoseconds idle{};
+};
+
+coro::Task<int> answer(std::vector<std::string> &log) {
+  log.emplace_back("answer");
+  co_await coro::sleep_for(10us);
+  co_return 42;
+}
+
+coro::Task<> sleeper(std::vector<std::string> &log, std::string name,
+                     std::chrono::microseconds d) {
+  log.push_back(name + " start");
+  co_await coro::sleep_for(d);
+  log.push_back(name + " end");
+}
+
+// Never resumed by anyone
+struct Forever {
+  bool await_ready() const noexcept { return false; }
+  void await_suspend(std::coroutine_handle<>) noexcept {}
+  void await_resume() noexcept {}
+};
+
+coro::Task<int> deadlocked() {
+  co_await Forever{};
+  co_return 1;
+}
+
+coro::Task<> failing() {
+  co_await coro::yield{};
+  throw std::runtime_error("failed");
+}
+} // namespace
+
+TEST_CASE("Coroutine scheduler", "[coro]") {
+  VirtualTime vt;
+  std::vector<std::string> log;
+
+  SECTION("sleeping tasks overlap") {
+    vt.scheduler.spawn(sleeper(log, "a", 100us));
+    vt.scheduler.spawn(sleeper(log, "b", 50us));
+    vt.scheduler.run();
+    REQUIRE(log == std::vector<std::string>{"a start", "b start", "b end",
+                                            "a end"});
+    REQUIRE(vt.now == 100us);
+  }
+
+  SECTION("run returns the result of the task") {
+    REQUIRE(vt.scheduler.run(answer(log)) == 42);
+    REQUIRE(vt.now == 10us);
+  }
+
+  SECTION("failures are propagated") {
+    REQUIRE_THROWS_AS(vt.scheduler.run(failing()), std::runtime_error);
+    vt.scheduler.spawn(failing());
+    REQUIRE_THROWS_AS(vt.scheduler.run(), std::runtime_error);
+  }
+
+  SECTION("a task that is never resumed") {
+    REQUIRE_THROWS_WITH(vt.scheduler.run(deadlocked()), "deadlocked task");
+  }
+}
+
+TEST_CASE("Programming waits of two targets overlap", "[coro]") {
+  auto t1 = setup();
+  auto t2 = setup();
+  auto icsp1 = ICSPHeader(t1.gpio);
+  auto icsp2 = ICSPHeader(t2.gpio);
+  auto prog1 = icsp1.enter_programming();
+  auto prog2 = icsp2.enter_programming();
+
+  // The mocks only see the time passing through their own delays
+  std::chrono::nanoseconds now{}, idle{};
+  coro::Scheduler scheduler{[&] { return now; },
+                            [&](std::chrono::nanoseconds d) {
+                              const auto us =
+                                  std::chrono::ceil<std::chrono::microseconds>(
+                                      d);
+                              t1.gpio->delay(us);
+                              t2.gpio->delay(us);
+                              now += d;
+                              idle += d;
+                            }};
+
+  const std::vector<std::uint8_t> data1{0x01, 0x02, 0x03, 0x04};
+  const std::vector<std::uint8_t> data2{0xA1, 0xA2, 0xA3, 0xA4};
+  constexpr auto EEPROM = pic18q20map::eeprom_region_v.start;
+  auto program = [](ICSPHeader &icsp, const std::vector<std::uint8_t> &data)
+      -> coro::Task<> {
+    co_await icsp.write_verify_async(pic18fq20, EEPROM, data.begin(),
+                                     data.end());
+  };
+  scheduler.spawn(program(icsp1, data1));
+  scheduler.spawn(program(icsp2, data2));
+  scheduler.run();
+
+  for (std::size_t i = 0; i < data1.size(); ++i) {
+    REQUIRE(t1.pic->buffer()[EEPROM + i] == data1[i]);
+    REQUIRE(t2.pic->buffer()[EEPROM + i] == data2[i]);
+  }
+  // 11ms per EEPROM byte, waited once for both targets
+  const auto t_prog = std::chrono::microseconds{
+      pic18q20map::eeprom_region_v.prog_delay().value()};
+  REQUIRE(idle >= data1.size() * t_prog);
+  REQUIRE(idle < data1.size() * t_prog * 2);
+}
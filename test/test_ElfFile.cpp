@@ -0,0 +1,151 @@
+#include <catch2/catch_all.hpp>
+
+#include <ElfFile.hpp>
+#include <PIC18-Q20.hpp>
+
+#include "test_utils.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <numeric>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <elf.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+struct TestSegment {
+  uint32_t type{PT_LOAD};
+  uint32_t paddr{};
+  std::vector<uint8_t> data{};
+  // zero filled tail
+  uint32_t bss{};
+};
+
+// A minimal ELF32 image: the header, the program headers, then the data of
+// the segments
+std::string elf_image(std::vector<TestSegment> const &segments,
+                      unsigned char elf_class = ELFCLASS32) {
+  Elf32_Ehdr ehdr{};
+  std::memcpy(ehdr.e_ident, ELFMAG, SELFMAG);
+  ehdr.e_ident[EI_CLASS] = elf_class;
+  ehdr.e_ident[EI_DATA] = ELFDATA2LSB;
+  ehdr.e_ident[EI_VERSION] = EV_CURRENT;
+  ehdr.e_type = ET_EXEC;
+  ehdr.e_version = EV_CURRENT;
+  ehdr.e_phoff = sizeof(Elf32_Ehdr);
+  ehdr.e_ehsize = sizeof(Elf32_Ehdr);
+  ehdr.e_phentsize = sizeof(Elf32_Phdr);
+  ehdr.e_phnum = static_cast<Elf32_Half>(segments.size());
+
+  std::string image(reinterpret_cast<const char *>(&ehdr), sizeof(ehdr));
+  std::string data;
+  auto offset = sizeof(Elf32_Ehdr) + segments.size() * sizeof(Elf32_Phdr);
+  for (const auto &segment : segments) {
+    Elf32_Phdr phdr{};
+    phdr.p_type = segment.type;
+    phdr.p_offset = static_cast<Elf32_Off>(offset + data.size());
+    phdr.p_vaddr = segment.paddr;
+    phdr.p_paddr = segment.paddr;
+    phdr.p_filesz = static_cast<Elf32_Word>(segment.data.size());
+    phdr.p_memsz = phdr.p_filesz + segment.bss;
+    image.append(reinterpret_cast<const char *>(&phdr), sizeof(phdr));
+    data.append(segment.data.begin(), segment.data.end());
+  }
+  return image + data;
+}
+
+const std::vector<TestSegment> firmware_segments{
+    {.paddr = 0x300000, .data = {0xEC, 0xFF, 0xFF, 0xFF}},
+    {.paddr = 0x0000, .data = {0x55, 0xEF, 0x00, 0xF0}, .bss = 0x100},
+    {.type = PT_NOTE, .paddr = 0x100000, .data = {0x01}},
+    {.paddr = 0x0004, .data = {0x12, 0x00}},
+};
+
+constexpr Address::region low_v{Address::Region::PROGRAM, 0x00, 0x10, 2};
+constexpr Address::region high_v{Address::Region::USER, 0x10, 0x20, 2};
+constexpr Address::RegionMap<low_v, high_v> adjacent_map{};
+} // namespace
+
+TEST_CASE("ELF loading", "[elf]") {
+  SECTION("the PT_LOAD segments are mapped into the regions") {
+    const auto fw =
+        Elf::parse_elf_buffer(pic18fq20, elf_image(firmware_segments));
+    REQUIRE(fw.size() == 2);
+    REQUIRE(fw[0].region.name == Address::Region::PROGRAM);
+    REQUIRE(fw[0].elems.size() == 1);
+    REQUIRE(fw[0].elems[0].base_addr == 0);
+    REQUIRE(fw[0].elems[0].data ==
+            byte_vector{0x55, 0xEF, 0x00, 0xF0, 0x12, 0x00});
+    REQUIRE(fw[1].region.name == Address::Region::CONFIG);
+    REQUIRE(fw[1].elems[0].base_addr == 0x300000);
+    REQUIRE(fw[1].elems[0].data == byte_vector{0xEC, 0xFF, 0xFF, 0xFF});
+  }
+
+  SECTION("segments spanning adjacent regions are split") {
+    std::vector<uint8_t> data(0x14);
+    std::iota(data.begin(), data.end(), uint8_t{0});
+    const auto fw = Elf::parse_elf_buffer(
+        adjacent_map, elf_image({{.paddr = 0x08, .data = data}}));
+    REQUIRE(fw.size() == 2);
+    REQUIRE(fw[0].elems[0].base_addr == 0x08);
+    REQUIRE(fw[0].elems[0].data.size() == 0x08);
+    REQUIRE(fw[1].region.name == Address::Region::USER);
+    REQUIRE(fw[1].elems[0].base_addr == 0x10);
+    REQUIRE(fw[1].elems[0].data.front() == 0x08);
+    REQUIRE(fw[1].elems[0].data.size() == 0x0C);
+  }
+
+  SECTION("the segments have to be in the regions") {
+    // nothing follows the CONFIG region
+    std::vector<uint8_t> data(0x24, 0xAB);
+    REQUIRE_THROWS_WITH(
+        Elf::parse_elf_buffer(pic18fq20,
+                              elf_image({{.paddr = 0x300000, .data = data}})),
+        "Out of bounds segment data at addr: 0x00300020");
+    data.resize(0x20);
+    const auto fw = Elf::parse_elf_buffer(
+        pic18fq20, elf_image({{.paddr = 0x300000, .data = data}}));
+    REQUIRE(fw[0].elems[0].data.size() == 0x20);
+  }
+
+  SECTION("invalid files") {
+    REQUIRE_THROWS_WITH(Elf::parse_elf_buffer(pic18fq20, ":00000001FF\n"),
+                        "Not an ELF file");
+    REQUIRE_THROWS_WITH(
+        Elf::parse_elf_buffer(pic18fq20, elf_image({}, ELFCLASS64)),
+        "Only ELF32 files are supported");
+    REQUIRE_THROWS_WITH(Elf::parse_elf_buffer(pic18fq20, elf_image({})),
+                        "No program headers in the ELF file");
+    const auto image = elf_image(firmware_segments);
+    REQUIRE_THROWS_WITH(
+        Elf::parse_elf_buffer(pic18fq20, image.substr(0, image.size() - 1)),
+        Catch::Matchers::StartsWith("Truncated ELF segment"));
+    REQUIRE_THROWS_WITH(Elf::parse_elf_buffer(pic18fq20, image.substr(0, 60)),
+                        "Truncated ELF program header");
+    REQUIRE_THROWS_WITH(
+        Elf::parse_elf_buffer(pic18fq20,
+                              elf_image({{.paddr = 0x0, .data = {1, 2}},
+                                         {.paddr = 0x1, .data = {3}}})),
+        "Overlapping segments with conflicting data at addr: 0x00000001");
+  }
+
+  SECTION("files and streams") {
+    const auto image = elf_image(firmware_segments);
+    TempPath tmp("image.elf");
+    std::ofstream(tmp.path, std::ios::binary) << image;
+    const auto fw = Elf::load_elf_file(pic18fq20, tmp.path);
+    fs::remove(tmp.path);
+    std::istringstream is(image);
+    const auto streamed = Elf::parse_elf_stream(pic18fq20, is);
+    REQUIRE(fw.size() == 2);
+    REQUIRE(streamed.size() == 2);
+    REQUIRE(fw[0].elems[0].data == streamed[0].elems[0].data);
+    REQUIRE_THROWS(Elf::load_elf_file(pic18fq20, tmp.path));
+  }
+}
@@ -0,0 +1,141 @@
+#include <catch2/catch_all.hpp>
+
+#include <FirmwareCache.hpp>
+#include <IntelHex.hpp>
+#include <PIC18-Q20.hpp>
+
+#include "test_utils.hpp"
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fmt/format.h>
+#include <fmt/ranges.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+const auto hex_text = ":0400000055EF00F0C8\n"
+                      ":012FE80018D0\n"
+                      ":020000040030CA\n"
+                      ":0B000000ECFFFFFF9FFFFF7FFFFFFFF3\n"
+                      ":00000001FF\n";
+
+std::size_t entry_count(fs::path const &dir) {
+  std::size_t count{};
+  for (const auto &entry : fs::directory_iterator(dir)) {
+    count += entry.path().extension() == ".fwc";
+  }
+  return count;
+}
+} // namespace
+
+TEST_CASE("Firmware cache", "[cache]") {
+  TempPath dir("cache");
+  const FirmwareCache cache({.dir = dir.path});
+  const auto parsed = IntelHex::parse_hex_buffer(pic18fq20, hex_text);
+
+  SECTION("hit after store") {
+    REQUIRE_FALSE(cache.load(pic18fq20, hex_text));
+    REQUIRE(cache.store(hex_text, parsed));
+    const auto fw = cache.load(pic18fq20, hex_text);
+    REQUIRE(fw);
+    REQUIRE(fw->size() == parsed.size());
+    for (std::size_t i = 0; i < fw->size(); ++i) {
+      const auto &r = (*fw)[i].region;
+      REQUIRE(r.name == parsed[i].region.name);
+      REQUIRE(r.start == parsed[i].region.start);
+      REQUIRE(r.end == parsed[i].region.end);
+      REQUIRE(r.word_size == parsed[i].region.word_size);
+      REQUIRE(r.t_PROG_us == parsed[i].region.t_PROG_us);
+      REQUIRE(r.writable == parsed[i].region.writable);
+      REQUIRE(r.autoincrement_addr == parsed[i].region.autoincrement_addr);
+      REQUIRE((*fw)[i].base_addr == parsed[i].base_addr);
+      REQUIRE((*fw)[i].elems.size() == parsed[i].elems.size());
+      for (std::size_t j = 0; j < (*fw)[i].elems.size(); ++j) {
+        REQUIRE((*fw)[i].elems[j].base_addr == parsed[i].elems[j].base_addr);
+        REQUIRE((*fw)[i].elems[j].data == parsed[i].elems[j].data);
+      }
+    }
+    // keyed by the content and the byte order
+    REQUIRE_FALSE(cache.load(pic18fq20, std::string(hex_text) + "\n"));
+    REQUIRE_FALSE(cache.load(pic18fq20, hex_text, false));
+  }
+
+  SECTION("the regions come from the memory map") {
+    REQUIRE(cache.store(hex_text, parsed));
+    // an entry with a region the map doesn't have is a miss
+    const std::vector<Address::region> regions{
+        pic18q20map::program_region_v};
+    REQUIRE_FALSE(cache.load(regions, hex_text));
+  }
+
+  SECTION("corrupt entries are misses") {
+    REQUIRE(cache.store(hex_text, parsed));
+    const auto path = cache.entry_path(hex_text, true);
+    fs::resize_file(path, fs::file_size(path) - 3);
+    REQUIRE_FALSE(cache.load(pic18fq20, hex_text));
+    REQUIRE_FALSE(fs::exists(path));
+  }
+
+  SECTION("the least recently used entries are evicted") {
+    const FirmwareCache small({.dir = dir.path, .max_entries = 2});
+    const std::string texts[] = {hex_text, std::string(hex_text) + "\n",
+                                 std::string(hex_text) + "\n\n"};
+    for (const auto &text : texts) {
+      REQUIRE(small.store(text, parsed));
+      // the file times may be coarse
+      fs::last_write_time(small.entry_path(text, true),
+                          fs::file_time_type::clock::now() -
+                              std::chrono::hours(&text - texts + 1));
+    }
+    // the oldest one is used again
+    REQUIRE(small.load(pic18fq20, texts[2]));
+    small.evict();
+    REQUIRE(entry_count(dir.path) == 2);
+    REQUIRE(small.load(pic18fq20, texts[2]));
+    REQUIRE(small.load(pic18fq20, texts[0]));
+    REQUIRE_FALSE(small.load(pic18fq20, texts[1]));
+  }
+
+  SECTION("loading a file through the cache") {
+    fs::create_directories(dir.path);
+    const auto file = dir.path / "fw.hex";
+    std::ofstream(file) << hex_text;
+    const auto first = load_hex_file(pic18fq20, file, cache);
+    REQUIRE(entry_count(dir.path) == 1);
+    const auto second = load_hex_file(pic18fq20, file, cache);
+    REQUIRE(second.size() == first.size());
+    REQUIRE(second[1].elems[0].data == first[1].elems[0].data);
+  }
+
+  SECTION("an unusable directory only disables the cache") {
+    fs::create_directories(dir.path);
+    std::ofstream(dir.path / "file") << "x";
+    const FirmwareCache broken({.dir = dir.path / "file" / "cache"});
+    REQUIRE_FALSE(broken.store(hex_text, parsed));
+    REQUIRE_FALSE(broken.load(pic18fq20, hex_text));
+    REQUIRE_NOTHROW(broken.evict());
+  }
+}
+
+TEST_CASE("Firmware cache digest", "[cache]") {
+  // FIPS 180-4 examples, the second one spans two blocks
+  REQUIRE(fmt::format("{:02x}", fmt::join(FirmwareCache::digest("abc"), "")) ==
+          "ba7816bf8f01cfea414140de5dae2223"
+          "b00361a396177a9cb410ff61f20015ad");
+  REQUIRE(fmt::format("{:02x}",
+                      fmt::join(FirmwareCache::digest(
+                                    "abcdbcdecdefdefgefghfghighijhijk"
+                                    "ijkljklmklmnlmnomnopnopq"),
+                                "")) ==
+          "248d6a61d20638b8e5c026930c3e6039"
+          "a33ce45964ff2167f6ecedd419db06c1");
+  REQUIRE(fmt::format("{:02x}", fmt::join(FirmwareCache::digest(""), "")) ==
+          "e3b0c44298fc1c149afbf4c8996fb924"
+          "27ae41e4649b934ca495991b7852b855");
+}
@@ -0,0 +1,192 @@
+#include <catch2/catch_all.hpp>
+
+#include <FlatImage.hpp>
+#include <IntelHex.hpp>
+#include <PIC18-Q20.hpp>
+#include <PICProgrammer.hpp>
+
+#include "test_utils.hpp"
+
+#include <array>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+const auto hex_text = ":0400000055EF00F0C8\n"
+                      ":012FE80018D0\n"
+                      ":020000040030CA\n"
+                      ":0B000000ECFFFFFF9FFFFF7FFFFFFFF3\n"
+                      ":00000001FF\n";
+
+std::vector<uint8_t> bytes(std::span<const uint8_t> s) {
+  return {s.begin(), s.end()};
+}
+
+struct ByteCounter : IProgressListener {
+  void onProgress(size_t byteCount) override { count += byteCount; }
+  size_t count{};
+};
+} // namespace
+
+TEST_CASE("Flat image", "[flatimage]") {
+  FlatImage image{pic18fq20};
+  REQUIRE(image.regions().size() == 7);
+  const auto &prog = *image.find(Address::Region::PROGRAM);
+  REQUIRE(prog.data().size() == 0x10000);
+  REQUIRE(prog.page_count() == 0x10000 / FlatImage::default_page_size);
+  REQUIRE_FALSE(prog.any_dirty());
+  REQUIRE(std::ranges::all_of(prog.data(), [](uint8_t b) {
+    return b == FlatImage::erased_value;
+  }));
+
+  SECTION("writes mark the pages dirty") {
+    const std::array<uint8_t, 4> data{0x01, 0x02, 0x03, 0x04};
+    image.write(0x7E, data);
+    REQUIRE(prog.dirty(1));
+    REQUIRE(prog.dirty(2));
+    REQUIRE_FALSE(prog.dirty(0));
+    REQUIRE_FALSE(prog.dirty(3));
+    REQUIRE(image.find(0x80u) == &prog);
+    REQUIRE(bytes(prog.data().subspan(0x7E, 4)) == bytes(data));
+    REQUIRE_THROWS_AS(prog.page_hash(1), std::logic_error);
+    image.seal();
+    REQUIRE_NOTHROW(prog.page_hash(1));
+    REQUIRE(prog.page_hash(1) != prog.page_hash(0));
+    // the blank pages hash the same
+    REQUIRE(prog.page_hash(0) == prog.page_hash(3));
+  }
+
+  SECTION("writes must be in one region") {
+    const std::array<uint8_t, 4> data{};
+    REQUIRE_THROWS_AS(image.write(0xFFFE, data), std::out_of_range);
+    REQUIRE_THROWS_AS(image.write(0x100000, data), std::out_of_range);
+    REQUIRE_THROWS_AS(FlatImage(pic18fq20, 3), std::invalid_argument);
+  }
+
+  SECTION("diff and verify") {
+    FlatImage other{pic18fq20};
+    const std::array<uint8_t, 2> a{0x12, 0x34};
+    const std::array<uint8_t, 2> b{0x12, 0x35};
+    image.write(0x380010, a);
+    other.write(0x380010, a);
+    image.write(0x1000, a);
+    other.write(0x1000, b);
+    // blank either way
+    other.write(0x2000, std::array<uint8_t, 2>{0xFF, 0xFF});
+    image.seal();
+    other.seal();
+    const auto diff = image.diff(other);
+    REQUIRE(diff.size() == 1);
+    REQUIRE(diff[0] == FlatImage::PageRef{Address::Region::PROGRAM,
+                                          0x1000 / prog.page_size()});
+    REQUIRE(image.diff(image).empty());
+    REQUIRE_THROWS_AS(image.diff(FlatImage{pic18fq20, 128}),
+                      std::invalid_argument);
+
+    REQUIRE_FALSE(image.verify(0x1000, a));
+    REQUIRE(image.verify(0x1000, b) == 0x1001u);
+    REQUIRE_FALSE(image.verify(0x0FFE, std::array<uint8_t, 2>{0xFF, 0xFF}));
+  }
+
+  SECTION("the blank words are elided") {
+    image.write(0x100, std::array<uint8_t, 8>{0x01, 0x02, 0xFF, 0xFF, 0xFF,
+                                              0x03, 0x04, 0x05});
+    image.write(0x140, std::array<uint8_t, 2>{0x06, 0x07});
+    image.write(0x380000, std::array<uint8_t, 2>{0xFF, 0xFF});
+    const auto fw = image.to_firmware();
+    REQUIRE(fw.size() == 2);
+    REQUIRE(fw[0].region.name == Address::Region::PROGRAM);
+    REQUIRE(fw[0].elems.size() == 3);
+    REQUIRE(fw[0].elems[0].base_addr == 0x100);
+    REQUIRE(fw[0].elems[0].data == byte_vector{0x01, 0x02});
+    // the words are kept whole
+    REQUIRE(fw[0].elems[1].base_addr == 0x104);
+    REQUIRE(fw[0].elems[1].data == byte_vector{0xFF, 0x03, 0x04, 0x05});
+    REQUIRE(fw[0].elems[2].base_addr == 0x140);
+    REQUIRE(fw[0].elems[2].data == byte_vector{0x06, 0x07});
+    // written, but blank: erased only
+    REQUIRE(fw[1].region.name == Address::Region::EEPROM);
+    REQUIRE(fw[1].elems.empty());
+    REQUIRE(image.program_size() == 8);
+  }
+}
+
+TEST_CASE("Firmware programmed through a flat image", "[flatimage]") {
+  auto objs = setup();
+  auto icsp = ICSPHeader(objs.gpio);
+  PICProgrammer programmer(pic18fq20, icsp);
+  const Firmware fw{
+      FirmwareFileRegion{pic18q20map::program_region_v,
+                         0,
+                         {FirmwareFileRegionElem{
+                             0x100, byte_vector{0x01, 0x02, 0xFF, 0xFF, 0xFF,
+                                                0xFF, 0x03, 0x04}}}}};
+  const FlatImage image{pic18fq20, fw};
+  REQUIRE(image.program_size() == 4);
+  REQUIRE(image.to_firmware()[0].base_addr == 0);
+  ByteCounter counter;
+  // the blank words are left erased
+  programmer.program_verify(fw, Address::Region::INVALID, &counter);
+  REQUIRE(counter.count == 4);
+  REQUIRE(objs.pic->buffer()[0x100] == 0x01);
+  REQUIRE(objs.pic->buffer()[0x102] == 0xFF);
+  REQUIRE(objs.pic->buffer()[0x106] == 0x03);
+  REQUIRE(objs.pic->buffer()[0x107] == 0x04);
+}
+
+TEST_CASE("Hex files parsed into a flat image", "[flatimage][intelhex]") {
+  SECTION("same content as the Firmware") {
+    const auto image = IntelHex::parse_hex_image(pic18fq20, hex_text);
+    const auto fw = IntelHex::parse_hex_buffer(pic18fq20, hex_text);
+    for (const auto &region : fw) {
+      for (const auto &elem : region.elems) {
+        REQUIRE_FALSE(image.verify(elem.base_addr, elem.data));
+      }
+    }
+    const auto &config = *image.find(Address::Region::CONFIG);
+    REQUIRE(config.dirty(0));
+    REQUIRE_NOTHROW(config.page_hash(0));
+    const auto flat = image.to_firmware();
+    REQUIRE(flat.size() == 2);
+    REQUIRE(flat[1].elems.size() == 3);
+    REQUIRE(flat[1].elems[2].base_addr == 0x300007);
+    REQUIRE(flat[1].elems[2].data == byte_vector{0x7F});
+  }
+
+  SECTION("big endian words are swapped") {
+    const auto image = IntelHex::parse_hex_image(pic18fq20, hex_text, false);
+    REQUIRE(bytes(image.find(0u)->data().first(4)) ==
+            std::vector<uint8_t>{0xEF, 0x55, 0xF0, 0x00});
+    // single byte words aren't
+    REQUIRE(image.find(Address::Region::CONFIG)->data()[0] == 0xEC);
+  }
+
+  SECTION("the checks of the Firmware parser") {
+    REQUIRE_THROWS_WITH(
+        IntelHex::parse_hex_image(pic18fq20, ":0400000055EF00F0C8\n"
+                                             ":0400000055EF00F1C7\n"
+                                             ":00000001FF\n"),
+        Catch::Matchers::ContainsSubstring("Overlapping layout"));
+    REQUIRE_THROWS_WITH(
+        IntelHex::parse_hex_image(pic18fq20, ":04FFFE0055EF00F0CB\n"
+                                             ":00000001FF\n"),
+        Catch::Matchers::ContainsSubstring("Out of bounds data"));
+    REQUIRE_THROWS_WITH(
+        IntelHex::parse_hex_image(pic18fq20, ":0400000055EF00F0C8\n"),
+        "End-of-file missing from hex file");
+  }
+
+  SECTION("programmed like the Firmware") {
+    auto objs = setup();
+    auto icsp = ICSPHeader(objs.gpio);
+    PICProgrammer programmer(pic18fq20, icsp);
+    programmer.program_verify(IntelHex::parse_hex_image(pic18fq20, hex_text));
+    REQUIRE(objs.pic->buffer()[0] == 0x55);
+    REQUIRE(objs.pic->buffer()[3] == 0xF0);
+    REQUIRE(objs.pic->buffer()[0x2FE8] == 0x18);
+    REQUIRE(objs.pic->buffer()[0x300000] == 0xEC);
+    REQUIRE(objs.pic->buffer()[0x300007] == 0x7F);
+    REQUIRE(objs.pic->buffer()[0x300008] == 0xFF);
+  }
+}
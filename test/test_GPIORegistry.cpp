@@ -0,0 +1,94 @@
+#include <catch2/catch_all.hpp>
+
+#include <GPIORegistry.hpp>
+#include <ICSP_header.hpp>
+#include <IGPIO.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+
+namespace {
+struct FakeGPIO : IGPIO {
+  explicit FakeGPIO(std::chrono::microseconds write_latency = {},
+                    Capabilities caps = {})
+      : write_latency{write_latency}, caps{caps} {}
+
+  void set_gpio_mode(port_id_t port, Modes mode, val_t initial) override {}
+  void gpio_write(port_id_t gpio, val_t val) override {
+    if (write_latency.count() != 0) {
+      std::this_thread::sleep_for(write_latency);
+    }
+  }
+  val_t gpio_read(port_id_t gpio) override { return 0; }
+  void delay(std::chrono::microseconds) override { ++delays; }
+  Capabilities capabilities() const override { return caps; }
+
+  std::chrono::microseconds write_latency;
+  Capabilities caps;
+  std::size_t delays{};
+};
+
+struct SlowGPIO : FakeGPIO {
+  SlowGPIO() : FakeGPIO(std::chrono::microseconds{200}) {}
+};
+
+struct FastGPIO : FakeGPIO {};
+
+// The slow one has the higher priority, so the probe has to overrule it
+const GPIOBackendRegistrar slow_registrar{
+    "test-slow", [] { return std::make_shared<SlowGPIO>(); }, 100};
+const GPIOBackendRegistrar fast_registrar{
+    "test-fast", [] { return std::make_shared<FastGPIO>(); }, 99};
+} // namespace
+
+TEST_CASE("GPIO backends are selectable by name", "[gpioregistry]") {
+  auto &registry = GPIORegistry::instance();
+  const auto names = registry.names();
+  REQUIRE(std::find(names.begin(), names.end(), "mock") != names.end());
+  REQUIRE(registry.create("mock") != nullptr);
+  REQUIRE(std::dynamic_pointer_cast<SlowGPIO>(registry.create("test-slow")));
+  REQUIRE_THROWS_AS(registry.create("no-such-backend"), std::invalid_argument);
+  REQUIRE_THROWS_AS(GPIOBackendRegistrar("mock", [] { return nullptr; }),
+                    std::invalid_argument);
+  REQUIRE_THROWS_AS(
+      GPIOBackendRegistrar(std::string{GPIORegistry::AUTO},
+                           [] { return nullptr; }),
+      std::invalid_argument);
+}
+
+TEST_CASE("Auto GPIO backend selection", "[gpioregistry]") {
+  auto &registry = GPIORegistry::instance();
+
+  SECTION("without probe pin the highest priority wins") {
+    REQUIRE(std::dynamic_pointer_cast<SlowGPIO>(registry.create("auto")));
+  }
+
+  SECTION("with probe pin the fastest wins") {
+    const auto results = registry.probe_all(0);
+    REQUIRE(results.size() >= 2);
+    REQUIRE(std::all_of(results.begin(), results.end(),
+                        [](auto const &r) { return r.name != "mock"; }));
+    REQUIRE(std::dynamic_pointer_cast<FastGPIO>(registry.create("auto", 0)));
+  }
+}
+
+TEST_CASE("ICSPHeader skips waits covered by the backend edge period",
+          "[gpioregistry]") {
+  using namespace std::chrono_literals;
+  auto plain = std::make_shared<FakeGPIO>();
+  auto slow_edges = std::make_shared<FakeGPIO>(
+      0us, IGPIO::Capabilities{.min_edge_period = Timings::T_CLK});
+  {
+    auto icsp = ICSPHeader(plain);
+    icsp.load_pc(0x100);
+  }
+  {
+    auto icsp = ICSPHeader(slow_edges);
+    icsp.load_pc(0x100);
+  }
+  // command + 24 bit payload, two clock edges per bit
+  REQUIRE(plain->delays - slow_edges->delays == 2 * 8 * 4);
+}
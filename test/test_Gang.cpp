@@ -0,0 +1,141 @@
+#include <catch2/catch_all.hpp>
+
+#include <FimwareFile.hpp>
+#include <ICSP_header.hpp>
+#include <PICProgrammer.hpp>
+#include <PIC18-Q20.hpp>
+
+#include "test_utils.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace {
+constexpr std::array<IGPIO::port_id_t, 3> DATA_PINS{10, 12, 13};
+
+ICSPPins gang_pins() {
+  ICSPPins pins{};
+  pins.gang_data_pins.assign(DATA_PINS.begin() + 1, DATA_PINS.end());
+  return pins;
+}
+
+// Targets sharing CLK, MCLR and PROG_EN on one mocked GPIO
+struct Gang {
+  Gang() : gpio(MockGPIO::Create()) {
+    for (auto data : DATA_PINS) {
+      ICSPPins pins{};
+      pins.data_pin = data;
+      pics.push_back(std::make_shared<MockPIC18Q20>(gpio.get(), pins));
+    }
+  }
+  std::shared_ptr<MockGPIO> gpio;
+  std::vector<std::shared_ptr<MockPIC18Q20>> pics;
+};
+
+// Counts the bank updates and reads a DATA line stuck low
+struct GangGPIO final : IGPIO {
+  explicit GangGPIO(std::shared_ptr<MockGPIO> gpio) : gpio{std::move(gpio)} {}
+
+  void set_gpio_mode(port_id_t port, Modes mode, val_t initial) override {
+    gpio->set_gpio_mode(port, mode, initial);
+  }
+  void gpio_write(port_id_t port, val_t val) override {
+    gpio->gpio_write(port, val);
+  }
+  val_t gpio_read(port_id_t port) override {
+    const auto val = gpio->gpio_read(port);
+    return std::ranges::find(stuck_low, port) != stuck_low.end() ? 0 : val;
+  }
+  void gpio_write_many(std::span<const port_id_t> ports,
+                       std::span<const val_t> vals) override {
+    ++bank_writes;
+    IGPIO::gpio_write_many(ports, vals);
+  }
+  void gpio_read_many(std::span<const port_id_t> ports,
+                      std::span<val_t> vals) override {
+    ++bank_reads;
+    IGPIO::gpio_read_many(ports, vals);
+  }
+  void delay(std::chrono::microseconds d) override { gpio->delay(d); }
+  std::chrono::nanoseconds now() const override { return gpio->now(); }
+
+  std::shared_ptr<MockGPIO> gpio;
+  std::vector<port_id_t> stuck_low;
+  std::size_t bank_writes{};
+  std::size_t bank_reads{};
+};
+
+Firmware gang_firmware() {
+  Firmware fw;
+  auto &prog = fw.emplace_back(pic18q20map::program_region_v);
+  prog.elems.assign({FirmwareFileRegionElem{0, {0xDE, 0xAD, 0xBE, 0xEF}}});
+  auto &eeprom = fw.emplace_back(pic18q20map::eeprom_region_v);
+  eeprom.elems.assign({FirmwareFileRegionElem{0x380000, {0x11, 0x22}}});
+  return fw;
+}
+} // namespace
+
+TEST_CASE("Gang programming", "[ICSP][gang]") {
+  Gang gang;
+  auto gpio = std::make_shared<GangGPIO>(gang.gpio);
+  auto icsp = ICSPHeader(gpio, gang_pins());
+  REQUIRE(icsp.target_count() == 3);
+
+  SECTION("program and verify every target") {
+    {
+      PICProgrammer programmer(pic18fq20, icsp);
+      REQUIRE_NOTHROW(programmer.program_verify(gang_firmware()));
+    }
+    for (auto &pic : gang.pics) {
+      REQUIRE(pic->buffer()[0] == 0xDE);
+      REQUIRE(pic->buffer()[3] == 0xEF);
+      REQUIRE(pic->buffer()[0x380001] == 0x22);
+      REQUIRE(in_state<IDLE>(pic->state()));
+    }
+    REQUIRE(gpio->bank_writes > 0);
+    REQUIRE(gpio->bank_reads > 0);
+    for (const auto &target : icsp.target_results()) {
+      REQUIRE(target.ok());
+    }
+  }
+
+  SECTION("read every target in one pass") {
+    gang.pics[1]->buffer()[0x10] = 0x5A;
+    auto prog = icsp.enter_programming();
+    const auto data = icsp.read_n_targets(pic18fq20, 0x10, 4);
+    REQUIRE(data.size() == 3);
+    REQUIRE(data[0] == std::vector<std::uint8_t>{0xFF, 0xFF, 0xFF, 0xFF});
+    REQUIRE(data[1] == std::vector<std::uint8_t>{0x5A, 0xFF, 0xFF, 0xFF});
+    REQUIRE(data[2] == data[0]);
+  }
+
+  SECTION("failed target is reported, the others are programmed") {
+    gpio->stuck_low = {DATA_PINS[2]};
+    PICProgrammer programmer(pic18fq20, icsp);
+    REQUIRE_THROWS_WITH(
+        programmer.program_verify(gang_firmware()),
+        Catch::Matchers::ContainsSubstring(
+            "Programming failed on 1 of 3 targets") &&
+            Catch::Matchers::ContainsSubstring("target 2 (DATA pin 13)"));
+    const auto results = icsp.target_results();
+    REQUIRE(results[0].ok());
+    REQUIRE(results[1].ok());
+    REQUIRE(results[2].failed_words == 4);
+    REQUIRE(gang.pics[0]->buffer()[0x380001] == 0x22);
+    REQUIRE(gang.pics[1]->buffer()[3] == 0xEF);
+  }
+
+  SECTION("stops when no target is left") {
+    gpio->stuck_low = {DATA_PINS.begin(), DATA_PINS.end()};
+    auto prog = icsp.enter_programming();
+    const std::vector<std::uint8_t> data{0x11, 0x22};
+    REQUIRE_THROWS_WITH(
+        icsp.write_verify(pic18fq20, 0x380000, data.begin(), data.end()),
+        Catch::Matchers::ContainsSubstring("Programming failed on 3 of 3"));
+    // the first word failed everywhere, the second one is not written
+    REQUIRE(gang.pics[0]->buffer()[0x380001] == 0xFF);
+  }
+}
@@ -0,0 +1,119 @@
+#include <catch2/catch_all.hpp>
+
+#include <Gzip.hpp>
+#include <IntelHex.hpp>
+#include <PIC18-Q20.hpp>
+#include <RawImage.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <fmt/format.h>
+
+namespace {
+std::string compress(std::string const &text) {
+  std::ostringstream os;
+  Gzip::OStream gz(os);
+  gz << text;
+  gz.finish();
+  return os.str();
+}
+
+std::string inflate(std::string const &data, std::size_t chunk_size) {
+  std::istringstream is(data);
+  Gzip::InflateBuf buf(is, chunk_size);
+  return {std::istreambuf_iterator<char>(&buf),
+          std::istreambuf_iterator<char>()};
+}
+
+std::vector<uint8_t> program_data() {
+  std::vector<uint8_t> data(4096);
+  for (std::size_t i = 0; i < data.size(); ++i) {
+    data[i] = static_cast<uint8_t>(i * 7);
+  }
+  return data;
+}
+} // namespace
+
+TEST_CASE("Gzip streams", "[gzip]") {
+  std::string text;
+  for (int i = 0; i < 5000; ++i) {
+    text += fmt::format("line {}\n", i);
+  }
+
+  SECTION("round trip in small chunks") {
+    const auto data = compress(text);
+    REQUIRE(static_cast<unsigned char>(data[0]) == 0x1f);
+    REQUIRE(static_cast<unsigned char>(data[1]) == 0x8b);
+    REQUIRE(data.size() < text.size() / 2);
+    REQUIRE(inflate(data, 7) == text);
+    REQUIRE(inflate(data, Gzip::default_chunk_size) == text);
+  }
+
+  SECTION("concatenated members") {
+    REQUIRE(inflate(compress("first\n") + compress("second\n"), 5) ==
+            "first\nsecond\n");
+  }
+
+  SECTION("flushed output can be inflated") {
+    std::ostringstream os;
+    Gzip::OStream gz(os);
+    gz << "partial" << std::flush;
+    std::istringstream is(os.str());
+    Gzip::IStream in(is);
+    std::string word;
+    REQUIRE_THROWS_WITH(in >> word, "Truncated gzip stream");
+  }
+
+  SECTION("invalid data") {
+    std::istringstream plain("plain text");
+    REQUIRE_FALSE(Gzip::is_gzip(plain));
+    auto data = compress(text);
+    REQUIRE_THROWS_WITH(inflate(data.substr(0, data.size() / 2), 64),
+                        "Truncated gzip stream");
+    data[20] = static_cast<char>(~data[20]);
+    data[21] = static_cast<char>(~data[21]);
+    REQUIRE_THROWS_WITH(inflate(data, 64),
+                        Catch::Matchers::StartsWith("Invalid gzip data"));
+  }
+
+  SECTION("compressed hex dump") {
+    auto data = program_data();
+    std::ostringstream os;
+    {
+      Gzip::OStream gz(os);
+      IntelHex::Dumper dumper(gz);
+      dumper.dump_start();
+      dumper.dump_region(Address::Region::PROGRAM, data);
+      dumper.dump_end();
+    }
+    std::istringstream is(os.str());
+    REQUIRE(Gzip::is_gzip(is));
+    Gzip::IStream hex(is);
+    const auto fw = IntelHex::parse_hex_file(pic18fq20, hex);
+    REQUIRE(fw.size() == 1);
+    REQUIRE(fw[0].elems.size() == 1);
+    REQUIRE(fw[0].elems[0].base_addr == 0);
+    REQUIRE(std::ranges::equal(fw[0].elems[0].data, data));
+  }
+
+  SECTION("compressed raw image") {
+    auto data = program_data();
+    std::ostringstream os;
+    Gzip::OStream gz(os);
+    RawImage::Dumper dumper(gz);
+    dumper.dump_start();
+    dumper.dump_region(Address::Region::PROGRAM, data);
+    dumper.dump_end();
+    gz.finish();
+    std::istringstream is(os.str());
+    Gzip::IStream image(is);
+    const auto fw = RawImage::parse_image_stream(pic18fq20, image);
+    REQUIRE(fw.size() == 1);
+    REQUIRE(std::ranges::equal(fw[0].elems[0].data, data));
+  }
+}
@@ -4,9 +4,13 @@
 #include "MockPIC18Q20.hpp"
 #include "PIC18-Q20.hpp"
 #include "Region.hpp"
+#include "SignalBridge.hpp"
 #include <catch2/catch_all.hpp>
 #include <csignal>
 #include <cstdint>
+#include <memory>
+#include <stop_token>
+#include <vector>
 
 #include "test_utils.hpp"
 
@@ -38,7 +42,10 @@ TEST_CASE("Cleanup in case of SIGINT/SIGTERM", "[ICSP]") {
     auto prog = icsp.enter_programming();
     REQUIRE(in_state<PROGRAMMING>(pic->state()));
     raise(SIGTERM);
-    REQUIRE_THROWS(gpio->gpio_write(ICSPPins{}.data_pin, 1));
+    // the GPIO calls themselves are not interrupted, only the transactions
+    REQUIRE_NOTHROW(gpio->gpio_write(ICSPPins{}.data_pin, 1));
+    REQUIRE_THROWS_AS(icsp.load_pc(0), IGPIO::Interrupted);
+    SignalBridge::reset();
   }
   REQUIRE(in_state<IDLE>(pobj.pic->state()));
 
@@ -49,6 +56,117 @@ TEST_CASE("Cleanup in case of SIGINT/SIGTERM", "[ICSP]") {
   REQUIRE(val == 0);
 }
 
+TEST_CASE("Sessions are interrupted independently", "[ICSP]") {
+  auto first = setup();
+  auto second = setup();
+  auto icsp1 = ICSPHeader(first.gpio);
+  auto icsp2 = ICSPHeader(second.gpio);
+  auto prog1 = icsp1.enter_programming();
+  auto prog2 = icsp2.enter_programming();
+
+  SECTION("on request") {
+    icsp1.session().interrupt();
+    REQUIRE_THROWS_AS(icsp1.load_pc(0), IGPIO::Interrupted);
+    REQUIRE_NOTHROW(icsp2.load_pc(0));
+    icsp1.session().reset();
+    REQUIRE_NOTHROW(icsp1.load_pc(0));
+  }
+
+  SECTION("a signal reaches every session") {
+    raise(SIGINT);
+    SignalBridge::reset();
+    REQUIRE_THROWS_AS(icsp1.load_pc(0), IGPIO::Interrupted);
+    REQUIRE_THROWS_AS(icsp2.load_pc(0), IGPIO::Interrupted);
+    // the sessions forget it on their own
+    icsp2.session().reset();
+    REQUIRE_NOTHROW(icsp2.load_pc(0));
+    REQUIRE_THROWS_AS(icsp1.load_pc(0), IGPIO::Interrupted);
+    // the handled signal doesn't affect the new sessions
+    REQUIRE_FALSE(GPIOSession{}.interrupted());
+  }
+
+  SECTION("headers may share a session") {
+    icsp2.set_session(icsp1.session_ptr());
+    icsp1.session().interrupt();
+    REQUIRE_THROWS_AS(icsp2.load_pc(0), IGPIO::Interrupted);
+  }
+}
+
+TEST_CASE("Mocked library handles are per instance", "[ICSP]") {
+  auto first = MockGPIO::Create();
+  auto second = MockGPIO::Create();
+  REQUIRE(first->handle() != second->handle());
+  REQUIRE(first->handle()->is_initialized());
+  first->handle()->terminate();
+  REQUIRE(first->handle()->is_terminated());
+  REQUIRE_FALSE(second->handle()->is_terminated());
+
+  auto shared = MockGPIO::Create(first->handle());
+  REQUIRE(shared->handle() == first->handle());
+  REQUIRE_THROWS_WITH(
+      GPIOLibHandle::create({.fail_to_initialize = true}), "GPIO init failed");
+}
+
+namespace {
+// Requests a stop on the first read, i.e. in the middle of a verified word
+struct StopOnReadGPIO : IGPIO {
+  explicit StopOnReadGPIO(IGPIO::Ptr gpio) : gpio{std::move(gpio)} {}
+  void set_gpio_mode(port_id_t port, Modes mode, val_t initial) override {
+    gpio->set_gpio_mode(port, mode, initial);
+  }
+  void gpio_write(port_id_t port, val_t val) override {
+    gpio->gpio_write(port, val);
+  }
+  val_t gpio_read(port_id_t port) override {
+    stop.request_stop();
+    return gpio->gpio_read(port);
+  }
+  void delay(std::chrono::microseconds d) override { gpio->delay(d); }
+  std::chrono::nanoseconds now() const override { return gpio->now(); }
+
+  IGPIO::Ptr gpio;
+  std::stop_source stop;
+};
+
+struct WordCounter : IProgressListener {
+  void onProgress(size_t byteCount) override { bytes += byteCount; }
+  std::size_t bytes{};
+};
+} // namespace
+
+TEST_CASE("Stop token is checked between transactions", "[ICSP]") {
+  auto objs = setup();
+  auto gpio = std::make_shared<StopOnReadGPIO>(objs.gpio);
+  auto icsp = ICSPHeader(gpio);
+  const auto start = pic18q20map::eeprom_region.value.start;
+  const std::vector<uint8_t> data{0xde, 0xad, 0xbe, 0xef};
+  WordCounter counter;
+
+  SECTION("at the next transaction") {
+    icsp.set_stop_token(gpio->stop.get_token());
+    auto prog = icsp.enter_programming();
+    REQUIRE_THROWS_AS(icsp.write_verify(pic18fq20, start, data.begin(),
+                                        data.end(), &counter),
+                      IGPIO::Interrupted);
+    REQUIRE(counter.bytes == 0);
+  }
+
+  SECTION("after finishing the current word") {
+    icsp.set_stop_token(gpio->stop.get_token(), ICSPHeader::StopAt::WORD);
+    auto prog = icsp.enter_programming();
+    REQUIRE_THROWS_AS(icsp.write_verify(pic18fq20, start, data.begin(),
+                                        data.end(), &counter),
+                      IGPIO::Interrupted);
+    REQUIRE(counter.bytes == 1);
+  }
+  REQUIRE(objs.pic->buffer()[start] == 0xde);
+  REQUIRE(objs.pic->buffer()[start + 1] == 0xff);
+  REQUIRE_FALSE(icsp.programming());
+  REQUIRE(in_state<IDLE>(objs.pic->state()));
+  // entering the programming mode again is refused as well
+  REQUIRE_THROWS_AS(icsp.enter_programming(), IGPIO::Interrupted);
+}
+
 TEST_CASE("Reading device IDs", "[ICSP]") {
 
   auto objs = setup();
@@ -0,0 +1,135 @@
+#include <catch2/catch_all.hpp>
+
+#include <ICSPWorker.hpp>
+#include <ICSP_header.hpp>
+#include <IGPIO.hpp>
+#include <PIC18-Q20.hpp>
+#include <PICProgrammer.hpp>
+#include <SPSCRing.hpp>
+
+#include "FimwareFile.hpp"
+#include "test_utils.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace {
+// Forwards to the mock, but reads back a stuck-at-zero DATA line on demand
+struct StuckDataGPIO : IGPIO {
+  explicit StuckDataGPIO(IGPIO::Ptr gpio) : gpio{std::move(gpio)} {}
+  void set_gpio_mode(port_id_t port, Modes mode, val_t initial) override {
+    gpio->set_gpio_mode(port, mode, initial);
+  }
+  void gpio_write(port_id_t port, val_t val) override {
+    gpio->gpio_write(port, val);
+  }
+  val_t gpio_read(port_id_t port) override {
+    const auto val = gpio->gpio_read(port);
+    return stuck ? 0 : val;
+  }
+  void delay(std::chrono::microseconds d) override { gpio->delay(d); }
+  std::chrono::nanoseconds now() const override { return gpio->now(); }
+
+  IGPIO::Ptr gpio;
+  std::atomic<bool> stuck{};
+};
+} // namespace
+
+TEST_CASE("SPSC ring", "[worker]") {
+  SPSCRing<int, 4> ring;
+  REQUIRE(ring.empty());
+  for (int i = 0; i < 4; ++i) {
+    REQUIRE(ring.try_push(i));
+  }
+  REQUIRE_FALSE(ring.try_push(4));
+  REQUIRE(ring.try_pop() == 0);
+  REQUIRE(ring.try_push(4));
+  for (int i = 1; i < 5; ++i) {
+    REQUIRE(ring.try_pop() == i);
+  }
+  REQUIRE_FALSE(ring.try_pop());
+
+  SECTION("producer and consumer threads") {
+    constexpr int COUNT = 100'000;
+    SPSCRing<int, 64> big;
+    std::thread producer([&] {
+      for (int i = 0; i < COUNT; ++i) {
+        while (!big.try_push(i)) {
+          big.wait_not_full();
+        }
+      }
+    });
+    bool in_order = true;
+    for (int expected = 0; expected < COUNT;) {
+      if (auto v = big.try_pop()) {
+        in_order = in_order && *v == expected;
+        ++expected;
+      } else {
+        big.wait_not_empty();
+      }
+    }
+    producer.join();
+    REQUIRE(in_order);
+  }
+}
+
+TEST_CASE("Program verify on the I/O worker", "[worker]") {
+  auto objs = setup();
+  objs.pic->buffer()[0x3FFFFC] = 0x42;
+  objs.pic->buffer()[0x3FFFFD] = 0xa0;
+  objs.pic->buffer()[0x3FFFFE] = 0x40;
+  objs.pic->buffer()[0x3FFFFF] = 0x7a;
+  auto icsp = ICSPHeader(objs.gpio);
+  ICSPWorker worker(icsp);
+  {
+    PICProgrammer programmer(pic18fq20, worker);
+    REQUIRE(programmer.read_device_id().deviceId == 0x7a40);
+
+    Firmware fw;
+    auto &prog = fw.emplace_back(pic18q20map::program_region_v);
+    prog.elems.assign({FirmwareFileRegionElem{0, {0xDE, 0xAD, 0xBE, 0xEF}},
+                       FirmwareFileRegionElem{0x2120, {0xAA, 0xBB, 0xCC}}});
+    auto &eeprom = fw.emplace_back(pic18q20map::eeprom_region_v);
+    eeprom.elems.assign({FirmwareFileRegionElem{0x380000, {0x11, 0x22}}});
+    programmer.program_verify(fw);
+  }
+  REQUIRE_FALSE(icsp.programming());
+  REQUIRE(in_state<IDLE>(objs.pic->state()));
+
+  REQUIRE(objs.pic->buffer()[0] == 0xDE);
+  REQUIRE(objs.pic->buffer()[3] == 0xEF);
+  REQUIRE(objs.pic->buffer()[0x2122] == 0xCC);
+  REQUIRE(objs.pic->buffer()[0x2123] == 0xFF);
+  REQUIRE(objs.pic->buffer()[0x380000] == 0x11);
+  REQUIRE(objs.pic->buffer()[0x380001] == 0x22);
+}
+
+TEST_CASE("I/O worker reports verify failures on sync", "[worker]") {
+  auto objs = setup();
+  auto gpio = std::make_shared<StuckDataGPIO>(objs.gpio);
+  auto icsp = ICSPHeader(gpio);
+  ICSPWorker worker(icsp);
+  auto prog = worker.enter_programming();
+  const std::vector<std::uint8_t> data{0x12, 0x34, 0x56, 0x78};
+
+  worker.write_verify(pic18fq20, 0x100, data.begin(), data.end());
+  REQUIRE_NOTHROW(worker.sync());
+
+  gpio->stuck = true;
+  const std::vector<std::uint8_t> big(1024, 0x5A);
+  // thrown by write_verify if the failure arrives while it's queueing
+  REQUIRE_THROWS_WITH(
+      (worker.write_verify(pic18fq20, 0x200, big.begin(), big.end()),
+       worker.sync()),
+      Catch::Matchers::ContainsSubstring("0x000200"));
+  // nothing is programmed after the first failed word
+  REQUIRE(objs.pic->buffer()[0x202] == 0xFF);
+  REQUIRE(objs.pic->buffer()[0x200 + big.size() - 1] == 0xFF);
+  // the worker is usable again after the failure was reported
+  gpio->stuck = false;
+  std::array<std::uint8_t, 4> readback{};
+  worker.read_n(pic18fq20, 0x100, readback.begin(), readback.size());
+  REQUIRE(std::equal(readback.begin(), readback.end(), data.begin()));
+}
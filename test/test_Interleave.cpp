@@ -0,0 +1,134 @@
+#include <catch2/catch_all.hpp>
+
+#include <FimwareFile.hpp>
+#include <ICSP_pins.hpp>
+#include <InterleavedProgrammer.hpp>
+#include <PIC18-Q20.hpp>
+
+#include "test_utils.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <optional>
+#include <vector>
+
+namespace {
+// Targets sharing CLK and DATA, with their own MCLR and PROG_EN lines
+std::vector<ICSPPins> target_pins(std::size_t n) {
+  std::vector<ICSPPins> res;
+  for (IGPIO::port_id_t i = 0; i < n; ++i) {
+    ICSPPins pins{};
+    pins.prog_en_pin = 2 + i;
+    pins.mclr_pin = 20 + i;
+    res.push_back(pins);
+  }
+  return res;
+}
+
+struct Panel {
+  explicit Panel(std::size_t n)
+      : gpio(MockGPIO::Create()), pins{target_pins(n)} {
+    for (const auto &p : pins) {
+      pics.push_back(std::make_shared<MockPIC18Q20>(gpio.get(), p));
+    }
+  }
+  std::shared_ptr<MockGPIO> gpio;
+  std::vector<ICSPPins> pins;
+  std::vector<std::shared_ptr<MockPIC18Q20>> pics;
+};
+
+// Reads the DATA line of the target enabled by a given PROG_EN as 0
+struct FaultyGPIO final : IGPIO {
+  FaultyGPIO(std::shared_ptr<MockGPIO> gpio, port_id_t faulty_prog_en)
+      : gpio{std::move(gpio)}, faulty{faulty_prog_en} {}
+
+  void set_gpio_mode(port_id_t port, Modes mode, val_t initial) override {
+    levels[port] = initial;
+    gpio->set_gpio_mode(port, mode, initial);
+  }
+  void gpio_write(port_id_t port, val_t val) override {
+    levels[port] = val;
+    gpio->gpio_write(port, val);
+  }
+  val_t gpio_read(port_id_t port) override {
+    const auto val = gpio->gpio_read(port);
+    return levels[faulty] != 0 ? 0 : val;
+  }
+  void delay(std::chrono::microseconds d) override { gpio->delay(d); }
+  std::chrono::nanoseconds now() const override { return gpio->now(); }
+
+  std::shared_ptr<MockGPIO> gpio;
+  port_id_t faulty;
+  std::map<port_id_t, val_t> levels;
+};
+
+Firmware eeprom_firmware() {
+  Firmware fw;
+  auto &prog = fw.emplace_back(pic18q20map::program_region_v);
+  prog.elems.assign({FirmwareFileRegionElem{0, {0xDE, 0xAD, 0xBE, 0xEF}}});
+  auto &eeprom = fw.emplace_back(pic18q20map::eeprom_region_v);
+  eeprom.elems.assign({FirmwareFileRegionElem{
+      0x380000, {0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88}}});
+  return fw;
+}
+
+std::chrono::nanoseconds program_panel(std::size_t n) {
+  Panel panel{n};
+  InterleavedProgrammer programmer(pic18fq20, panel.gpio, panel.pins);
+  const auto start = panel.gpio->now();
+  programmer.program_verify(eeprom_firmware());
+  return panel.gpio->now() - start;
+}
+} // namespace
+
+TEST_CASE("Interleaved programming", "[ICSP][interleave]") {
+  SECTION("every target is programmed") {
+    Panel panel{3};
+    InterleavedProgrammer programmer(pic18fq20, panel.gpio, panel.pins);
+    REQUIRE(programmer.target_count() == 3);
+    REQUIRE_NOTHROW(programmer.program_verify(eeprom_firmware()));
+    for (auto &pic : panel.pics) {
+      REQUIRE(pic->buffer()[0] == 0xDE);
+      REQUIRE(pic->buffer()[3] == 0xEF);
+      REQUIRE(pic->buffer()[0x380000] == 0x11);
+      REQUIRE(pic->buffer()[0x380007] == 0x88);
+      REQUIRE(in_state<IDLE>(pic->state()));
+    }
+  }
+
+  SECTION("the t_PROG waits overlap") {
+    const auto one = program_panel(1);
+    const auto four = program_panel(4);
+    // sequential programming would take 4 times as long
+    REQUIRE(four < one * 3 / 2);
+  }
+
+  SECTION("a failed target doesn't stop the others") {
+    Panel panel{3};
+    auto gpio = std::make_shared<FaultyGPIO>(panel.gpio,
+                                             *panel.pins[1].prog_en_pin);
+    InterleavedProgrammer programmer(pic18fq20, gpio, panel.pins);
+    REQUIRE_THROWS_WITH(
+        programmer.program_verify(eeprom_firmware()),
+        Catch::Matchers::ContainsSubstring(
+            "Programming failed on 1 of 3 targets") &&
+            Catch::Matchers::ContainsSubstring("target 1 (MCLR pin 21)"));
+    REQUIRE(programmer.results()[0] == nullptr);
+    REQUIRE(programmer.results()[1] != nullptr);
+    REQUIRE(programmer.results()[2] == nullptr);
+    REQUIRE(panel.pics[2]->buffer()[0x380007] == 0x88);
+    for (auto &pic : panel.pics) {
+      REQUIRE(in_state<IDLE>(pic->state()));
+    }
+  }
+
+  SECTION("the targets must share CLK and DATA only") {
+    auto pins = target_pins(2);
+    pins[1].mclr_pin = pins[0].mclr_pin;
+    REQUIRE_THROWS_WITH(
+        InterleavedProgrammer(pic18fq20, MockGPIO::Create(), pins),
+        "Targets 0 and 1 share MCLR or PROG_EN lines");
+  }
+}
@@ -0,0 +1,132 @@
+#include <catch2/catch_all.hpp>
+
+#include <FimwareFile.hpp>
+#include <MultiHeaderProgrammer.hpp>
+#include <PIC18-Q20.hpp>
+
+#include "test_utils.hpp"
+
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+// A target whose DATA line reads inverted
+struct BrokenGPIO final : IGPIO {
+  explicit BrokenGPIO(std::shared_ptr<MockGPIO> gpio)
+      : gpio{std::move(gpio)} {}
+
+  void set_gpio_mode(port_id_t port, Modes mode, val_t initial) override {
+    gpio->set_gpio_mode(port, mode, initial);
+  }
+  void gpio_write(port_id_t port, val_t val) override {
+    gpio->gpio_write(port, val);
+  }
+  val_t gpio_read(port_id_t port) override {
+    return gpio->gpio_read(port) ^ 1U;
+  }
+  void delay(std::chrono::microseconds d) override { gpio->delay(d); }
+  std::chrono::nanoseconds now() const override { return gpio->now(); }
+
+  std::shared_ptr<MockGPIO> gpio;
+};
+
+// Independent headers, each with its own mocked GPIO and target
+struct Rig {
+  explicit Rig(std::size_t n) {
+    for (std::size_t i = 0; i < n; ++i) {
+      auto &objs = targets.emplace_back(setup());
+      objs.pic->buffer()[0x3FFFFE] = 0x40;
+      objs.pic->buffer()[0x3FFFFF] = 0x7a;
+      // the same pin numbers on separate mocked GPIOs
+      headers.push_back(ICSPPins{});
+    }
+  }
+
+  auto factory(std::optional<std::size_t> broken = std::nullopt) {
+    return [this, broken, next = std::size_t{0}](ICSPPins const &) mutable
+               -> IGPIO::Ptr {
+      const auto i = next++;
+      if (broken == i) {
+        return std::make_shared<BrokenGPIO>(targets[i].gpio);
+      }
+      return targets[i].gpio;
+    };
+  }
+
+  std::vector<TestObjects> targets;
+  std::vector<ICSPPins> headers;
+};
+
+std::shared_ptr<const Firmware> test_firmware() {
+  auto fw = std::make_shared<Firmware>();
+  auto &prog = fw->emplace_back(pic18q20map::program_region_v);
+  prog.elems.assign({FirmwareFileRegionElem{0, {0xDE, 0xAD, 0xBE, 0xEF}}});
+  auto &eeprom = fw->emplace_back(pic18q20map::eeprom_region_v);
+  eeprom.elems.assign({FirmwareFileRegionElem{0x380000, {0x11, 0x22}}});
+  return fw;
+}
+} // namespace
+
+TEST_CASE("Multi header programming", "[ICSP][multiheader]") {
+  SECTION("jobs from the shared queue") {
+    Rig rig{3};
+    MultiHeaderProgrammer programmer(pic18fq20, rig.headers, rig.factory());
+    REQUIRE(programmer.header_count() == 3);
+    const auto fw = test_firmware();
+    for (std::size_t i = 0; i < 3; ++i) {
+      programmer.submit({.operation = JobOperation::WRITE,
+                         .firmware = fw,
+                         .header = i,
+                         .name = "board"});
+    }
+    const auto id = programmer.submit({.operation = JobOperation::READ_ID});
+    const auto report = programmer.wait();
+
+    REQUIRE(report.results.size() == 4);
+    REQUIRE(report.failed() == 0);
+    for (std::size_t i = 0; i < 3; ++i) {
+      REQUIRE(report.results[i].header == i);
+      REQUIRE(report.results[i].name == "board");
+      auto &pic = *rig.targets[i].pic;
+      REQUIRE(pic.buffer()[3] == 0xEF);
+      REQUIRE(pic.buffer()[0x380001] == 0x22);
+      REQUIRE(in_state<IDLE>(pic.state()));
+    }
+    REQUIRE(report.results[id].device_id->deviceId == 0x7a40);
+
+    // the next round starts with an empty report
+    programmer.submit({.operation = JobOperation::ERASE,
+                       .erase = Address::Region::EEPROM,
+                       .header = 1});
+    const auto erased = programmer.wait();
+    REQUIRE(erased.results.size() == 1);
+    REQUIRE(erased.results[0].ok());
+    REQUIRE(rig.targets[1].pic->buffer()[0x380001] == 0xFF);
+    REQUIRE(rig.targets[0].pic->buffer()[0x380001] == 0x22);
+  }
+
+  SECTION("failures are reported per job") {
+    Rig rig{2};
+    MultiHeaderProgrammer programmer(pic18fq20, rig.headers, rig.factory(1));
+    const auto fw = test_firmware();
+    programmer.submit(
+        {.operation = JobOperation::WRITE, .firmware = fw, .header = 0});
+    programmer.submit(
+        {.operation = JobOperation::WRITE, .firmware = fw, .header = 1});
+    const auto report = programmer.wait();
+    REQUIRE(report.failed() == 1);
+    REQUIRE(report.results[0].ok());
+    REQUIRE_THROWS_WITH(
+        std::rethrow_exception(report.results[1].error),
+        Catch::Matchers::ContainsSubstring("Programming error at address"));
+    REQUIRE(rig.targets[0].pic->buffer()[3] == 0xEF);
+  }
+
+  SECTION("invalid jobs are rejected") {
+    Rig rig{1};
+    MultiHeaderProgrammer programmer(pic18fq20, rig.headers, rig.factory());
+    REQUIRE_THROWS_AS(programmer.submit({.header = 1}), std::out_of_range);
+    REQUIRE_THROWS_WITH(programmer.submit({}), "Write job without firmware");
+  }
+}
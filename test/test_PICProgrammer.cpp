@@ -8,6 +8,8 @@
 #include "Region.hpp"
 #include "test_utils.hpp"
 
+#include <type_traits>
+
 TEST_CASE("Reading device IDs API", "[PICProgrammer]") {
 
   auto objs = setup();
@@ -148,4 +150,26 @@ TEST_CASE("Program Verify API", "[PICProgrammer]") {
   REQUIRE(objs.pic->buffer()[0x00300017] == 0xFF);
   REQUIRE(objs.pic->buffer()[0x00300018] == 0xDE);
   REQUIRE(objs.pic->buffer()[0x00300019] == 0xAD);
-}
\ No newline at end of file
+}
+TEST_CASE("Statically dispatched header with mock backend",
+          "[PICProgrammer]") {
+  auto objs = setup();
+  objs.pic->buffer()[0x3FFFFC] = 0xDE;
+  objs.pic->buffer()[0x3FFFFD] = 0xAD;
+  auto icsp = BasicICSPHeader<MockGPIO>(objs.gpio);
+  PICProgrammer programmer(pic18fq20, icsp);
+  static_assert(std::is_same_v<
+                decltype(programmer),
+                PICProgrammer<std::remove_cvref_t<decltype(pic18fq20)>,
+                              BasicICSPHeader<MockGPIO>>>);
+
+  REQUIRE(programmer.read_device_id().revisionId == 0xADDE);
+
+  Firmware fw;
+  auto &prog = fw.emplace_back(pic18q20map::program_region_v);
+  prog.elems.assign({FirmwareFileRegionElem{0x100, {0x12, 0x34, 0x56, 0x78}}});
+  programmer.program_verify(fw);
+
+  REQUIRE(objs.pic->buffer()[0x100] == 0x12);
+  REQUIRE(objs.pic->buffer()[0x103] == 0x78);
+}
@@ -0,0 +1,65 @@
+#include <catch2/catch_all.hpp>
+
+#include <ICSP_header.hpp>
+#include <PIC18-Q20.hpp>
+#include <Progress.hpp>
+
+#include "test_utils.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+TEST_CASE("Progress rate and ETA", "[progress]") {
+  ProgressMeter meter(1000);
+
+  auto p = meter.update(0, 0s);
+  REQUIRE(p.rate == 0);
+  REQUIRE_FALSE(p.eta);
+  REQUIRE(p.fraction() == 0);
+
+  p = meter.update(100, 1s);
+  REQUIRE(p.rate == Catch::Approx(100));
+  REQUIRE(p.eta == 9s);
+  REQUIRE(p.elapsed == 1s);
+
+  // the rate follows the changes smoothly
+  p = meter.update(400, 2s);
+  REQUIRE(p.rate > 100);
+  REQUIRE(p.rate < 300);
+
+  p = meter.update(1000, 3s);
+  REQUIRE(p.fraction() == 1);
+  REQUIRE(p.eta == 0s);
+}
+
+TEST_CASE("Progress reports are aggregated", "[progress]") {
+  std::mutex mutex;
+  std::vector<ProgressSnapshot> reports;
+  constexpr std::size_t TOTAL = 64;
+  {
+    ProgressReporter reporter(TOTAL,
+                              [&](const ProgressSnapshot &p) {
+                                std::lock_guard lock{mutex};
+                                reports.push_back(p);
+                              },
+                              {.every_bytes = 16, .interval = 1h});
+    auto objs = setup();
+    auto icsp = ICSPHeader(objs.gpio);
+    auto prog = icsp.enter_programming();
+    std::vector<std::uint8_t> data(TOTAL, 0xA5);
+    icsp.write(pic18fq20, pic18q20map::eeprom_region_v.start, data.begin(),
+               data.end(), &reporter);
+    REQUIRE(reporter.done() == TOTAL);
+  }
+  // one report per word would be 64
+  REQUIRE(reports.size() <= TOTAL / 16 + 1);
+  REQUIRE(reports.back().done == TOTAL);
+  REQUIRE(reports.back().total == TOTAL);
+  for (std::size_t i = 1; i < reports.size(); ++i) {
+    REQUIRE(reports[i - 1].done <= reports[i].done);
+  }
+}
@@ -0,0 +1,135 @@
+#include <catch2/catch_all.hpp>
+
+#include <ICSP_header.hpp>
+#include <PIC18-Q20.hpp>
+#include <RawImage.hpp>
+
+#include "test_utils.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace {
+Firmware test_firmware() {
+  Firmware fw;
+  auto &prog = fw.emplace_back(pic18q20map::program_region_v);
+  prog.elems.assign({FirmwareFileRegionElem{0, {0xDE, 0xAD, 0xBE, 0xEF}},
+                     FirmwareFileRegionElem{0x100, {0x12, 0x34}}});
+  auto &eeprom = fw.emplace_back(pic18q20map::eeprom_region_v);
+  eeprom.elems.assign({FirmwareFileRegionElem{0x380010, {0x11, 0x22, 0x33}}});
+  return fw;
+}
+
+std::string dump(Firmware const &fw) {
+  std::ostringstream os;
+  RawImage::Dumper dumper(os);
+  dumper.dump_start();
+  dumper.dump_firmware(fw);
+  dumper.dump_end();
+  return os.str();
+}
+} // namespace
+
+TEST_CASE("Raw binary images", "[rawimage]") {
+  SECTION("CRC-32") {
+    constexpr std::string_view check = "123456789";
+    const std::span data(reinterpret_cast<const uint8_t *>(check.data()),
+                         check.size());
+    REQUIRE(RawImage::crc32(data) == 0xCBF43926);
+    REQUIRE(RawImage::crc32(data.subspan(4), RawImage::crc32(data.first(4))) ==
+            0xCBF43926);
+  }
+
+  SECTION("round trip") {
+    const auto fw = test_firmware();
+    const auto image = dump(fw);
+    REQUIRE(image.starts_with("PICIMG"));
+    REQUIRE(image.size() == RawImage::file_header_size +
+                                4 * RawImage::region_header_size + 9);
+    const auto loaded = RawImage::parse_image(pic18fq20, image);
+    REQUIRE(loaded.size() == 2);
+    for (std::size_t i = 0; i < fw.size(); ++i) {
+      REQUIRE(loaded[i].region.name == fw[i].region.name);
+      REQUIRE(loaded[i].elems.size() == fw[i].elems.size());
+      for (std::size_t j = 0; j < fw[i].elems.size(); ++j) {
+        REQUIRE(loaded[i].elems[j].base_addr == fw[i].elems[j].base_addr);
+        REQUIRE(loaded[i].elems[j].data == fw[i].elems[j].data);
+      }
+    }
+  }
+
+  SECTION("device dumps") {
+    auto objs = setup();
+    objs.pic->buffer()[0x380000] = 0x5A;
+    objs.pic->buffer()[0x3800FF] = 0xA5;
+    auto icsp = ICSPHeader(objs.gpio);
+    auto prog = icsp.enter_programming();
+    auto eeprom = icsp.read_region(pic18q20map::eeprom_region);
+    std::ostringstream os;
+    RawImage::Dumper dumper(os);
+    dumper.dump_start();
+    dumper.dump_region(Address::Region::EEPROM, std::span{eeprom.data});
+    dumper.dump_end();
+    const auto loaded = RawImage::parse_image(pic18fq20, os.str());
+    REQUIRE(loaded.size() == 1);
+    REQUIRE(loaded[0].elems[0].base_addr == 0x380000);
+    REQUIRE(loaded[0].elems[0].data.size() == 0x100);
+    REQUIRE(loaded[0].elems[0].data.front() == 0x5A);
+    REQUIRE(loaded[0].elems[0].data.back() == 0xA5);
+  }
+
+  SECTION("invalid images") {
+    auto image = dump(test_firmware());
+    REQUIRE_THROWS_WITH(RawImage::parse_image(pic18fq20, "PICIM"),
+                        "Not a raw firmware image");
+    REQUIRE_THROWS_WITH(
+        RawImage::parse_image(pic18fq20,
+                              image.substr(0, image.size() - 1)),
+        "Truncated raw image");
+    REQUIRE_THROWS_WITH(
+        RawImage::parse_image(pic18fq20, image.substr(0, 40)),
+        "Truncated raw image");
+
+    auto corrupt = image;
+    corrupt[RawImage::file_header_size + RawImage::region_header_size] ^= 1;
+    REQUIRE_THROWS_WITH(
+        RawImage::parse_image(pic18fq20, corrupt),
+        "CRC mismatch of the PROGRAM region in raw image");
+
+    auto version = image;
+    version[6] = 2;
+    REQUIRE_THROWS_WITH(RawImage::parse_image(pic18fq20, version),
+                        "Unsupported raw image version 2");
+
+    auto unknown = image;
+    unknown.replace(RawImage::file_header_size, 7, "FLASH\0\0", 7);
+    REQUIRE_THROWS_WITH(RawImage::parse_image(pic18fq20, unknown),
+                        "Unknown region 'FLASH' in raw image");
+
+    std::ostringstream os;
+    RawImage::Dumper dumper(os);
+    dumper.dump_start();
+    dumper.dump_data(Address::Region::EEPROM, 0x3800FF,
+                     std::vector<uint8_t>{1, 2});
+    dumper.dump_end();
+    REQUIRE_THROWS_WITH(
+        RawImage::parse_image(pic18fq20, os.str()),
+        "Image data out of the EEPROM region at 0x003800ff (2 bytes)");
+  }
+
+  SECTION("files and streams") {
+    const auto image = dump(test_firmware());
+    TempPath tmp("image.bin");
+    std::ofstream(tmp.path, std::ios::binary) << image;
+    const auto fw = RawImage::load_image_file(pic18fq20, tmp.path);
+    std::istringstream is(image);
+    const auto streamed = RawImage::parse_image_stream(pic18fq20, is);
+    REQUIRE(fw.size() == 2);
+    REQUIRE(fw[1].elems[0].data == streamed[1].elems[0].data);
+  }
+}
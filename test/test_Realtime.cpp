@@ -0,0 +1,89 @@
+#include <catch2/catch_all.hpp>
+
+#include <Realtime.hpp>
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+namespace {
+auto current_sched() {
+  int policy{};
+  sched_param param{};
+  pthread_getschedparam(pthread_self(), &policy, &param);
+  return std::pair{policy, param.sched_priority};
+}
+
+auto current_affinity() {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  pthread_getaffinity_np(pthread_self(), sizeof(set), &set);
+  return set;
+}
+} // namespace
+
+TEST_CASE("Realtime session restores the thread settings", "[realtime]") {
+  const auto sched_before = current_sched();
+  const auto affinity_before = current_affinity();
+  {
+    // Without privileges some of the steps fail, that must not be fatal
+    RealtimeSession session;
+    if (session.cpu()) {
+      const auto affinity = current_affinity();
+      REQUIRE(CPU_COUNT(&affinity) == 1);
+      REQUIRE(CPU_ISSET(*session.cpu(), &affinity));
+    }
+    std::vector<std::uint8_t> buffer(64 * 1024, 0xFF);
+    RealtimeSession::prefault(buffer.data(), buffer.size());
+    RealtimeSession::prefault(nullptr, 0);
+  }
+  REQUIRE(current_sched() == sched_before);
+  const auto affinity_after = current_affinity();
+  REQUIRE(CPU_EQUAL(&affinity_after, &affinity_before));
+}
+
+TEST_CASE("Helper threads leave the real-time settings", "[realtime]") {
+  auto helper_settings = [] {
+    std::pair<int, int> sched{};
+    cpu_set_t affinity;
+    std::thread helper([&] {
+      RealtimeSession::reset_thread();
+      sched = current_sched();
+      affinity = current_affinity();
+    });
+    helper.join();
+    return std::pair{sched, affinity};
+  };
+
+  SECTION("the settings from before the session") {
+    const auto sched_before = current_sched();
+    const auto affinity_before = current_affinity();
+    RealtimeSession session;
+    const auto [sched, affinity] = helper_settings();
+    REQUIRE(sched == sched_before);
+    REQUIRE(CPU_EQUAL(&affinity, &affinity_before));
+  }
+
+  SECTION("nothing changes without a session") {
+    // e.g. started with taskset
+    const auto allowed = current_affinity();
+    cpu_set_t one;
+    CPU_ZERO(&one);
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+      if (CPU_ISSET(cpu, &allowed)) {
+        CPU_SET(cpu, &one);
+        break;
+      }
+    }
+    cpu_set_t affinity;
+    std::thread restricted([&] {
+      pthread_setaffinity_np(pthread_self(), sizeof(one), &one);
+      affinity = helper_settings().second;
+    });
+    restricted.join();
+    REQUIRE(CPU_EQUAL(&affinity, &one));
+  }
+}
@@ -0,0 +1,123 @@
+#include <catch2/catch_all.hpp>
+
+#include <ICSP_header.hpp>
+#include <IGPIO.hpp>
+#include <PIC18-Q20.hpp>
+#include <ShadowGPIO.hpp>
+
+#include "test_utils.hpp"
+
+#include <map>
+#include <memory>
+#include <vector>
+
+namespace {
+struct CountingGPIO : IGPIO {
+  void set_gpio_mode(port_id_t port, Modes mode, val_t initial) override {
+    ++mode_changes;
+    levels[port] = initial;
+  }
+  void gpio_write(port_id_t gpio, val_t val) override {
+    ++writes;
+    levels[gpio] = val;
+  }
+  val_t gpio_read(port_id_t gpio) override { return levels[gpio]; }
+  void gpio_write_many(std::span<const port_id_t> ports,
+                       std::span<const val_t> vals) override {
+    ++bank_writes;
+    IGPIO::gpio_write_many(ports, vals);
+  }
+  void delay(std::chrono::microseconds) override {}
+
+  std::size_t writes{};
+  std::size_t bank_writes{};
+  std::size_t mode_changes{};
+  std::map<port_id_t, val_t> levels;
+};
+} // namespace
+
+TEST_CASE("Shadow GPIO elides redundant writes", "[shadowgpio]") {
+  auto counting = std::make_shared<CountingGPIO>();
+  ShadowGPIO gpio(counting);
+
+  gpio.set_gpio_mode(1, IGPIO::Modes::OUTPUT, 0);
+  REQUIRE(counting->mode_changes == 1);
+
+  gpio.gpio_write(1, 0);
+  gpio.gpio_write(1, 0);
+  REQUIRE(counting->writes == 0);
+  REQUIRE(gpio.stats().suppressed_writes == 2);
+
+  gpio.gpio_write(1, 1);
+  gpio.gpio_write(1, 5);
+  REQUIRE(counting->writes == 1);
+  REQUIRE(counting->levels[1] == 1);
+
+  SECTION("same mode with new level becomes a plain write") {
+    gpio.set_gpio_mode(1, IGPIO::Modes::OUTPUT, 0);
+    REQUIRE(counting->mode_changes == 1);
+    REQUIRE(counting->writes == 2);
+    REQUIRE(counting->levels[1] == 0);
+    REQUIRE(gpio.stats().suppressed_mode_changes == 1);
+    // the level is part of the mode change, not a write of the caller
+    REQUIRE(gpio.stats().writes == 4);
+    REQUIRE(gpio.stats().suppressed_writes == 3);
+  }
+
+  SECTION("mode change forgets the level") {
+    gpio.set_gpio_mode(1, IGPIO::Modes::INPUT);
+    gpio.set_gpio_mode(1, IGPIO::Modes::OUTPUT, 1);
+    REQUIRE(counting->mode_changes == 3);
+    gpio.gpio_write(1, 1);
+    REQUIRE(counting->writes == 1);
+  }
+
+  SECTION("invalidate forwards the next write") {
+    gpio.invalidate();
+    gpio.gpio_write(1, 1);
+    REQUIRE(counting->writes == 2);
+  }
+
+  SECTION("bank writes only forward the changed lines") {
+    constexpr auto passed = ShadowGPIO::MAX_SHADOWED_PINS;
+    gpio.set_gpio_mode(2, IGPIO::Modes::OUTPUT, 0);
+    const IGPIO::port_id_t ports[] = {1, 2, passed};
+    gpio.gpio_write_many(ports, std::vector<IGPIO::val_t>{1, 0, 1});
+    REQUIRE(counting->bank_writes == 1);
+    REQUIRE(counting->writes == 2);
+    REQUIRE(gpio.stats().suppressed_writes == 5);
+
+    gpio.gpio_write_many(std::span(ports, 2), std::vector<IGPIO::val_t>{1, 0});
+    REQUIRE(counting->bank_writes == 1);
+
+    gpio.gpio_write_many(std::span(ports, 2), std::vector<IGPIO::val_t>{1, 1});
+    REQUIRE(counting->bank_writes == 2);
+    REQUIRE(counting->writes == 3);
+    REQUIRE(counting->levels[2] == 1);
+    gpio.gpio_write(2, 1);
+    REQUIRE(counting->writes == 3);
+  }
+
+  SECTION("pins out of the shadowed range are passed through") {
+    constexpr auto port = ShadowGPIO::MAX_SHADOWED_PINS;
+    gpio.set_gpio_mode(port, IGPIO::Modes::OUTPUT, 0);
+    gpio.gpio_write(port, 0);
+    gpio.gpio_write(port, 0);
+    REQUIRE(counting->writes == 3);
+  }
+}
+
+TEST_CASE("Shadow GPIO keeps the ICSP protocol intact", "[shadowgpio]") {
+  auto objs = setup();
+  auto shadow = std::make_shared<ShadowGPIO>(objs.gpio);
+  auto icsp = ICSPHeader(shadow);
+  auto prog = icsp.enter_programming();
+  std::vector<uint8_t> data{0xFF, 0xFF, 0x00, 0x00, 0xF0, 0x0F, 0xDE, 0xAD};
+  icsp.write_verify(pic18fq20, 0x100, data.begin(), data.end());
+
+  for (std::size_t i = 0; i < data.size(); ++i) {
+    REQUIRE(objs.pic->buffer()[0x100 + i] == data[i]);
+  }
+  REQUIRE(shadow->stats().suppressed_writes > 0);
+  REQUIRE(shadow->stats().suppressed_mode_changes > 0);
+}
@@ -0,0 +1,152 @@
+#include <catch2/catch_all.hpp>
+
+#include <ICSP_header.hpp>
+#include <IntelHex.hpp>
+#include <PIC18-Q20.hpp>
+
+#include "test_utils.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <numeric>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Counts the allocations of the whole test binary, so that the steady state
+// of the programming loop can be checked to be allocation free
+namespace {
+std::atomic<std::size_t> s_allocations{0};
+
+void *counted_alloc(std::size_t size) {
+  s_allocations.fetch_add(1, std::memory_order_relaxed);
+  if (auto *p = std::malloc(size == 0 ? 1 : size); p) {
+    return p;
+  }
+  throw std::bad_alloc{};
+}
+
+void *counted_aligned_alloc(std::size_t size, std::align_val_t align) {
+  s_allocations.fetch_add(1, std::memory_order_relaxed);
+  const auto alignment = static_cast<std::size_t>(align);
+  // aligned_alloc needs the size to be a multiple of the alignment
+  const auto rounded = (size + alignment - 1) / alignment * alignment;
+  if (auto *p = std::aligned_alloc(alignment, rounded == 0 ? alignment
+                                                           : rounded);
+      p) {
+    return p;
+  }
+  throw std::bad_alloc{};
+}
+
+std::size_t allocations() {
+  return s_allocations.load(std::memory_order_relaxed);
+}
+} // namespace
+
+void *operator new(std::size_t size) { return counted_alloc(size); }
+void *operator new[](std::size_t size) { return counted_alloc(size); }
+void *operator new(std::size_t size, std::align_val_t align) {
+  return counted_aligned_alloc(size, align);
+}
+void *operator new[](std::size_t size, std::align_val_t align) {
+  return counted_aligned_alloc(size, align);
+}
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete[](void *p) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void *p, std::size_t) noexcept { std::free(p); }
+void operator delete(void *p, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void *p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t, std::align_val_t) noexcept {
+  std::free(p);
+}
+void operator delete[](void *p, std::size_t, std::align_val_t) noexcept {
+  std::free(p);
+}
+
+TEST_CASE("Steady state transactions don't allocate", "[ICSP][alloc]") {
+  auto objs = setup();
+  auto icsp = ICSPHeader(objs.gpio);
+  auto prog = icsp.enter_programming();
+  const std::vector<std::uint8_t> data{0xde, 0xad, 0xbe, 0xef};
+  std::array<std::uint8_t, 4> readback{};
+  constexpr auto EEPROM = pic18q20map::eeprom_region_v.start;
+  constexpr auto PROGRAM = pic18q20map::program_region_v.start;
+
+  auto transactions = [&](std::uint32_t offset) {
+    icsp.write(pic18fq20, EEPROM + offset, data.begin(), data.end());
+    icsp.write_verify(pic18fq20, PROGRAM + offset, data.begin(), data.end());
+    icsp.read_n(pic18fq20, PROGRAM + offset, readback.begin(),
+                readback.size());
+  };
+  // warms up the coroutine frame pool and the scheduler queues
+  transactions(0);
+
+  std::size_t write{}, write_verify{}, read{};
+  for (std::uint32_t offset = 4; offset < 64; offset += 4) {
+    auto before = allocations();
+    icsp.write(pic18fq20, EEPROM + offset, data.begin(), data.end());
+    write += allocations() - before;
+
+    before = allocations();
+    icsp.write_verify(pic18fq20, PROGRAM + offset, data.begin(), data.end());
+    write_verify += allocations() - before;
+
+    before = allocations();
+    icsp.read_n(pic18fq20, PROGRAM + offset, readback.begin(),
+                readback.size());
+    read += allocations() - before;
+  }
+  REQUIRE(write == 0);
+  REQUIRE(write_verify == 0);
+  REQUIRE(read == 0);
+  REQUIRE(readback == std::array<std::uint8_t, 4>{0xde, 0xad, 0xbe, 0xef});
+  REQUIRE(objs.pic->buffer()[EEPROM + 60] == 0xde);
+}
+
+TEST_CASE("Hex parsing allocates per run, not per record",
+          "[intelhex][alloc]") {
+  std::vector<std::uint8_t> data(pic18q20map::program_region_v.size());
+  std::iota(data.begin(), data.end(), std::uint8_t{0});
+
+  auto parse = [](std::string const &text) {
+    const auto before = allocations();
+    auto fw = IntelHex::parse_hex_buffer(pic18fq20, text);
+    return std::pair{allocations() - before, std::move(fw)};
+  };
+
+  SECTION("the records in order") {
+    std::ostringstream os;
+    IntelHex::Dumper dumper(os);
+    dumper.dump_data_memory(0, data);
+    dumper.dump_end();
+    const auto [count, fw] = parse(os.str());
+    REQUIRE(fw[0].elems.size() == 1);
+    REQUIRE(std::ranges::equal(fw[0].elems[0].data, data));
+    // 4096 records, the run grows geometrically
+    REQUIRE(count < 64);
+  }
+
+  SECTION("sparse records in reverse order") {
+    constexpr std::size_t runs = 1024;
+    std::ostringstream os;
+    IntelHex::Dumper dumper(os);
+    for (auto i = runs; i-- > 0;) {
+      dumper.dump_data_line(static_cast<std::uint16_t>(i * 32),
+                            std::span(data).subspan(i * 32, 16));
+    }
+    dumper.dump_end();
+    const auto [count, fw] = parse(os.str());
+    REQUIRE(fw[0].elems.size() == runs);
+    // a map node per run, the data is in the arena
+    REQUIRE(count < runs + 64);
+    REQUIRE(fw.arena_count() == 1);
+  }
+}
@@ -1,11 +1,27 @@
 #include <catch2/catch_all.hpp>
 
+#include "FirmwareBuilder.hpp"
 #include "IntelHex.hpp"
 #include "PIC18-Q20.hpp"
 #include "Region.hpp"
 
+#include "test_utils.hpp"
+
+#include <algorithm>
+#include <array>
 #include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <memory_resource>
+#include <numeric>
 #include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/stat.h>
+
+#include <fmt/format.h>
 
 TEST_CASE("int parsing", "[intelhex]") {
   using namespace std::literals;
@@ -65,6 +81,56 @@ TEST_CASE("Checksum defect driven test 1", "[intelhex]") {
   REQUIRE(res->payload.second.at(0) == 0x18);
 }
 
+TEST_CASE("Hex digit decoding", "[intelhex]") {
+  // long enough for the vectorized path and a scalar tail
+  std::string hex;
+  std::vector<uint8_t> expected;
+  uint8_t expected_sum{};
+  for (unsigned i = 0; i < 255; ++i) {
+    const auto byte = static_cast<uint8_t>(i * 37 + 11);
+    hex += i % 2 ? fmt::format("{:02x}", byte) : fmt::format("{:02X}", byte);
+    expected.push_back(byte);
+    expected_sum += byte;
+  }
+  std::array<uint8_t, 256> out{};
+
+  SECTION("valid digits") {
+    const auto sum = IntelHex::decode_hex(hex, out.data());
+    REQUIRE(sum == expected_sum);
+    REQUIRE(std::equal(expected.begin(), expected.end(), out.begin()));
+  }
+
+  SECTION("invalid digits") {
+    for (const auto pos : {0UL, 17UL, 31UL, 32UL, 200UL, 509UL}) {
+      for (const char c : {'g', 'G', ':', '/', '@', '`', ' ', '\x80'}) {
+        auto bad = hex;
+        bad[pos] = c;
+        REQUIRE_FALSE(IntelHex::decode_hex(bad, out.data()));
+      }
+    }
+    REQUIRE_FALSE(IntelHex::decode_hex("ABC", out.data()));
+  }
+}
+
+TEST_CASE("Invalid hex lines", "[intelhex]") {
+  using IntelHex::parse_hex_line;
+  REQUIRE_THROWS_WITH(parse_hex_line("1023A8001551DA"),
+                      "Invalid line in hex file:1023A8001551DA");
+  REQUIRE_THROWS_WITH(parse_hex_line(":012FE80018D"),
+                      "Invalid line in hex file::012FE80018D");
+  REQUIRE_THROWS_WITH(parse_hex_line(":012FE800\r"),
+                      "Invalid line in hex file::012FE800");
+  REQUIRE_THROWS_WITH(parse_hex_line(":012FE8X018D0"),
+                      "Invalid line in hex file::012FE8X018D0");
+  REQUIRE_THROWS_WITH(parse_hex_line(":012FE80518D0"), "Unhandled RecordType");
+  REQUIRE_THROWS_WITH(parse_hex_line(":012FE80018D1"),
+                      "Invalid checksum (0x01) on line :012FE80018D1");
+  // longer than the longest record
+  const auto too_long = ":FF000000" + std::string(2 * 256 + 2, '0');
+  REQUIRE_THROWS_WITH(parse_hex_line(too_long),
+                      "Invalid line in hex file:" + too_long);
+}
+
 TEST_CASE("Hex file basic parsing", "[intelhex]") {
 
   std::istringstream iss(R"-(:0400000055EF00F0C8
@@ -203,6 +269,341 @@ TEST_CASE("test dump memory to intel hex", "[utils][dump_memory]") {
   }
 }
 
+namespace {
+const auto small_hex = ":0400000055EF00F0C8\r\n"
+                       ":012FE80018D0\r\n"
+                       ":020000040030CA\n"
+                       ":02001800FFFFE8\n"
+                       ":00000001FF";
+
+void require_small_hex(Firmware const &fw) {
+  REQUIRE(fw.size() == 2);
+  REQUIRE(fw[0].elems[0].data == byte_vector{0x55, 0xEF, 0x00, 0xF0});
+  REQUIRE(fw[0].elems[1].base_addr == 0x2FE8);
+  REQUIRE(fw[1].elems[0].base_addr == 0x300018);
+  REQUIRE(fw[1].elems[0].data == byte_vector{0xFF, 0xFF});
+}
+} // namespace
+
+TEST_CASE("Hex input sources", "[intelhex]") {
+  SECTION("buffers are split like streams") {
+    IntelHex::LineReader lines{"a\r\n\nb"};
+    REQUIRE(lines.next() == "a\r");
+    REQUIRE(lines.next() == "");
+    REQUIRE(lines.next() == "b");
+    REQUIRE_FALSE(lines.next());
+    require_small_hex(IntelHex::parse_hex_buffer(pic18fq20, small_hex));
+    REQUIRE_THROWS_WITH(
+        IntelHex::parse_hex_buffer(pic18fq20, ":012FE80018D0\n\n"),
+        "Invalid line in hex file:");
+    REQUIRE_THROWS_WITH(
+        IntelHex::parse_hex_buffer(pic18fq20, ":012FE80018D0\n"),
+        "End-of-file missing from hex file");
+  }
+
+  SECTION("regular files are mapped") {
+    TempPath tmp("small.hex");
+    std::ofstream(tmp.path) << small_hex;
+    const auto mapped = MappedFile::map(tmp.path);
+    REQUIRE(mapped);
+    REQUIRE(mapped->view() == small_hex);
+    require_small_hex(IntelHex::load_hex_file(pic18fq20, tmp.path));
+  }
+
+  SECTION("pipes are streamed") {
+    TempPath tmp("small.fifo");
+    REQUIRE(::mkfifo(tmp.path.c_str(), 0600) == 0);
+    // doesn't wait for a writer
+    REQUIRE_FALSE(MappedFile::map(tmp.path));
+    std::thread writer{[&] { std::ofstream(tmp.path) << small_hex; }};
+    require_small_hex(IntelHex::load_hex_file(pic18fq20, tmp.path));
+    writer.join();
+  }
+
+  SECTION("missing files") {
+    REQUIRE_THROWS_AS(MappedFile::map("/nonexistent/fw.hex"),
+                      std::system_error);
+  }
+}
+
+namespace {
+std::string hex_record(uint16_t addr, uint8_t type,
+                       std::vector<uint8_t> const &data) {
+  auto line = fmt::format(":{:02X}{:04X}{:02X}", data.size(), addr, type);
+  uint8_t sum = data.size() + (addr >> 8) + (addr & 0xFF) + type;
+  for (const auto byte : data) {
+    line += fmt::format("{:02X}", byte);
+    sum += byte;
+  }
+  return line + fmt::format("{:02X}\n", static_cast<uint8_t>(-sum));
+}
+
+// Many segments in the program and EEPROM regions, out of address order
+std::string segmented_hex(std::size_t segments) {
+  std::string text;
+  for (std::size_t i = 0; i < segments; ++i) {
+    const bool eeprom = i % 10 == 9;
+    const uint16_t prefix = eeprom ? 0x0038 : 0x0000;
+    text += hex_record(0, 4, {static_cast<uint8_t>(prefix >> 8),
+                              static_cast<uint8_t>(prefix & 0xFF)});
+    // 7 and 64 are coprimes: distinct 32 byte slots in the program region
+    const auto addr =
+        static_cast<uint16_t>(eeprom ? i / 10 * 32 : i * 7 % 64 * 32);
+    for (uint16_t line = 0; line < 2; ++line) {
+      std::vector<uint8_t> data(16);
+      std::iota(data.begin(), data.end(), static_cast<uint8_t>(i + line));
+      text += hex_record(addr + line * 16, 0, data);
+    }
+  }
+  return text;
+}
+
+void require_same(Firmware const &a, Firmware const &b) {
+  REQUIRE(a.size() == b.size());
+  for (std::size_t i = 0; i < a.size(); ++i) {
+    REQUIRE(a[i].region.name == b[i].region.name);
+    REQUIRE(a[i].base_addr == b[i].base_addr);
+    REQUIRE(a[i].elems.size() == b[i].elems.size());
+    for (std::size_t j = 0; j < a[i].elems.size(); ++j) {
+      REQUIRE(a[i].elems[j].base_addr == b[i].elems[j].base_addr);
+      REQUIRE(a[i].elems[j].data == b[i].elems[j].data);
+    }
+  }
+}
+} // namespace
+
+TEST_CASE("Parallel hex parsing", "[intelhex]") {
+  using IntelHex::parse_hex_buffer;
+  using IntelHex::parse_hex_buffer_parallel;
+  const IntelHex::ParallelOptions opts{.threads = 4, .min_chunk_size = 200};
+  auto text = segmented_hex(60);
+
+  SECTION("split at the line boundaries") {
+    const auto chunks = IntelHex::split_hex_chunks(text, 200);
+    REQUIRE(chunks.size() > 4);
+    std::string joined;
+    for (const auto &chunk : chunks) {
+      REQUIRE(chunk.text.starts_with(":"));
+      REQUIRE(chunk.text.ends_with("\n"));
+      // the extended address record before the chunk
+      const auto start = joined.size();
+      const auto ext =
+          start == 0 ? text.npos : text.rfind(":02000004", start - 1);
+      const auto expected =
+          ext == text.npos
+              ? uint32_t{0}
+              : static_cast<uint32_t>(
+                    std::stoul(text.substr(ext + 9, 4), nullptr, 16) << 16);
+      REQUIRE(chunk.base_addr == expected);
+      joined += chunk.text;
+    }
+    REQUIRE(joined == text);
+    REQUIRE(std::any_of(chunks.begin(), chunks.end(), [](auto const &c) {
+      return c.base_addr == 0x380000;
+    }));
+    REQUIRE(IntelHex::split_hex_chunks(text, text.size()).size() == 1);
+  }
+
+  SECTION("a single segment is split too") {
+    std::string flat = hex_record(0, 4, {0x00, 0x38});
+    for (uint16_t addr = 0; addr < 256; addr += 16) {
+      std::vector<uint8_t> data(16);
+      std::iota(data.begin(), data.end(), static_cast<uint8_t>(addr));
+      flat += hex_record(addr, 0, data);
+    }
+    flat += ":00000001FF\n";
+    const auto chunks = IntelHex::split_hex_chunks(flat, 200);
+    REQUIRE(chunks.size() > 2);
+    REQUIRE(chunks.back().base_addr == 0x380000);
+    const auto expected = parse_hex_buffer(pic18fq20, flat);
+    require_same(parse_hex_buffer_parallel(pic18fq20, flat, opts), expected);
+    REQUIRE(expected.size() == 1);
+    REQUIRE(expected[0].region.name == Address::Region::EEPROM);
+  }
+
+  SECTION("same result as the sequential parser") {
+    text += ":00000001FF\n";
+    const auto expected = parse_hex_buffer(pic18fq20, text);
+    REQUIRE(expected.size() == 2);
+    REQUIRE(expected[0].region.name == Address::Region::PROGRAM);
+    REQUIRE(expected[1].region.name == Address::Region::EEPROM);
+    require_same(parse_hex_buffer_parallel(pic18fq20, text, opts), expected);
+    require_same(parse_hex_buffer_parallel(pic18fq20, text, {.threads = 1}),
+                 expected);
+  }
+
+  SECTION("the records after the end of file are ignored") {
+    const auto eof = text.size();
+    text += ":00000001FF\n" + segmented_hex(30) + ":invalid\n";
+    const auto fw = parse_hex_buffer_parallel(pic18fq20, text, opts);
+    require_same(fw, parse_hex_buffer(pic18fq20, text.substr(0, eof + 12)));
+  }
+
+  SECTION("the first error is reported") {
+    // conflicting data in a segment in the middle of the file
+    const auto pos = text.find(":02000004", text.size() / 2);
+    text.insert(pos, hex_record(0, 4, {0, 0}) + hex_record(0, 0, {1, 2}) +
+                         hex_record(0, 0, {3}));
+    text += ":invalid\n";
+    // found on the line, or when merging if the chunks split the records
+    REQUIRE_THROWS_WITH(parse_hex_buffer_parallel(pic18fq20, text, opts),
+                        Catch::Matchers::ContainsSubstring(
+                            "conflicting data at linear addr: 0x00000000"));
+    REQUIRE_THROWS_WITH(parse_hex_buffer(pic18fq20, text),
+                        Catch::Matchers::ContainsSubstring(
+                            "Overlapping layout on line with addr:0x0000"));
+  }
+
+  SECTION("end of file missing") {
+    REQUIRE_THROWS_WITH(parse_hex_buffer_parallel(pic18fq20, text, opts),
+                        "End-of-file missing from hex file");
+    REQUIRE_THROWS_WITH(parse_hex_buffer_parallel(pic18fq20, "", opts),
+                        "End-of-file missing from hex file");
+  }
+}
+
+TEST_CASE("Out of order hex records", "[intelhex]") {
+  using IntelHex::parse_hex_buffer;
+  const auto bootloader = hex_record(0, 0, {0x01, 0x02, 0x03, 0x04}) +
+                          hex_record(4, 0, {0x05, 0x06});
+  const auto application = hex_record(0x10, 0, {0x11, 0x12}) +
+                           hex_record(0x06, 0, {0x07, 0x08}) +
+                           hex_record(0x08, 0, {0x09, 0x0A, 0x0B, 0x0C,
+                                                0x0D, 0x0E, 0x0F, 0x10});
+  const auto eeprom = hex_record(0, 4, {0x00, 0x38}) +
+                      hex_record(0, 0, {0xAA}) + hex_record(0, 4, {0, 0});
+
+  SECTION("the runs are coalesced") {
+    const auto fw =
+        parse_hex_buffer(pic18fq20, application + eeprom + bootloader +
+                                        ":00000001FF\n");
+    REQUIRE(fw.size() == 2);
+    REQUIRE(fw[0].region.name == Address::Region::PROGRAM);
+    REQUIRE(fw[0].elems.size() == 1);
+    REQUIRE(fw[0].elems[0].base_addr == 0);
+    byte_vector expected(0x12);
+    std::iota(expected.begin(), expected.end(), uint8_t{1});
+    REQUIRE(fw[0].elems[0].data == expected);
+    REQUIRE(fw[1].region.name == Address::Region::EEPROM);
+    REQUIRE(fw[1].base_addr == 0x380000);
+    REQUIRE(fw[1].elems[0].data == byte_vector{0xAA});
+  }
+
+  SECTION("the same data may overlap") {
+    const auto fw = parse_hex_buffer(
+        pic18fq20, bootloader + hex_record(2, 0, {0x03, 0x04, 0x05}) +
+                       bootloader + ":00000001FF\n");
+    REQUIRE(fw[0].elems.size() == 1);
+    REQUIRE(fw[0].elems[0].data ==
+            byte_vector{0x01, 0x02, 0x03, 0x04, 0x05, 0x06});
+  }
+
+  SECTION("conflicting data") {
+    REQUIRE_THROWS_WITH(
+        parse_hex_buffer(pic18fq20, application + bootloader +
+                                        hex_record(0x0E, 0, {0x0F, 0x00}) +
+                                        ":00000001FF\n"),
+        "Overlapping layout on line with addr:0x000e, conflicting data at "
+        "linear addr: 0x0000000f");
+    REQUIRE_THROWS_WITH(
+        IntelHex::parse_hex_image(pic18fq20,
+                                  application + hex_record(0x0F, 0, {0x00}) +
+                                      ":00000001FF\n"),
+        Catch::Matchers::ContainsSubstring("linear addr: 0x0000000f"));
+  }
+
+  SECTION("conflicts between the chunks of the parallel parser") {
+    const auto text = bootloader + hex_record(0, 4, {0, 0}) +
+                      hex_record(0, 0, {0x01, 0x00}) + ":00000001FF\n";
+    REQUIRE_THROWS_WITH(
+        IntelHex::parse_hex_buffer_parallel(
+            pic18fq20, text, {.threads = 2, .min_chunk_size = 1}),
+        "Overlapping layout, conflicting data at linear addr: 0x00000001");
+  }
+
+  SECTION("the records have to be in one region") {
+    REQUIRE_THROWS_WITH(
+        parse_hex_buffer(pic18fq20,
+                         hex_record(0xFFFE, 0, {0x01, 0x02, 0x03, 0x04}) +
+                             ":00000001FF\n"),
+        "Out of bounds data on line with addr:0xfffe, linear addr: "
+        "0x00010001");
+    REQUIRE_THROWS_WITH(
+        parse_hex_buffer(pic18fq20, hex_record(0, 4, {0x00, 0x10}) +
+                                        hex_record(0, 0, {0x01}) +
+                                        ":00000001FF\n"),
+        Catch::Matchers::ContainsSubstring("Out of bounds data"));
+  }
+}
+
+TEST_CASE("Firmware builder", "[intelhex]") {
+  const auto &program = pic18q20map::program_region_v;
+  FirmwareBuilder builder;
+  const byte_vector data{1, 2, 3, 4};
+  REQUIRE_FALSE(builder.add(program, 0x20, data));
+  REQUIRE_FALSE(builder.add(program, 0x10, data));
+  REQUIRE(builder.run_count() == 2);
+  // bridging the gap
+  REQUIRE_FALSE(builder.add(program, 0x14, byte_vector(12, 0xFF)));
+  REQUIRE(builder.run_count() == 1);
+  REQUIRE(builder.add(program, 0x22, byte_vector{3, 5}) == 0x23u);
+  // extending the run downwards
+  REQUIRE_FALSE(builder.add(program, 0x0C, byte_vector{9, 9, 9, 9, 1, 2}));
+  REQUIRE(builder.run_count() == 1);
+
+  FirmwareBuilder other;
+  REQUIRE_FALSE(other.add(pic18q20map::eeprom_region_v, 0x380000, data));
+  REQUIRE_FALSE(other.add(program, 0x24, byte_vector{5}));
+  REQUIRE_FALSE(builder.merge(std::move(other)));
+
+  const auto fw = std::move(builder).build();
+  REQUIRE(fw.size() == 2);
+  REQUIRE(fw[0].elems.size() == 1);
+  REQUIRE(fw[0].elems[0].base_addr == 0x0C);
+  REQUIRE(fw[0].elems[0].data.size() == 0x19);
+  REQUIRE(fw[0].elems[0].data[0x04] == 1);
+  REQUIRE(fw[0].elems[0].data[0x18] == 5);
+  REQUIRE(fw[1].elems[0].base_addr == 0x380000);
+
+  // moved builders keep their runs
+  FirmwareBuilder moved;
+  REQUIRE_FALSE(moved.add(program, 0, data));
+  FirmwareBuilder target;
+  REQUIRE_FALSE(target.add(program, 0x100, data));
+  target = std::move(moved);
+  REQUIRE_FALSE(target.add(program, 4, data));
+  REQUIRE(target.run_count() == 1);
+  REQUIRE(std::move(target).build()[0].elems[0].data.size() == 8);
+}
+
+TEST_CASE("Firmware arenas", "[intelhex]") {
+  FirmwareBuilder builder;
+  const byte_vector data{1, 2, 3, 4};
+  REQUIRE_FALSE(builder.add(pic18q20map::program_region_v, 0, data));
+  REQUIRE_FALSE(builder.add(pic18q20map::eeprom_region_v, 0x380000, data));
+  auto fw = std::move(builder).build();
+  REQUIRE(fw.arena_count() == 1);
+  const auto *arena = fw[0].elems[0].data.get_allocator().resource();
+  REQUIRE(arena != std::pmr::get_default_resource());
+  REQUIRE(fw[1].elems[0].data.get_allocator().resource() == arena);
+
+  SECTION("the copies are on the heap") {
+    const Firmware copy(fw);
+    REQUIRE(copy.arena_count() == 0);
+    REQUIRE(copy[0].elems[0].data.get_allocator().resource() ==
+            std::pmr::get_default_resource());
+    REQUIRE(copy[0].elems[0].data == fw[0].elems[0].data);
+  }
+
+  SECTION("the assigned Firmware takes the arena") {
+    Firmware target(fw);
+    target = std::move(fw);
+    REQUIRE(target.arena_count() == 1);
+    REQUIRE(target[0].elems[0].data.get_allocator().resource() == arena);
+    REQUIRE(target[1].elems[0].data == data);
+  }
+}
+
 TEST_CASE("parse hex file from reference output", "[intelhex]") {
   std::istringstream iss(R"-(:02000004002CCE
 :1000000032421161619113540000FFFFFFFFFFFFB7
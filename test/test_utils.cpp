@@ -2,6 +2,8 @@
 #include "Region.hpp"
 #include <catch2/catch_all.hpp>
 
+#include <ICSP_commands.hpp>
+#include <algorithm>
 #include <cstdint>
 #include <iostream>
 #include <utils.hpp>
@@ -121,4 +123,32 @@ TEST_CASE("detailed parse", "[utils][parse]") {
   std::span<uint8_t const, 6> dp(data);
   const auto res = std::make_tuple(detail::parse(dp.subspan<0, 2>()),
                                    detail::parse(dp.subspan<2, 4>()));
-}
\ No newline at end of file
+}
+TEST_CASE("ICSP command level tables", "[utils][commands]") {
+  using namespace ICSPCommands;
+  static_assert(command_levels(Command::LOAD_PC) ==
+                byte_levels_t{1, 0, 0, 0, 0, 0, 0, 0});
+  static_assert(command_levels(Command::BULK_ERASE) ==
+                byte_levels_t{0, 0, 0, 1, 1, 0, 0, 0});
+
+  // the payload tables must match the transmission format of write_cast
+  for (std::uint32_t val : {0u, 1u, 0xABCDu, 0x12'3456u, PAYLOAD_MAX}) {
+    const auto bytes = write_cast(val);
+    const auto levels = payload_levels(val);
+    for (std::size_t i = 0; i < PAYLOAD_BITS; ++i) {
+      REQUIRE(levels[i] == ((bytes[i / 8] >> (7 - i % 8)) & 1));
+    }
+  }
+
+  for (auto cmd : ALL_COMMANDS) {
+    const auto &levels = command_levels(cmd);
+    for (std::size_t i = 0; i < levels.size(); ++i) {
+      REQUIRE(levels[i] == ((static_cast<std::uint8_t>(cmd) >> (7 - i)) & 1));
+    }
+    const auto transaction = transaction_levels(cmd, 0x1234);
+    REQUIRE(std::equal(levels.begin(), levels.end(), transaction.begin()));
+    const auto payload = payload_levels(0x1234);
+    REQUIRE(std::equal(payload.begin(), payload.end(),
+                       transaction.begin() + 8));
+  }
+}
@@ -7,6 +7,13 @@
 #include <MockGPIO.hpp>
 #include <Region.hpp>
 
+#include <filesystem>
+#include <string_view>
+#include <system_error>
+
+#include <fmt/format.h>
+#include <unistd.h>
+
 template <typename T> bool in_state(PIC18Q20StateImpl &state) {
   struct prog : SelectiveVisitor {
     void visit(T &p) override { res = true; }
@@ -23,4 +30,22 @@ struct TestObjects {
   std::shared_ptr<MockGPIO> gpio;
   std::shared_ptr<MockPIC18Q20> pic;
 };
-inline auto setup() { return TestObjects{}; }
\ No newline at end of file
+inline auto setup() { return TestObjects{}; }
+
+// A file or directory path in the temporary directory, unique per process,
+// removed (with its content) when leaving the scope, even if the test fails
+struct TempPath {
+  explicit TempPath(std::string_view name)
+      : path{std::filesystem::temp_directory_path() /
+             fmt::format("icsp_test_{}_{}", ::getpid(), name)} {
+    // left over by a crashed run
+    std::filesystem::remove_all(path);
+  }
+  TempPath(const TempPath &) = delete;
+  TempPath &operator=(const TempPath &) = delete;
+  ~TempPath() {
+    std::error_code ec;
+    std::filesystem::remove_all(path, ec);
+  }
+  std::filesystem::path path;
+};